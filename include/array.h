@@ -0,0 +1,9 @@
+#ifndef CLOX_ARRAY_H
+#define CLOX_ARRAY_H
+
+// defines the typed array constructors and the natives running over whole
+// arrays: float64Array, int32Array, uint8Array, arraySum, arrayDot,
+// arrayScale, arrayAdd, arrayMin, arrayMax, arrayFill and arrayCopy.
+void defineArrayNatives();
+
+#endif
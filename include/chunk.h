@@ -11,6 +11,7 @@ typedef enum {
   OP_FALSE,
   OP_POP,
   OP_GET_LOCAL,
+  OP_GET_LOCAL_GET_LOCAL,
   OP_SET_LOCAL,
   OP_GET_UPVALUE,
   OP_SET_UPVALUE,
@@ -26,15 +27,73 @@ typedef enum {
   OP_SUB,
   OP_MUL,
   OP_DIV,
+  OP_MOD,
+  OP_QUOTIENT,
+  // forms the interpreter rewrites the generic arithmetic and comparisons
+  // into once it has seen their operands. they turn back into the generic
+  // form when the operands are of another type.
+  OP_ADD_NUMBER,
+  OP_ADD_STRING,
+  OP_SUB_NUMBER,
+  OP_MUL_NUMBER,
+  OP_DIV_NUMBER,
+  OP_GREATER_NUMBER,
+  OP_LESS_NUMBER,
+  OP_ADD_INT,
+  OP_SUB_INT,
+  OP_MUL_INT,
+  OP_GREATER_INT,
+  OP_LESS_INT,
+  OP_ADD_LOCAL_CONST,
   OP_JUMP,
   OP_JUMP_IF_FALSE,
+  OP_JUMP_IF_TRUE,
   OP_LOOP,
+  OP_LOCAL_LESS_CONST_JUMP,
+  // long jumps end with a 32 bit distance instead of a 16 bit one.
+  OP_JUMP_LONG,
+  OP_JUMP_IF_FALSE_LONG,
+  OP_JUMP_IF_TRUE_LONG,
+  OP_LOOP_LONG,
+  OP_LOCAL_LESS_CONST_JUMP_LONG,
+  OP_BUILD_LIST,
+  OP_BUILD_MAP,
+  OP_INDEX_GET,
+  OP_INDEX_SET,
+  // the name constant and the cache index of the function.
+  OP_GET_PROPERTY,
+  OP_SET_PROPERTY,
+  OP_GET_SUPER,
+  // the name constant, the argument count and the cache index.
+  OP_INVOKE,
+  OP_SUPER_INVOKE,
   OP_CLOSE_UPVALUE,
   OP_CLOSURE,
   OP_CALL,
+  OP_CALL_0,
+  OP_CALL_1,
+  OP_CALL_2,
+  OP_CALL_3,
+  OP_TAIL_CALL,
+  OP_TAIL_CALL_0,
+  OP_TAIL_CALL_1,
+  OP_TAIL_CALL_2,
+  OP_TAIL_CALL_3,
+  OP_CALL_NATIVE,
+  OP_TAIL_CALL_NATIVE,
   OP_RETURN,
+  OP_CLASS,
+  OP_INHERIT,
+  OP_METHOD,
 } OpCode;
 
+// how OP_CLOSURE captures each upvalue, the byte before its index.
+typedef enum {
+  CAPTURE_UPVALUE,  // an upvalue of the enclosing closure, shared.
+  CAPTURE_LOCAL,    // a local of the enclosing frame, by reference.
+  CAPTURE_COPY,     // a local never assigned after its declaration, by value.
+} CaptureKind;
+
 typedef struct {
   int size;
   int capacity;
@@ -47,5 +106,15 @@ void initChunk(Chunk *chunk);
 void writeChunk(Chunk *chunk, uint8_t byte, int line);
 void freeChunk(Chunk *chunk);
 int addConstant(Chunk *chunk, Value value);
+// size in bytes of the instruction at offset, operands included.
+int instructionLength(Chunk *chunk, int offset);
+// offset the jump at offset goes to.
+int jumpTarget(Chunk *chunk, int offset);
+bool isJumpOp(uint8_t op);
+// the long form of a short jump, or op itself for anything else.
+uint8_t longJumpOp(uint8_t op);
+// stores distance in the operand ending at end, 32 bits wide for the long
+// forms and 16 otherwise.
+void storeJumpDistance(uint8_t *end, bool wide, int distance);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+#ifndef CLOX_H
+#define CLOX_H
+
+// public interface for embedding the interpreter in a host program.
+//
+// vms and programs are only handled through pointers, their layout is not
+// part of the interface. values handed to the host stay valid until the vm
+// that created them is freed, objects are never moved or collected before
+// that.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct VM CloxVM;
+typedef struct Program CloxProgram;
+
+// a value of the language. hosts make and read values with the functions
+// below and never look inside.
+typedef struct {
+  uint64_t opaque[2];
+} CloxValue;
+
+typedef enum {
+  CLOX_OK,
+  CLOX_COMPILE_ERROR,
+  CLOX_RUNTIME_ERROR,
+} CloxResult;
+
+// natives store their return value in result, or report an error with
+// cloxError() and return its result.
+typedef bool (*CloxNativeFn)(int arg_count, CloxValue *args,
+                             CloxValue *result);
+
+// the arity of natives that take any number of arguments.
+#define CLOX_VARIADIC (-1)
+
+// the most arguments a call can pass.
+#define CLOX_ARGS_MAX 255
+
+CloxVM *cloxNewVM();
+void cloxFreeVM(CloxVM *instance);
+
+// compiles source once into a program any number of vms, on any thread, can
+// run. NULL when it does not compile.
+CloxProgram *cloxCompile(const char *source);
+CloxProgram *cloxRetainProgram(CloxProgram *program);
+void cloxReleaseProgram(CloxProgram *program);
+
+CloxResult cloxInterpret(CloxVM *instance, const char *source);
+// the first run of a program on a vm loads it, later runs reuse what it
+// loaded.
+CloxResult cloxRunProgram(CloxVM *instance, CloxProgram *program);
+// writes out what the vm printed, which is otherwise held until a script
+// finishes, the output buffer fills or a line ends on a terminal.
+void cloxFlush(CloxVM *instance);
+
+// arity is checked before calling fn unless it is CLOX_VARIADIC. false, and
+// nothing is defined, when arity is neither that nor 0 to CLOX_ARGS_MAX.
+bool cloxDefineNative(CloxVM *instance, const char *name, int arity,
+                      CloxNativeFn fn);
+// reports a runtime error from within a native, natives return its result.
+bool cloxError(const char *format, ...);
+
+bool cloxGetGlobal(CloxVM *instance, const char *name, CloxValue *value);
+void cloxSetGlobal(CloxVM *instance, const char *name, CloxValue value);
+
+// calls a lox closure or native from the host, or from within a native of
+// any vm. at most CLOX_ARGS_MAX arguments.
+CloxResult cloxCall(CloxVM *instance, CloxValue callee, int arg_count,
+                    CloxValue *args, CloxValue *result);
+
+// false when the stack is full. popping an empty stack, or peeking past its
+// bottom, gives nil.
+bool cloxPush(CloxVM *instance, CloxValue value);
+CloxValue cloxPop(CloxVM *instance);
+CloxValue cloxPeek(CloxVM *instance, int distance);
+
+CloxValue cloxNil();
+bool cloxIsNil(CloxValue value);
+CloxValue cloxBool(bool boolean);
+bool cloxIsBool(CloxValue value);
+bool cloxAsBool(CloxValue value);
+// ints and doubles are both numbers, cloxAsNumber reads either as a double.
+CloxValue cloxNumber(double number);
+CloxValue cloxInt(int64_t integer);
+bool cloxIsNumber(CloxValue value);
+bool cloxIsInt(CloxValue value);
+double cloxAsNumber(CloxValue value);
+int64_t cloxAsInt(CloxValue value);
+
+CloxValue cloxString(CloxVM *instance, const char *chars, int length);
+bool cloxIsString(CloxValue value);
+const char *cloxStringChars(CloxValue value, int *length);
+
+// wraps host memory in a buffer without copying it, the bytes must outlive
+// the vm and are never freed by it.
+CloxValue cloxWrapBuffer(CloxVM *instance, uint8_t *bytes, int length);
+// allocates a buffer owned by the vm.
+CloxValue cloxNewBuffer(CloxVM *instance, int length);
+bool cloxIsBuffer(CloxValue value);
+uint8_t *cloxBufferBytes(CloxValue value, int *length);
+
+#endif
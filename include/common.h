@@ -12,4 +12,8 @@
 
 #define UINT8_COUNT (UINT8_MAX + 1)
 
+// state that must not be shared between threads, each thread running its own
+// vm.
+#define CLOX_THREAD_LOCAL __thread
+
 #endif
\ No newline at end of file
@@ -4,6 +4,17 @@
 #include "object.h"
 #include "vm.h"
 
+typedef struct {
+  bool optimize;   // run the peephole optimizer over every finished chunk.
+  bool registers;  // run functions as register code where they translate.
+  bool jit;        // compile hot functions to machine code where supported.
+} CompilerOptions;
+
+// set before compiling; shared by every thread.
+extern CompilerOptions compiler_options;
+
 ObjFunction *compile(const char *source);
+// picks the tier a finished function starts in from the options.
+void chooseTier(ObjFunction *function);
 
 #endif
\ No newline at end of file
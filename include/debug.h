@@ -2,8 +2,11 @@
 #define CLOX_DEBUG_H
 
 #include "chunk.h"
+#include "object.h"
 
 void disassembleChunk(Chunk *chunk, const char *name);
 int disassembleOp(Chunk *chunk, int i);
+void disassembleRegisters(ObjFunction *function);
+int disassembleRegisterOp(ObjFunction *function, int offset);
 
 #endif
\ No newline at end of file
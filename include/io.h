@@ -0,0 +1,15 @@
+#ifndef CLOX_IO_H
+#define CLOX_IO_H
+
+#include "object.h"
+
+// the size of the block files are read into, which grows for longer lines.
+#define CLOX_FILE_BLOCK (64 * 1024)
+
+// defines the global stdin and the natives reading files: fileOpen,
+// fileReadLine, fileRead, fileReadInto and fileClose.
+void defineIoNatives();
+// releases the block of a file and closes it, unless it is stdin.
+void closeFile(ObjFile *file);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef CLOX_JIT_H
+#define CLOX_JIT_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+// calls and loop iterations a warming function runs interpreted before it
+// gets compiled.
+#ifndef CLOX_JIT_THRESHOLD
+#define CLOX_JIT_THRESHOLD 100
+#endif
+
+typedef enum {
+  JIT_RETURNED,  // the frame returned and its result was pushed.
+  JIT_FALLBACK,  // the frame goes on interpreted from its ip.
+  JIT_ERROR,     // a runtime error was reported.
+} JitExit;
+
+// machine code for the chunk of a function. it works on the same stack and
+// frames as the interpreter, so it can be entered at any instruction and
+// leave to the interpreter at any instruction it does not handle, or whose
+// operands it does not expect.
+typedef struct JitCode {
+  uint8_t *code;
+  size_t size;
+  int *entries;  // code offset of each instruction of the chunk, or -1.
+  int entry_count;
+} JitCode;
+
+// returns NULL when the platform has no jit or the code cannot be mapped.
+JitCode *compileNative(ObjFunction *function);
+void freeJitCode(JitCode *code);
+// runs the frame on top from the instruction at offset.
+JitExit enterNative(JitCode *code, CallFrame *frame, int offset);
+
+// the runtime entry points the generated code calls with vm->sp in sync,
+// defined in vm.c. the calls return false after reporting a runtime error.
+bool jitCall(int arg_count);
+bool jitCallGlobal(ObjString *name, int arg_count);
+// whether the global still holds a native, without reporting anything.
+bool jitHoldsNative(ObjString *name);
+bool jitInvoke(ObjString *name, int arg_count, PropertyCache *cache);
+// calls with the superclass on top of the arguments.
+bool jitInvokeSuper(ObjString *name, int arg_count);
+// runs the OP_CLOSURE whose operands start at frame->ip.
+void jitClosure(CallFrame *frame);
+void jitCloseUpvalue(Value *last);
+void jitBuildList(int item_count);
+bool jitBuildMap(int entry_count);
+// run a property instruction missing its cache, refilling it.
+bool jitGetProperty(ObjString *name, PropertyCache *cache);
+bool jitSetProperty(ObjString *name, PropertyCache *cache);
+void jitReturn(CallFrame *frame);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef CLOX_NUMBER_H
+#define CLOX_NUMBER_H
+
+#include "common.h"
+
+// write the text of a number, terminated, and return its length. ints are
+// in full, doubles in the shortest digits that read back as the same double.
+int formatInt(int64_t integer, char *text);
+int formatDouble(double number, char *text);
+
+#endif
@@ -2,35 +2,93 @@
 #define CLOX_OBJECT_H
 
 #include "chunk.h"
+#include "clox.h"
 #include "common.h"
+#include "table.h"
 #include "value.h"
 
+// the longest concatenation that is interned. longer ones are rarely looked
+// up or compared, so hashing them up front is mostly wasted.
+#ifndef CLOX_INTERN_MAX
+#define CLOX_INTERN_MAX 64
+#endif
+
 typedef enum {
   OBJ_STRING,
   OBJ_FUNCTION,
   OBJ_CLOSURE,
   OBJ_NATIVE_FN,
   OBJ_UPVALUE,
+  OBJ_BUFFER,
+  OBJ_ARRAY,
+  OBJ_STRING_BUILDER,
+  OBJ_FILE,
+  OBJ_LIST,
+  OBJ_MAP,
+  OBJ_CLASS,
+  OBJ_INSTANCE,
+  OBJ_BOUND_METHOD,
+  OBJ_SHAPE,
 } ObjType;
 
+struct Program;
+struct RegisterCode;
+struct JitCode;
+struct ObjShape;
+struct ObjClosure;
+
+// how calls run a function.
+typedef enum {
+  TIER_STACK,      // the chunk, in run().
+  TIER_REGISTERS,  // the register code, in runRegisters().
+  TIER_WARMING,    // the chunk, counting calls and loops until it is jitted.
+  TIER_NATIVE,     // machine code from the jit.
+} FunctionTier;
+
 typedef struct Obj {
   ObjType type;
   struct Obj *next;
 } Obj;
 
-typedef struct {
+// strings made by copyString and short concatenations are interned, so that
+// equal ones are the same object. longer ones and those natives make are
+// not, and are only hashed when they need to be.
+typedef struct ObjString {
   Obj obj;
   int length;
-  uint32_t hash;
+  uint32_t hash;  // valid once hashed, which interned strings always are.
+  bool hashed;
+  bool interned;
   char chars[];
 } ObjString;
 
+// the monomorphic inline cache of a property instruction, valid for the
+// instances of shape. a field is at slot, and a write adding it moves the
+// instance to transition. method is set when the property is a method.
+typedef struct {
+  struct ObjShape *shape;
+  int slot;
+  struct ObjShape *transition;
+  struct ObjClosure *method;
+} PropertyCache;
+
 typedef struct {
   Obj obj;
   int arity;
   Chunk chunk;
   ObjString *name;
   uint8_t upvalue_count;
+  // when loaded from a shared program the code and lines of the chunk are
+  // borrowed from it, only the constants belong to the function.
+  struct Program *program;
+  FunctionTier tier;
+  int hotness;  // calls and loop iterations while warming.
+  struct RegisterCode *registers;
+  struct JitCode *jit;
+  // indexed by the cache operand of the property instructions, and never
+  // shared with other vms even when the code is.
+  PropertyCache *caches;
+  int cache_count;
 } ObjFunction;
 
 typedef struct ObjUpValue {
@@ -40,49 +98,242 @@ typedef struct ObjUpValue {
   struct ObjUpValue *next;
 } ObjUpvalue;
 
-typedef struct {
+typedef struct ObjClosure {
   Obj obj;
   ObjFunction *function;
   ObjUpvalue **upvalues;
   int upvalue_count;
+  // closed cells of the upvalues captured by copy, allocated with the first
+  // one. they are not objects of the vm and never on the open list.
+  ObjUpvalue *copies;
 } ObjClosure;
 
-typedef Value (*NativeFn)(int args_count, Value *args);
+// natives store their return value in result, or report an error with
+// nativeError() and return false.
+typedef bool (*NativeFn)(int args_count, Value *args, Value *result);
+
+typedef enum {
+  NATIVE_VARIADIC = 1 << 0,  // takes any number of arguments.
+} NativeFlags;
 
 typedef struct {
   Obj obj;
   NativeFn function;
+  // set instead of function for the natives of a host, which see the
+  // arguments and result as copies in CloxValue.
+  CloxNativeFn host;
+  int arity;
+  uint8_t flags;
 } ObjNativeFn;
 
+typedef struct {
+  Obj obj;
+  int length;
+  uint8_t *bytes;
+  // external bytes belong to the host and are never freed by the vm.
+  bool is_external;
+} ObjBuffer;
+
+// the element types of typed arrays.
+typedef enum {
+  ARRAY_FLOAT64,
+  ARRAY_INT32,
+  ARRAY_UINT8,
+} ArrayKind;
+
+// a fixed number of unboxed numbers of one kind, stored contiguously.
+typedef struct {
+  Obj obj;
+  ArrayKind kind;
+  int length;
+  union {
+    double *float64;
+    int32_t *int32;
+    uint8_t *uint8;
+  } elements;
+} ObjArray;
+
+// text being put together, only interned once it is made a string.
+typedef struct {
+  Obj obj;
+  int length;
+  int capacity;
+  char *chars;
+} ObjStringBuilder;
+
+// a file read through a block of its bytes, or through a mapping of all of
+// them when it is a regular file. lines and chunks are cut from the block
+// without a system call each.
+typedef struct {
+  Obj obj;
+  int fd;  // -1 once closed.
+  bool mapped;
+  bool at_end;  // nothing is left to read into the block.
+  char *block;
+  size_t capacity;  // of the block, or the size of the mapping.
+  size_t start;     // of the bytes not taken yet.
+  size_t end;       // of the bytes in the block.
+} ObjFile;
+
+typedef struct {
+  Obj obj;
+  ValueArray items;
+} ObjList;
+
+typedef struct {
+  Obj obj;
+  Table table;
+} ObjMap;
+
+// a hidden class: the fields of an instance in the order they were added.
+// instances of a class that got the same fields in the same order share
+// their shape, which gives the slot of each field.
+typedef struct ObjShape {
+  Obj obj;
+  struct ObjShape *parent;
+  ObjString *name;  // of the last field, NULL for the shape without fields.
+  int slot_count;
+  struct ObjClass *klass;
+  Table transitions;  // field name to the shape adding it to this one.
+} ObjShape;
+
+typedef struct ObjClass {
+  Obj obj;
+  ObjString *name;
+  Table methods;
+  ObjShape *shape;  // of new instances.
+  int field_count;  // most fields an instance got, allocated up front.
+} ObjClass;
+
+typedef struct {
+  Obj obj;
+  ObjShape *shape;
+  Value *fields;
+  int field_capacity;
+} ObjInstance;
+
+typedef struct {
+  Obj obj;
+  Value receiver;
+  ObjClosure *method;
+} ObjBoundMethod;
+
 #define OBJ_TYPE(value) (AS_OBJ(value)->type)
 
 #define IS_STRING(value) isObjType(value, OBJ_STRING)
 #define IS_FUNCTION(value) isObjType(value, OBJ_FUNCTION)
 #define IS_CLOSURE(value) isObjType(value, OBJ_CLOSURE)
 #define IS_NATIVE_FN(value) isObjType(value, OBJ_NATIVE_FN)
+#define IS_BUFFER(value) isObjType(value, OBJ_BUFFER)
+#define IS_ARRAY(value) isObjType(value, OBJ_ARRAY)
+#define IS_STRING_BUILDER(value) isObjType(value, OBJ_STRING_BUILDER)
+#define IS_FILE(value) isObjType(value, OBJ_FILE)
+#define IS_LIST(value) isObjType(value, OBJ_LIST)
+#define IS_MAP(value) isObjType(value, OBJ_MAP)
+#define IS_CLASS(value) isObjType(value, OBJ_CLASS)
+#define IS_INSTANCE(value) isObjType(value, OBJ_INSTANCE)
+#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
 
 #define AS_STRING(value) ((ObjString *)AS_OBJ(value))
 #define AS_CSTRING(value) (((ObjString *)AS_OBJ(value))->chars)
 #define AS_FUNCTION(value) ((ObjFunction *)AS_OBJ(value))
 #define AS_CLOSURE(value) ((ObjClosure *)AS_OBJ(value))
 #define AS_NATIVE_FN(value) ((ObjNativeFn *)AS_OBJ(value))
+#define AS_BUFFER(value) ((ObjBuffer *)AS_OBJ(value))
+#define AS_ARRAY(value) ((ObjArray *)AS_OBJ(value))
+#define AS_STRING_BUILDER(value) ((ObjStringBuilder *)AS_OBJ(value))
+#define AS_FILE(value) ((ObjFile *)AS_OBJ(value))
+#define AS_LIST(value) ((ObjList *)AS_OBJ(value))
+#define AS_MAP(value) ((ObjMap *)AS_OBJ(value))
+#define AS_CLASS(value) ((ObjClass *)AS_OBJ(value))
+#define AS_INSTANCE(value) ((ObjInstance *)AS_OBJ(value))
+#define AS_BOUND_METHOD(value) ((ObjBoundMethod *)AS_OBJ(value))
 
+// a string that is not interned, with room for length characters.
 ObjString *newString(const int length);
+// the interned string equal to string, or NULL when there is none.
+ObjString *findInterned(ObjString *string);
+// the interned string equal to string, which becomes it when there is none.
+ObjString *internString(ObjString *string);
+// interned, for names and literals.
 ObjString *copyString(const char *chars, int length);
+// not interned, for the strings natives make.
+ObjString *makeString(const char *chars, int length);
 uint32_t hashString(const char *key, const int length);
 ObjString *stringConcat(ObjString *a, ObjString *b);
 
 ObjFunction *newFunction();
+void allocateCaches(ObjFunction *function);
 ObjClosure *newClosure(ObjFunction *function);
-ObjNativeFn *newNativeFn(NativeFn function);
+ObjNativeFn *newNativeFn(NativeFn function, int arity, uint8_t flags);
+ObjBuffer *newBuffer(int length);
+ObjBuffer *wrapBuffer(uint8_t *bytes, int length);
+// the elements start as zeros.
+ObjArray *newArray(ArrayKind kind, int length);
+const char *arrayKindName(ArrayKind kind);
+size_t arrayElementSize(ArrayKind kind);
+// stores value at index, or returns false when it does not fit the kind.
+bool arrayStore(ObjArray *array, int index, Value value);
+ObjStringBuilder *newStringBuilder();
+void appendChars(ObjStringBuilder *builder, const char *chars, int length);
+// a file that has not read anything yet.
+ObjFile *newFile(int fd);
+ObjList *newList();
+ObjMap *newMap();
+ObjClass *newClass(ObjString *name);
+ObjInstance *newInstance(ObjClass *klass);
+ObjBoundMethod *newBoundMethod(Value receiver, ObjClosure *method);
+// the slot of the field name in shape, or -1.
+int shapeSlot(ObjShape *shape, ObjString *name);
+ObjShape *shapeTransition(ObjShape *shape, ObjString *name);
+void growFields(ObjInstance *instance, int count);
 
 ObjUpvalue *newUpvalue(Value *slot);
 
-void printObject(Value value);
+void writeObject(Value value);
 bool objectsEqual(Value a, Value b);
 
 static inline bool isObjType(Value value, ObjType type) {
   return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
+// the hash of a string, computed on first use for the ones not interned.
+static inline uint32_t stringHash(ObjString *string) {
+  if (!string->hashed) {
+    string->hash = hashString(string->chars, string->length);
+    string->hashed = true;
+  }
+  return string->hash;
+}
+
+// the element index refers to, or -1 when it is not a whole number below
+// length.
+static inline int elementIndex(Value index, int length) {
+  if (IS_INT(index)) {
+    int64_t integer = AS_INT(index);
+    return integer >= 0 && integer < length ? (int)integer : -1;
+  }
+  if (!IS_NUMBER(index)) return -1;
+  double number = AS_NUMBER(index);
+  if (!(number >= 0 && number < length)) return -1;
+  return number == (int)number ? (int)number : -1;
+}
+
+static inline int listIndex(ObjList *list, Value index) {
+  return elementIndex(index, list->items.size);
+}
+
+static inline Value arrayLoad(ObjArray *array, int index) {
+  switch (array->kind) {
+    case ARRAY_FLOAT64:
+      return NUMBER_VAL(array->elements.float64[index]);
+    case ARRAY_INT32:
+      return INT_VAL(array->elements.int32[index]);
+    case ARRAY_UINT8:
+      return INT_VAL(array->elements.uint8[index]);
+  }
+
+  return NIL_VAL;  // unreachable.
+}
+
 #endif
\ No newline at end of file
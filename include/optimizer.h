@@ -0,0 +1,10 @@
+#ifndef CLOX_OPTIMIZER_H
+#define CLOX_OPTIMIZER_H
+
+#include "chunk.h"
+
+// rewrites a finished chunk in place with a peephole pass. the chunk is left
+// untouched if it cannot be re-encoded.
+void optimizeChunk(Chunk *chunk);
+
+#endif
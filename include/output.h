@@ -0,0 +1,27 @@
+#ifndef CLOX_OUTPUT_H
+#define CLOX_OUTPUT_H
+
+#include "common.h"
+#include "value.h"
+
+#define CLOX_OUTPUT_SIZE (64 * 1024)
+
+// what programs print, gathered by the vm and written to stdout a block at a
+// time. when stdout is a terminal every line is written as it ends instead.
+typedef struct {
+  int length;
+  bool line_buffered;
+  char bytes[CLOX_OUTPUT_SIZE];
+} Output;
+
+void initOutput(Output *output);
+// writes out what the output of the current vm holds.
+void flushOutput();
+void writeChars(const char *chars, int length);
+void writeText(const char *text);
+void writeNumber(Value number);
+void writeValue(Value value);
+// ends the line, written out right away when line buffered.
+void writeLine();
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef CLOX_PROGRAM_H
+#define CLOX_PROGRAM_H
+
+#include "common.h"
+#include "object.h"
+
+typedef enum {
+  LITERAL_NUMBER,
+  LITERAL_INT,
+  LITERAL_STRING,
+  LITERAL_FUNCTION,
+} LiteralType;
+
+// a constant as written in the source, independent of any vm heap.
+typedef struct {
+  LiteralType type;
+  union {
+    double number;
+    int64_t integer;
+    struct {
+      int length;
+      char *chars;
+    } string;
+    int function;  // index into the functions of the program.
+  } as;
+} Literal;
+
+typedef struct {
+  int arity;
+  uint8_t upvalue_count;
+  char *name;  // NULL for the top-level script.
+  int name_length;
+  int size;
+  uint8_t *code;
+  int *lines;
+  int literal_count;
+  Literal *literals;
+  int cache_count;
+} FunctionProto;
+
+// immutable compiled code that can be loaded by any number of vms, on any
+// thread, without copying the bytecode.
+typedef struct Program {
+  int ref_count;
+  int function_count;
+  int function_capacity;
+  FunctionProto *functions;  // the script is always the first function.
+} Program;
+
+Program *compileProgram(const char *source);
+Program *retainProgram(Program *program);
+void releaseProgram(Program *program);
+ObjFunction *loadProgram(Program *program);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef CLOX_REGISTER_H
+#define CLOX_REGISTER_H
+
+#include "common.h"
+#include "object.h"
+
+// register n is slot n of the call frame, so locals keep the slots the stack
+// code gives them and temporaries live right above them. the first operand
+// of an instruction that produces a value is its destination.
+typedef enum {
+  REG_MOVE,
+  REG_CONSTANT,
+  REG_NIL,
+  REG_TRUE,
+  REG_FALSE,
+  REG_GET_UPVALUE,
+  REG_SET_UPVALUE,
+  REG_DEF_GLOBAL,
+  REG_GET_GLOBAL,
+  REG_SET_GLOBAL,
+  REG_NOT,
+  REG_NEGATE,
+  REG_EQUAL,
+  REG_GREATER,
+  REG_LESS,
+  REG_ADD,
+  REG_SUB,
+  REG_MUL,
+  REG_DIV,
+  // the right operand is a constant.
+  REG_EQUAL_K,
+  REG_GREATER_K,
+  REG_LESS_K,
+  REG_ADD_K,
+  REG_SUB_K,
+  REG_MUL_K,
+  REG_DIV_K,
+  REG_JUMP,
+  REG_LOOP,
+  REG_JUMP_IF_FALSE,
+  REG_JUMP_IF_TRUE,
+  // comparisons fused with the conditional jump that consumes them.
+  REG_JUMP_IF_NOT_EQUAL,
+  REG_JUMP_IF_NOT_GREATER,
+  REG_JUMP_IF_NOT_LESS,
+  REG_JUMP_IF_NOT_EQUAL_K,
+  REG_JUMP_IF_NOT_GREATER_K,
+  REG_JUMP_IF_NOT_LESS_K,
+  // the callee is in the base register and the arguments follow it.
+  REG_CALL,
+  REG_TAIL_CALL,
+  REG_CALL_NATIVE,
+  REG_TAIL_CALL_NATIVE,
+  REG_CLOSURE,
+  REG_CLOSE_UPVALUE,
+  REG_RETURN,
+} RegisterOp;
+
+// operands are spelled with one character each: 'r' a register, 'k' a
+// constant, 'b' a plain byte, 'j' a forward and 'l' a backward 16 bit jump.
+// closures are followed by the upvalue pairs of the stack code.
+typedef struct {
+  const char *name;
+  const char *operands;
+} RegisterOpInfo;
+
+extern const RegisterOpInfo register_ops[];
+
+// register code of a function. it shares the constants of the chunk.
+typedef struct RegisterCode {
+  int size;
+  uint8_t *code;
+  int *lines;
+} RegisterCode;
+
+// translates the stack code of a finished function, or returns NULL when it
+// cannot be expressed with registers and the function stays on the stack.
+RegisterCode *translateRegisters(ObjFunction *function);
+void freeRegisterCode(RegisterCode *code);
+int registerInstructionLength(ObjFunction *function, int offset);
+
+#endif
@@ -7,13 +7,17 @@ typedef enum {
   TOKEN_RIGHT_PAREN,
   TOKEN_LEFT_BRACE,
   TOKEN_RIGHT_BRACE,
+  TOKEN_LEFT_BRACKET,
+  TOKEN_RIGHT_BRACKET,
   TOKEN_COMMA,
+  TOKEN_COLON,
   TOKEN_DOT,
   TOKEN_MINUS,
   TOKEN_PLUS,
   TOKEN_SEMICOLON,
   TOKEN_SLASH,
   TOKEN_STAR,
+  TOKEN_PERCENT,
 
   // One or two character tokens.
   TOKEN_BANG,
@@ -24,6 +28,7 @@ typedef enum {
   TOKEN_GREATER_EQUAL,
   TOKEN_LESS,
   TOKEN_LESS_EQUAL,
+  TOKEN_TILDE_SLASH,
 
   // Literals.
   TOKEN_IDENTIFIER,
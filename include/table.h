@@ -4,19 +4,32 @@
 #include "common.h"
 #include "value.h"
 
+// deleted entries keep their place with a nil key until the next resize.
 typedef struct {
-  ObjString *key;
+  Value key;
   Value value;
 } Entry;
 
+// entries are kept in insertion order, and an open addressed index of
+// twice their capacity maps hashes to them. iterating is a walk over
+// entries[0, size) skipping nil keys.
 typedef struct {
-  int count;
+  int count;  // live entries.
+  int size;   // entries used, deleted ones included.
   int capacity;
   Entry *entries;
+  int *index;  // entry of each slot, or one of the SLOT_ markers.
 } Table;
 
 void initTable(Table *table);
 void freeTable(Table *table);
+// keys are numbers, bools or objects, compared as by valuesEqual. nil and
+// NaN are not keys.
+bool isTableKey(Value key);
+bool tableSetValue(Table *table, Value key, Value value);
+bool tableGetValue(Table *table, Value key, Value *value);
+bool tableDeleteValue(Table *table, Value key);
+// the string-keyed fast path used for globals and interning.
 bool tableSet(Table *table, ObjString *key, Value value);
 void tableUpdate(Table *dest, Table *src);
 bool tableGet(Table *table, ObjString *key, Value *value);
@@ -0,0 +1,9 @@
+#ifndef CLOX_TEXT_H
+#define CLOX_TEXT_H
+
+// defines the string builder natives, stringBuilder, sbAppend,
+// sbAppendNumber and sbToString, and the string natives strJoin, strRepeat,
+// strSub, strIndexOf, strCount and strSplit.
+void defineTextNatives();
+
+#endif
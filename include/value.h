@@ -4,12 +4,14 @@
 #include "common.h"
 
 typedef struct Obj Obj;
+typedef struct ObjString ObjString;
 
 typedef enum {
   VAL_BOOL,
   VAL_NIL,
   VAL_NUMBER,
   VAL_OBJ,
+  VAL_INT,
 } ValueType;
 
 typedef struct {
@@ -17,6 +19,7 @@ typedef struct {
   union {
     bool boolean;
     double number;
+    int64_t integer;
     Obj *obj;
   } as;
 } Value;
@@ -25,15 +28,25 @@ typedef struct {
 #define IS_NIL(value) ((value).type == VAL_NIL)
 #define IS_NUMBER(value) ((value).type == VAL_NUMBER)
 #define IS_OBJ(value) ((value).type == VAL_OBJ)
+#define IS_INT(value) ((value).type == VAL_INT)
+// ints and doubles are both numbers to the language.
+#define IS_NUMERIC(value) (IS_NUMBER(value) || IS_INT(value))
 
 #define AS_BOOL(value) ((value).as.boolean)
 #define AS_NUMBER(value) ((value).as.number)
 #define AS_OBJ(value) ((value).as.obj)
+#define AS_INT(value) ((value).as.integer)
+#define AS_DOUBLE(value) \
+  (IS_INT(value) ? (double)AS_INT(value) : AS_NUMBER(value))
 
 #define BOOL_VAL(value) ((Value){VAL_BOOL, {.boolean = value}})
 #define NIL_VAL ((Value){VAL_NIL, {.number = 0}})
 #define NUMBER_VAL(value) ((Value){VAL_NUMBER, {.number = value}})
 #define OBJ_VAL(object) ((Value){VAL_OBJ, {.obj = (Obj *)object}})
+#define INT_VAL(value) ((Value){VAL_INT, {.integer = value}})
+
+// the longest text of a number, terminator included.
+#define NUMBER_TEXT_MAX 32
 
 typedef struct {
   int capacity;
@@ -45,7 +58,23 @@ void initValueArray(ValueArray *array);
 void writeValueArray(ValueArray *array, Value value);
 void freeValueArray(ValueArray *array);
 void printValue(Value value);
+// writes the text a number prints as and returns its length.
+int formatNumber(Value number, char *text);
 
 bool valuesEqual(Value a, Value b);
 
+// arithmetic on numbers. ints give exact ints unless the result overflows,
+// which is computed in doubles like anything with a double operand.
+Value addNumbers(Value a, Value b);
+Value subtractNumbers(Value a, Value b);
+Value multiplyNumbers(Value a, Value b);
+// always a double, 7 / 2 is 3.5.
+Value divideNumbers(Value a, Value b);
+Value negateNumber(Value a);
+bool lessNumbers(Value a, Value b);
+// the truncated quotient and its remainder, ints when both are ints. false
+// when an int is divided by the int 0.
+bool quotientNumbers(Value a, Value b, Value *result);
+bool remainderNumbers(Value a, Value b, Value *result);
+
 #endif
\ No newline at end of file
@@ -3,11 +3,13 @@
 
 #include "chunk.h"
 #include "object.h"
+#include "output.h"
 #include "table.h"
 #include "value.h"
 
 #define CLOX_FRAMES_MAX 64
-#define CLOX_VM_STACK_MAX (CLOX_FRAMES_MAX * UINT8_COUNT)
+// a window of slots for every frame, and one more for what hosts push.
+#define CLOX_VM_STACK_MAX ((CLOX_FRAMES_MAX + 1) * UINT8_COUNT)
 
 typedef struct {
   ObjClosure *closure;
@@ -15,15 +17,27 @@ typedef struct {
   Value *slots;
 } CallFrame;
 
+// the script of a program this vm has loaded, kept so running the program
+// again reuses its functions, constants and caches.
 typedef struct {
+  struct Program *program;
+  ObjClosure *script;
+} LoadedProgram;
+
+typedef struct VM {
   CallFrame frames[CLOX_FRAMES_MAX];
   int frame_count;
   Value stack[CLOX_VM_STACK_MAX];
   Value *sp;
   Table globals;
   Table strings;
+  ObjString *init_string;
   ObjUpvalue *open_upvalues;
   Obj *objects;
+  LoadedProgram *programs;
+  int program_count;
+  int program_capacity;
+  Output output;
 } VM;
 
 typedef enum {
@@ -32,12 +46,25 @@ typedef enum {
   INTERPRET_RUNTIME_ERROR
 } InterpretResult;
 
-extern VM vm;
+// the vm the calling thread is currently running.
+extern CLOX_THREAD_LOCAL VM *vm;
 
-void initVM();
-void freeVM();
+VM *newVM();
+void freeVM(VM *instance);
+void switchVM(VM *instance);
 InterpretResult interpret(const char *source);
+InterpretResult interpretProgram(struct Program *program);
+// calls the value below the top arg_count values of the stack, replacing
+// them with the result.
+InterpretResult callFunction(int arg_count);
 void push(Value value);
 Value pop();
 
+ObjNativeFn *defineNativeFn(const char *name, int arity, uint8_t flags,
+                            NativeFn fn);
+// calls a native of the host with copies of its arguments.
+bool callHostNative(ObjNativeFn *nativeFn, int arg_count, Value *args,
+                    Value *result);
+bool nativeError(const char *format, ...);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include <string.h>
+
+#include "array.h"
+#include "object.h"
+#include "value.h"
+#include "vm.h"
+
+// the kernels are plain loops over the elements that the compiler
+// vectorizes. sums of doubles are split into independent lanes since it may
+// not reorder a single chain of additions.
+#define LANES 4
+
+static double sumFloat64(const double *values, int length) {
+  double lanes[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= length; i += LANES) {
+    for (int lane = 0; lane < LANES; ++lane) lanes[lane] += values[i + lane];
+  }
+
+  double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < length; ++i) sum += values[i];
+  return sum;
+}
+
+static double dotFloat64(const double *a, const double *b, int length) {
+  double lanes[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= length; i += LANES) {
+    for (int lane = 0; lane < LANES; ++lane) {
+      lanes[lane] += a[i + lane] * b[i + lane];
+    }
+  }
+
+  double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < length; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+static int64_t sumInt32(const int32_t *values, int length) {
+  int64_t sum = 0;
+  for (int i = 0; i < length; ++i) sum += values[i];
+  return sum;
+}
+
+static int64_t sumUint8(const uint8_t *values, int length) {
+  int64_t sum = 0;
+  for (int i = 0; i < length; ++i) sum += values[i];
+  return sum;
+}
+
+// the extreme of the elements, which are not empty, that select picks. a NaN
+// anywhere is the extreme, as it is the result of any arithmetic on it.
+#define EXTREME(type, values, length, select)                          \
+  do {                                                                 \
+    type extreme = values[0];                                          \
+    for (int i = 1; i < length; ++i) {                                 \
+      bool nan = values[i] != values[i];                               \
+      extreme = nan || values[i] select extreme ? values[i] : extreme; \
+    }                                                                  \
+    return extreme;                                                    \
+  } while (0)
+
+static double minFloat64(const double *values, int length) {
+  EXTREME(double, values, length, <);
+}
+
+static double maxFloat64(const double *values, int length) {
+  EXTREME(double, values, length, >);
+}
+
+static int32_t minInt32(const int32_t *values, int length) {
+  EXTREME(int32_t, values, length, <);
+}
+
+static int32_t maxInt32(const int32_t *values, int length) {
+  EXTREME(int32_t, values, length, >);
+}
+
+static uint8_t minUint8(const uint8_t *values, int length) {
+  EXTREME(uint8_t, values, length, <);
+}
+
+static uint8_t maxUint8(const uint8_t *values, int length) {
+  EXTREME(uint8_t, values, length, >);
+}
+
+#undef EXTREME
+
+static bool isArrayOf(Value value, ArrayKind kind) {
+  return IS_ARRAY(value) && AS_ARRAY(value)->kind == kind;
+}
+
+// a new array of kind with a length, or with the elements of a list or of
+// another array.
+static bool makeArray(ArrayKind kind, Value from, Value *result) {
+  const char *name = arrayKindName(kind);
+  if (IS_NUMERIC(from)) {
+    if (elementIndex(from, INT32_MAX) < 0) {
+      return nativeError("%sArray() length must be a whole number", name);
+    }
+    *result = OBJ_VAL(newArray(kind, (int)AS_DOUBLE(from)));
+    return true;
+  }
+
+  int length;
+  if (IS_LIST(from)) {
+    length = AS_LIST(from)->items.size;
+  } else if (IS_ARRAY(from)) {
+    length = AS_ARRAY(from)->length;
+  } else {
+    return nativeError("%sArray() expects a length, a list or an array",
+                       name);
+  }
+
+  ObjArray *array = newArray(kind, length);
+  for (int i = 0; i < length; ++i) {
+    Value element = IS_LIST(from) ? AS_LIST(from)->items.values[i]
+                                  : arrayLoad(AS_ARRAY(from), i);
+    if (!arrayStore(array, i, element)) {
+      return nativeError("element %d does not fit in %s elements", i, name);
+    }
+  }
+
+  *result = OBJ_VAL(array);
+  return true;
+}
+
+static bool nativeFloat64Array(int arg_count, Value *args, Value *result) {
+  return makeArray(ARRAY_FLOAT64, args[0], result);
+}
+
+static bool nativeInt32Array(int arg_count, Value *args, Value *result) {
+  return makeArray(ARRAY_INT32, args[0], result);
+}
+
+static bool nativeUint8Array(int arg_count, Value *args, Value *result) {
+  return makeArray(ARRAY_UINT8, args[0], result);
+}
+
+// sums of int arrays are ints, which cannot overflow below 2^31 elements.
+static bool nativeArraySum(int arg_count, Value *args, Value *result) {
+  if (!IS_ARRAY(args[0])) return nativeError("arraySum() expects an array");
+
+  ObjArray *array = AS_ARRAY(args[0]);
+  switch (array->kind) {
+    case ARRAY_FLOAT64:
+      *result = NUMBER_VAL(sumFloat64(array->elements.float64, array->length));
+      break;
+    case ARRAY_INT32:
+      *result = INT_VAL(sumInt32(array->elements.int32, array->length));
+      break;
+    case ARRAY_UINT8:
+      *result = INT_VAL(sumUint8(array->elements.uint8, array->length));
+      break;
+  }
+  return true;
+}
+
+static bool nativeArrayDot(int arg_count, Value *args, Value *result) {
+  if (!isArrayOf(args[0], ARRAY_FLOAT64) ||
+      !isArrayOf(args[1], ARRAY_FLOAT64)) {
+    return nativeError("arrayDot() expects two float64 arrays");
+  }
+
+  ObjArray *a = AS_ARRAY(args[0]);
+  ObjArray *b = AS_ARRAY(args[1]);
+  if (a->length != b->length) {
+    return nativeError("arrayDot() of arrays of lengths %d and %d", a->length,
+                       b->length);
+  }
+
+  *result = NUMBER_VAL(
+      dotFloat64(a->elements.float64, b->elements.float64, a->length));
+  return true;
+}
+
+// multiplies every element in place.
+static bool nativeArrayScale(int arg_count, Value *args, Value *result) {
+  if (!isArrayOf(args[0], ARRAY_FLOAT64) || !IS_NUMERIC(args[1])) {
+    return nativeError("arrayScale() expects a float64 array and a number");
+  }
+
+  ObjArray *array = AS_ARRAY(args[0]);
+  double factor = AS_DOUBLE(args[1]);
+  double *values = array->elements.float64;
+  for (int i = 0; i < array->length; ++i) values[i] *= factor;
+
+  *result = NIL_VAL;
+  return true;
+}
+
+// adds the elements of the second array to those of the first.
+static bool nativeArrayAdd(int arg_count, Value *args, Value *result) {
+  if (!isArrayOf(args[0], ARRAY_FLOAT64) ||
+      !isArrayOf(args[1], ARRAY_FLOAT64)) {
+    return nativeError("arrayAdd() expects two float64 arrays");
+  }
+
+  ObjArray *a = AS_ARRAY(args[0]);
+  ObjArray *b = AS_ARRAY(args[1]);
+  if (a->length != b->length) {
+    return nativeError("arrayAdd() of arrays of lengths %d and %d", a->length,
+                       b->length);
+  }
+
+  double *to = a->elements.float64;
+  const double *from = b->elements.float64;
+  for (int i = 0; i < a->length; ++i) to[i] += from[i];
+
+  *result = NIL_VAL;
+  return true;
+}
+
+static bool nativeArrayMin(int arg_count, Value *args, Value *result) {
+  if (!IS_ARRAY(args[0])) return nativeError("arrayMin() expects an array");
+
+  ObjArray *array = AS_ARRAY(args[0]);
+  if (array->length == 0) return nativeError("arrayMin() of an empty array");
+
+  switch (array->kind) {
+    case ARRAY_FLOAT64:
+      *result = NUMBER_VAL(minFloat64(array->elements.float64, array->length));
+      break;
+    case ARRAY_INT32:
+      *result = INT_VAL(minInt32(array->elements.int32, array->length));
+      break;
+    case ARRAY_UINT8:
+      *result = INT_VAL(minUint8(array->elements.uint8, array->length));
+      break;
+  }
+  return true;
+}
+
+static bool nativeArrayMax(int arg_count, Value *args, Value *result) {
+  if (!IS_ARRAY(args[0])) return nativeError("arrayMax() expects an array");
+
+  ObjArray *array = AS_ARRAY(args[0]);
+  if (array->length == 0) return nativeError("arrayMax() of an empty array");
+
+  switch (array->kind) {
+    case ARRAY_FLOAT64:
+      *result = NUMBER_VAL(maxFloat64(array->elements.float64, array->length));
+      break;
+    case ARRAY_INT32:
+      *result = INT_VAL(maxInt32(array->elements.int32, array->length));
+      break;
+    case ARRAY_UINT8:
+      *result = INT_VAL(maxUint8(array->elements.uint8, array->length));
+      break;
+  }
+  return true;
+}
+
+static bool nativeArrayFill(int arg_count, Value *args, Value *result) {
+  if (!IS_ARRAY(args[0])) return nativeError("arrayFill() expects an array");
+
+  ObjArray *array = AS_ARRAY(args[0]);
+  *result = NIL_VAL;
+  if (array->length == 0) return true;
+  if (!arrayStore(array, 0, args[1])) {
+    return nativeError("value does not fit in %s elements",
+                       arrayKindName(array->kind));
+  }
+
+  switch (array->kind) {
+    case ARRAY_FLOAT64: {
+      double *values = array->elements.float64;
+      for (int i = 1; i < array->length; ++i) values[i] = values[0];
+      break;
+    }
+    case ARRAY_INT32: {
+      int32_t *values = array->elements.int32;
+      for (int i = 1; i < array->length; ++i) values[i] = values[0];
+      break;
+    }
+    case ARRAY_UINT8:
+      memset(array->elements.uint8, array->elements.uint8[0], array->length);
+      break;
+  }
+  return true;
+}
+
+// copies all the elements of the second array to the start of the first.
+static bool nativeArrayCopy(int arg_count, Value *args, Value *result) {
+  if (!IS_ARRAY(args[0]) || !IS_ARRAY(args[1]) ||
+      AS_ARRAY(args[0])->kind != AS_ARRAY(args[1])->kind) {
+    return nativeError("arrayCopy() expects two arrays of the same kind");
+  }
+
+  ObjArray *to = AS_ARRAY(args[0]);
+  ObjArray *from = AS_ARRAY(args[1]);
+  if (from->length > to->length) {
+    return nativeError("arrayCopy() of %d elements into an array of %d",
+                       from->length, to->length);
+  }
+
+  size_t size = arrayElementSize(from->kind) * from->length;
+  if (size > 0) memmove(to->elements.uint8, from->elements.uint8, size);
+  *result = NIL_VAL;
+  return true;
+}
+
+void defineArrayNatives() {
+  defineNativeFn("float64Array", 1, 0, nativeFloat64Array);
+  defineNativeFn("int32Array", 1, 0, nativeInt32Array);
+  defineNativeFn("uint8Array", 1, 0, nativeUint8Array);
+  defineNativeFn("arraySum", 1, 0, nativeArraySum);
+  defineNativeFn("arrayDot", 2, 0, nativeArrayDot);
+  defineNativeFn("arrayScale", 2, 0, nativeArrayScale);
+  defineNativeFn("arrayAdd", 2, 0, nativeArrayAdd);
+  defineNativeFn("arrayMin", 1, 0, nativeArrayMin);
+  defineNativeFn("arrayMax", 1, 0, nativeArrayMax);
+  defineNativeFn("arrayFill", 2, 0, nativeArrayFill);
+  defineNativeFn("arrayCopy", 2, 0, nativeArrayCopy);
+}
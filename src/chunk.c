@@ -28,10 +28,124 @@ void writeChunk(Chunk *chunk, uint8_t byte, int line) {
 void freeChunk(Chunk *chunk) {
   FREE_ARRAY(chunk->code, uint8_t, chunk->capacity);
   FREE_ARRAY(chunk->lines, int, chunk->capacity);
+  freeValueArray(&chunk->constants);
   initChunk(chunk);
 }
 
 int addConstant(Chunk *chunk, Value value) {
   writeValueArray(&chunk->constants, value);
   return chunk->constants.size - 1;
-}
\ No newline at end of file
+}
+int instructionLength(Chunk *chunk, int offset) {
+  switch (chunk->code[offset]) {
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_DEF_GLOBAL:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_CALL:
+    case OP_TAIL_CALL:
+    case OP_BUILD_LIST:
+    case OP_BUILD_MAP:
+    case OP_GET_SUPER:
+    case OP_CLASS:
+    case OP_METHOD:
+      return 2;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+    case OP_LOOP:
+    case OP_CALL_NATIVE:
+    case OP_TAIL_CALL_NATIVE:
+    case OP_GET_LOCAL_GET_LOCAL:
+    case OP_ADD_LOCAL_CONST:
+    case OP_SUPER_INVOKE:
+      return 3;
+    case OP_GET_PROPERTY:
+    case OP_SET_PROPERTY:
+      return 4;
+    case OP_JUMP_LONG:
+    case OP_JUMP_IF_FALSE_LONG:
+    case OP_JUMP_IF_TRUE_LONG:
+    case OP_LOOP_LONG:
+    case OP_LOCAL_LESS_CONST_JUMP:
+    case OP_INVOKE:
+      return 5;
+    case OP_LOCAL_LESS_CONST_JUMP_LONG:
+      return 7;
+    case OP_CLOSURE: {
+      Value function = chunk->constants.values[chunk->code[offset + 1]];
+      return 2 + 2 * AS_FUNCTION(function)->upvalue_count;
+    }
+    default:
+      return 1;
+  }
+}
+
+int jumpTarget(Chunk *chunk, int offset) {
+  int end = offset + instructionLength(chunk, offset);
+  uint8_t op = chunk->code[offset];
+  int distance = (chunk->code[end - 2] << 8) | chunk->code[end - 1];
+  switch (op) {
+    case OP_JUMP_LONG:
+    case OP_JUMP_IF_FALSE_LONG:
+    case OP_JUMP_IF_TRUE_LONG:
+    case OP_LOOP_LONG:
+    case OP_LOCAL_LESS_CONST_JUMP_LONG: {
+      uint8_t *operand = &chunk->code[end - 4];
+      distance = (int)((uint32_t)operand[0] << 24 | operand[1] << 16 |
+                       operand[2] << 8 | operand[3]);
+      break;
+    }
+    default:
+      break;
+  }
+  return op == OP_LOOP || op == OP_LOOP_LONG ? end - distance : end + distance;
+}
+
+bool isJumpOp(uint8_t op) {
+  switch (op) {
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+    case OP_LOOP:
+    case OP_LOCAL_LESS_CONST_JUMP:
+    case OP_JUMP_LONG:
+    case OP_JUMP_IF_FALSE_LONG:
+    case OP_JUMP_IF_TRUE_LONG:
+    case OP_LOOP_LONG:
+    case OP_LOCAL_LESS_CONST_JUMP_LONG:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint8_t longJumpOp(uint8_t op) {
+  switch (op) {
+    case OP_JUMP:
+      return OP_JUMP_LONG;
+    case OP_JUMP_IF_FALSE:
+      return OP_JUMP_IF_FALSE_LONG;
+    case OP_JUMP_IF_TRUE:
+      return OP_JUMP_IF_TRUE_LONG;
+    case OP_LOOP:
+      return OP_LOOP_LONG;
+    case OP_LOCAL_LESS_CONST_JUMP:
+      return OP_LOCAL_LESS_CONST_JUMP_LONG;
+    default:
+      return op;
+  }
+}
+
+void storeJumpDistance(uint8_t *end, bool wide, int distance) {
+  if (wide) {
+    end[-4] = (distance >> 24) & 0xff;
+    end[-3] = (distance >> 16) & 0xff;
+  }
+  end[-2] = (distance >> 8) & 0xff;
+  end[-1] = distance & 0xff;
+}
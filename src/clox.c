@@ -0,0 +1,245 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "clox.h"
+#include "object.h"
+#include "output.h"
+#include "program.h"
+#include "table.h"
+#include "value.h"
+#include "vm.h"
+
+// a CloxValue is the storage of a Value. this fails to compile if their
+// sizes ever part.
+typedef char CloxValueSizeCheck[sizeof(CloxValue) == sizeof(Value) ? 1 : -1];
+
+static Value toValue(CloxValue value) {
+  Value result;
+  memcpy(&result, &value, sizeof(Value));
+  return result;
+}
+
+static CloxValue fromValue(Value value) {
+  CloxValue result;
+  memcpy(&result, &value, sizeof(Value));
+  return result;
+}
+
+static CloxResult fromResult(InterpretResult result) {
+  switch (result) {
+    case INTERPRET_OK:
+      return CLOX_OK;
+    case INTERPRET_COMPILE_ERROR:
+      return CLOX_COMPILE_ERROR;
+    case INTERPRET_RUNTIME_ERROR:
+      return CLOX_RUNTIME_ERROR;
+  }
+
+  return CLOX_RUNTIME_ERROR;  // unreachable.
+}
+
+// every call runs on the vm it is given and makes the caller's vm current
+// again before returning, so a native can call into another vm.
+
+CloxVM *cloxNewVM() {
+  VM *previous = vm;
+  VM *instance = newVM();
+  switchVM(previous);
+  return instance;
+}
+
+void cloxFreeVM(CloxVM *instance) { freeVM(instance); }
+
+CloxProgram *cloxCompile(const char *source) { return compileProgram(source); }
+
+CloxProgram *cloxRetainProgram(CloxProgram *program) {
+  return retainProgram(program);
+}
+
+void cloxReleaseProgram(CloxProgram *program) { releaseProgram(program); }
+
+CloxResult cloxInterpret(CloxVM *instance, const char *source) {
+  VM *previous = vm;
+  switchVM(instance);
+  InterpretResult result = interpret(source);
+  switchVM(previous);
+  return fromResult(result);
+}
+
+CloxResult cloxRunProgram(CloxVM *instance, CloxProgram *program) {
+  VM *previous = vm;
+  switchVM(instance);
+  InterpretResult result = interpretProgram(program);
+  switchVM(previous);
+  return fromResult(result);
+}
+
+void cloxFlush(CloxVM *instance) {
+  VM *previous = vm;
+  switchVM(instance);
+  flushOutput();
+  switchVM(previous);
+}
+
+bool callHostNative(ObjNativeFn *nativeFn, int arg_count, Value *args,
+                    Value *result) {
+  CloxValue host_args[CLOX_ARGS_MAX];
+  memcpy(host_args, args, sizeof(Value) * arg_count);
+  CloxValue host_result = fromValue(*result);
+  if (!nativeFn->host(arg_count, host_args, &host_result)) return false;
+  *result = toValue(host_result);
+  return true;
+}
+
+bool cloxDefineNative(CloxVM *instance, const char *name, int arity,
+                      CloxNativeFn fn) {
+  if (arity != CLOX_VARIADIC && (arity < 0 || arity > CLOX_ARGS_MAX)) {
+    return false;
+  }
+
+  VM *previous = vm;
+  switchVM(instance);
+  uint8_t flags = arity == CLOX_VARIADIC ? NATIVE_VARIADIC : 0;
+  defineNativeFn(name, arity == CLOX_VARIADIC ? 0 : arity, flags, NULL)
+      ->host = fn;
+  switchVM(previous);
+  return true;
+}
+
+bool cloxError(const char *format, ...) {
+  char message[1024];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  return nativeError("%s", message);
+}
+
+bool cloxGetGlobal(CloxVM *instance, const char *name, CloxValue *value) {
+  VM *previous = vm;
+  switchVM(instance);
+  Value global;
+  bool found = tableGet(&vm->globals, copyString(name, strlen(name)), &global);
+  if (found) *value = fromValue(global);
+  switchVM(previous);
+  return found;
+}
+
+void cloxSetGlobal(CloxVM *instance, const char *name, CloxValue value) {
+  VM *previous = vm;
+  switchVM(instance);
+  tableSet(&vm->globals, copyString(name, strlen(name)), toValue(value));
+  switchVM(previous);
+}
+
+// the callee and its arguments open a window of the stack, which must leave
+// room for one per frame the call can still push.
+static bool checkCall(int arg_count) {
+  if (arg_count < 0 || arg_count > CLOX_ARGS_MAX) {
+    return nativeError("cannot call with %d arguments", arg_count);
+  }
+  if (vm->sp + (CLOX_FRAMES_MAX - vm->frame_count) * UINT8_COUNT >
+      vm->stack + CLOX_VM_STACK_MAX) {
+    return nativeError("stack overflow");
+  }
+  return true;
+}
+
+CloxResult cloxCall(CloxVM *instance, CloxValue callee, int arg_count,
+                    CloxValue *args, CloxValue *result) {
+  VM *previous = vm;
+  switchVM(instance);
+
+  InterpretResult status = INTERPRET_RUNTIME_ERROR;
+  if (checkCall(arg_count)) {
+    push(toValue(callee));
+    for (int i = 0; i < arg_count; ++i) push(toValue(args[i]));
+
+    status = callFunction(arg_count);
+    if (status == INTERPRET_OK) *result = fromValue(pop());
+  }
+
+  switchVM(previous);
+  return fromResult(status);
+}
+
+bool cloxPush(CloxVM *instance, CloxValue value) {
+  if (instance->sp == instance->stack + CLOX_VM_STACK_MAX) return false;
+  *instance->sp++ = toValue(value);
+  return true;
+}
+
+CloxValue cloxPop(CloxVM *instance) {
+  if (instance->sp == instance->stack) return cloxNil();
+  return fromValue(*--instance->sp);
+}
+
+CloxValue cloxPeek(CloxVM *instance, int distance) {
+  if (distance < 0 || distance >= instance->sp - instance->stack) {
+    return cloxNil();
+  }
+  return fromValue(instance->sp[-1 - distance]);
+}
+
+CloxValue cloxNil() { return fromValue(NIL_VAL); }
+
+bool cloxIsNil(CloxValue value) { return IS_NIL(toValue(value)); }
+
+CloxValue cloxBool(bool boolean) { return fromValue(BOOL_VAL(boolean)); }
+
+bool cloxIsBool(CloxValue value) { return IS_BOOL(toValue(value)); }
+
+bool cloxAsBool(CloxValue value) { return AS_BOOL(toValue(value)); }
+
+CloxValue cloxNumber(double number) { return fromValue(NUMBER_VAL(number)); }
+
+CloxValue cloxInt(int64_t integer) { return fromValue(INT_VAL(integer)); }
+
+bool cloxIsNumber(CloxValue value) { return IS_NUMERIC(toValue(value)); }
+
+bool cloxIsInt(CloxValue value) { return IS_INT(toValue(value)); }
+
+double cloxAsNumber(CloxValue value) { return AS_DOUBLE(toValue(value)); }
+
+int64_t cloxAsInt(CloxValue value) { return AS_INT(toValue(value)); }
+
+CloxValue cloxString(CloxVM *instance, const char *chars, int length) {
+  VM *previous = vm;
+  switchVM(instance);
+  Value string = OBJ_VAL(copyString(chars, length));
+  switchVM(previous);
+  return fromValue(string);
+}
+
+bool cloxIsString(CloxValue value) { return IS_STRING(toValue(value)); }
+
+const char *cloxStringChars(CloxValue value, int *length) {
+  ObjString *string = AS_STRING(toValue(value));
+  if (length) *length = string->length;
+  return string->chars;
+}
+
+CloxValue cloxWrapBuffer(CloxVM *instance, uint8_t *bytes, int length) {
+  VM *previous = vm;
+  switchVM(instance);
+  Value buffer = OBJ_VAL(wrapBuffer(bytes, length));
+  switchVM(previous);
+  return fromValue(buffer);
+}
+
+CloxValue cloxNewBuffer(CloxVM *instance, int length) {
+  VM *previous = vm;
+  switchVM(instance);
+  Value buffer = OBJ_VAL(newBuffer(length));
+  switchVM(previous);
+  return fromValue(buffer);
+}
+
+bool cloxIsBuffer(CloxValue value) { return IS_BUFFER(toValue(value)); }
+
+uint8_t *cloxBufferBytes(CloxValue value, int *length) {
+  ObjBuffer *buffer = AS_BUFFER(toValue(value));
+  if (length) *length = buffer->length;
+  return buffer->bytes;
+}
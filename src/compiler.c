@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,7 +7,11 @@
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
+#include "memory.h"
+#include "optimizer.h"
+#include "register.h"
 #include "scanner.h"
+#include "table.h"
 
 typedef struct {
   Token current;
@@ -18,6 +23,7 @@ typedef struct {
 typedef struct {
   Token name;
   bool is_captured;
+  bool is_assigned;  // after its declaration, directly or by a closure.
   int depth;
 } Local;
 
@@ -28,6 +34,8 @@ typedef struct {
 
 typedef enum {
   TYPE_FUNCTION,
+  TYPE_INITIALIZER,
+  TYPE_METHOD,
   TYPE_SCRIPT,
 } FunctionType;
 
@@ -40,8 +48,43 @@ typedef struct Compiler {
   Local locals[UINT8_COUNT];
   int local_count;
   int scope_depth;
+
+  // offsets used to specialize the last emitted instructions.
+  int last_get_global;
+  int last_get_local;
+  int last_add_local;  // start of a 'local = local + constant' assignment.
+  int last_call;
+  int last_jump_target;
+
+  // string constants already in the chunk, mapped to their index.
+  Table string_constants;
+
+  // offsets of the OP_CLOSURE pairs capturing locals still in scope, patched
+  // to copies when the scope ends if the local was never assigned.
+  int *captures;
+  int capture_count;
+  int capture_capacity;
+
+  // forward jumps too far for their 16 bit operand, as pairs of the offset
+  // of the jump and of its target. they are widened when the function ends.
+  int *long_jumps;
+  int long_jump_count;
+  int long_jump_capacity;
 } Compiler;
 
+typedef struct ClassCompiler {
+  struct ClassCompiler *enclosing;
+  bool has_superclass;
+} ClassCompiler;
+
+// identifiers interned during the current compilation. probed with a cheap
+// hash of the token text so repeated names skip hashString and vm->strings.
+typedef struct {
+  int count;
+  int capacity;
+  ObjString **strings;
+} SymbolCache;
+
 // precedence from lowest to highest
 typedef enum {
   PREC_NONE,
@@ -51,7 +94,7 @@ typedef enum {
   PREC_EQUALITY,    // == !=
   PREC_COMPARISON,  // < > <= >=
   PREC_TERM,        // + -
-  PREC_FACTOR,      // * /
+  PREC_FACTOR,      // * / % ~/
   PREC_UNARY,       // ! - +
   PREC_CALL,        // . () []
   PREC_PRIMARY
@@ -65,8 +108,16 @@ typedef struct {
   Precedence precedence;
 } ParseRule;
 
-Parser parser;
-Compiler *current = NULL;
+CompilerOptions compiler_options = {
+    .optimize = false, .registers = false, .jit = false};
+
+CLOX_THREAD_LOCAL Parser parser;
+CLOX_THREAD_LOCAL Compiler *current = NULL;
+CLOX_THREAD_LOCAL ClassCompiler *current_class = NULL;
+CLOX_THREAD_LOCAL SymbolCache symbols;
+// globals holding a native that the script declares or assigns, whose calls
+// are never fused since the native may be gone by the time they run.
+CLOX_THREAD_LOCAL Table replaced_natives;
 
 static void initCompiler(Compiler *c, FunctionType type) {
   c->enclosing = current;
@@ -74,15 +125,33 @@ static void initCompiler(Compiler *c, FunctionType type) {
   c->type = type;
   c->local_count = 0;
   c->scope_depth = 0;
+  c->last_get_global = -1;
+  c->last_get_local = -1;
+  c->last_add_local = -1;
+  c->last_call = -1;
+  c->last_jump_target = -1;
+  initTable(&c->string_constants);
+  c->captures = NULL;
+  c->capture_count = 0;
+  c->capture_capacity = 0;
+  c->long_jumps = NULL;
+  c->long_jump_count = 0;
+  c->long_jump_capacity = 0;
   current = c;
 
-  // reserved for the current function object value being interpreted
+  // reserved for the function being called, or the receiver of a method.
   Local *local = &current->locals[current->local_count++];
   local->depth = 0;
   local->is_captured = false;
+  local->is_assigned = false;
   local->name.type = TOKEN_IDENTIFIER;
-  local->name.start = "";
-  local->name.length = 0;
+  if (type == TYPE_METHOD || type == TYPE_INITIALIZER) {
+    local->name.start = "this";
+    local->name.length = 4;
+  } else {
+    local->name.start = "";
+    local->name.length = 0;
+  }
   local->name.line = 0;
 }
 
@@ -188,36 +257,180 @@ static int emitJump(uint8_t jump) {
   return currentChunk()->size - 2;
 }
 
-static void patchJump(int offset) {
-  int jump = currentChunk()->size - offset - 2;
-  if (jump > UINT8_MAX) error("too much code to jump over");
+static int markJumpTarget() {
+  current->last_jump_target = currentChunk()->size;
+  return current->last_jump_target;
+}
 
-  currentChunk()->code[offset] = (jump >> 8) & 0xff;
-  currentChunk()->code[offset + 1] = jump & 0xff;
+// patches the forward jump starting at op to land on the current offset.
+static void patchJumpAt(int op) {
+  Chunk *chunk = currentChunk();
+  // the 16 bit operand always ends the instruction.
+  int offset = op + instructionLength(chunk, op) - 2;
+  int jump = chunk->size - offset - 2;
+  markJumpTarget();
+
+  if (jump > UINT16_MAX) {
+    // widening the jump now would move code that other offsets still
+    // point into, so it waits for the end of the function.
+    if (current->long_jump_count == current->long_jump_capacity) {
+      int capacity = GROW_CAPACITY(current->long_jump_capacity);
+      current->long_jumps = GROW_ARRAY(current->long_jumps, int,
+                                       current->long_jump_capacity, capacity);
+      current->long_jump_capacity = capacity;
+    }
+    current->long_jumps[current->long_jump_count++] = op;
+    current->long_jumps[current->long_jump_count++] = chunk->size;
+    jump = 0;
+  }
+
+  storeJumpDistance(&chunk->code[offset + 2], false, jump);
 }
 
-static void emitLoop(int start) {
-  emitByte(OP_LOOP);
+static void patchJump(int offset) { patchJumpAt(offset - 1); }
 
-  int jump = currentChunk()->size - start + 2;
-  if (jump > UINT8_MAX) error("loop body too large");
+static void emitLoop(int start) {
+  int jump = currentChunk()->size - start + 3;
+  if (jump > UINT16_MAX) {
+    jump += 2;
+    emitByte(OP_LOOP_LONG);
+    emitBytes((jump >> 24) & 0xff, (jump >> 16) & 0xff);
+  } else {
+    emitByte(OP_LOOP);
+  }
 
   emitByte((jump >> 8) & 0xff);
   emitByte(jump & 0xff);
 }
 
+static void emitGetLocal(uint8_t slot) {
+  // two locals pushed in a row, as in 'a + b', share one dispatch.
+  Chunk *chunk = currentChunk();
+  int previous = current->last_get_local;
+  if (previous != -1 && previous == chunk->size - 2 &&
+      current->last_jump_target != chunk->size) {
+    chunk->code[previous] = OP_GET_LOCAL_GET_LOCAL;
+    emitByte(slot);
+    current->last_get_local = -1;
+    return;
+  }
+
+  current->last_get_local = chunk->size;
+  emitBytes(OP_GET_LOCAL, slot);
+}
+
+static bool isAddLocalConst(int start, uint8_t slot) {
+  Chunk *chunk = currentChunk();
+  uint8_t *code = &chunk->code[start];
+  return chunk->size - start == 5 && code[0] == OP_GET_LOCAL &&
+         code[1] == slot && code[2] == OP_CONSTANT && code[4] == OP_ADD;
+}
+
+static void emitPop() {
+  // 'local = local + constant;' updates the local in place without pushing.
+  Chunk *chunk = currentChunk();
+  int start = current->last_add_local;
+  if (start != -1 && start == chunk->size - 7) {
+    uint8_t slot = chunk->code[start + 1];
+    uint8_t constant = chunk->code[start + 3];
+    int line = chunk->lines[start];
+    chunk->size = start;
+    current->last_add_local = -1;
+    current->last_get_local = -1;
+    emitBytesWithLine(OP_ADD_LOCAL_CONST, slot, line);
+    emitByteWithLine(constant, line);
+    return;
+  }
+
+  emitByte(OP_POP);
+}
+
+// emits the exit jump of a loop condition, fusing 'local < constant' into a
+// single test that leaves nothing to pop. returns the offset of the opcode.
+static int emitLoopExit(int condition, bool *fused) {
+  Chunk *chunk = currentChunk();
+  uint8_t *code = &chunk->code[condition];
+  *fused = chunk->size - condition == 5 && code[0] == OP_GET_LOCAL &&
+           code[2] == OP_CONSTANT && code[4] == OP_LESS;
+  if (!*fused) return emitJump(OP_JUMP_IF_FALSE) - 1;
+
+  uint8_t slot = code[1];
+  uint8_t constant = code[3];
+  int line = chunk->lines[condition];
+  chunk->size = condition;
+  current->last_get_local = -1;
+  emitBytesWithLine(OP_LOCAL_LESS_CONST_JUMP, slot, line);
+  emitByteWithLine(constant, line);
+  emitBytesWithLine(0xff, 0xff, line);
+  return condition;
+}
+
 static void emitReturn() {
-  emitByte(OP_NIL);
+  if (current->type == TYPE_INITIALIZER) {
+    emitBytes(OP_GET_LOCAL, 0);
+  } else {
+    emitByte(OP_NIL);
+  }
   emitByte(OP_RETURN);
 }
 
+static void emitValueReturn() {
+  // a call returned right away runs in the frame of the returning function.
+  Chunk *chunk = currentChunk();
+  int call = current->last_call;
+  if (call == -1) {
+    // nothing to rewrite, and the checks below would read before the code.
+  } else if (call == chunk->size - 3 && chunk->code[call] == OP_CALL_NATIVE) {
+    chunk->code[call] = OP_TAIL_CALL_NATIVE;
+  } else if (call == chunk->size - 2 && chunk->code[call] == OP_CALL) {
+    chunk->code[call] = OP_TAIL_CALL;
+  } else if (call == chunk->size - 1) {
+    chunk->code[call] = OP_TAIL_CALL_0 + (chunk->code[call] - OP_CALL_0);
+  }
+  emitByte(OP_RETURN);
+}
+
+static int findConstant(Value value) {
+  if (IS_STRING(value)) {
+    Value index;
+    if (tableGet(&current->string_constants, AS_STRING(value), &index)) {
+      return (int)AS_NUMBER(index);
+    }
+  } else if (IS_NUMBER(value)) {
+    // literals are never negative or nan, so comparing with == is exact.
+    ValueArray *constants = &currentChunk()->constants;
+    for (int i = 0; i < constants->size; ++i) {
+      Value constant = constants->values[i];
+      if (IS_NUMBER(constant) && AS_NUMBER(constant) == AS_NUMBER(value)) {
+        return i;
+      }
+    }
+  } else if (IS_INT(value)) {
+    ValueArray *constants = &currentChunk()->constants;
+    for (int i = 0; i < constants->size; ++i) {
+      Value constant = constants->values[i];
+      if (IS_INT(constant) && AS_INT(constant) == AS_INT(value)) return i;
+    }
+  }
+
+  return -1;
+}
+
 static uint8_t makeConstant(Value value) {
-  int constant = addConstant(currentChunk(), value);
+  int constant = findConstant(value);
+  if (constant != -1) return (uint8_t)constant;
+
+  constant = addConstant(currentChunk(), value);
   if (constant > UINT8_MAX) {
     error("too many constants in one chunk");
     return 0;
   }
 
+  if (IS_STRING(value)) {
+    tableSet(&current->string_constants, AS_STRING(value),
+             NUMBER_VAL(constant));
+  }
+
   return (uint8_t)constant;
 }
 
@@ -225,20 +438,154 @@ static void emitConstant(Value value) {
   emitBytes(OP_CONSTANT, makeConstant(value));
 }
 
+// every property access site gets its own cache in the function.
+static uint16_t makeCache() {
+  ObjFunction *function = current->function;
+  if (function->cache_count == UINT16_MAX + 1) {
+    error("too many property accesses in one function");
+    return 0;
+  }
+  return (uint16_t)function->cache_count++;
+}
+
+static void addCapture(int offset) {
+  if (current->capture_count == current->capture_capacity) {
+    int capacity = GROW_CAPACITY(current->capture_capacity);
+    current->captures = GROW_ARRAY(current->captures, int,
+                                   current->capture_capacity, capacity);
+    current->capture_capacity = capacity;
+  }
+  current->captures[current->capture_count++] = offset;
+}
+
+// patches the closures that captured the local at slot to copy it when it is
+// never assigned, and returns whether they do.
+static bool resolveCaptures(int slot) {
+  Local *local = &current->locals[slot];
+  bool copied = local->is_captured && !local->is_assigned;
+  uint8_t *code = currentChunk()->code;
+
+  int kept = 0;
+  for (int i = 0; i < current->capture_count; ++i) {
+    int at = current->captures[i];
+    if (code[at + 1] != slot) {
+      current->captures[kept++] = at;
+    } else if (copied) {
+      code[at] = CAPTURE_COPY;
+    }
+  }
+  current->capture_count = kept;
+  return copied;
+}
+
+// lays the code out again with the long jumps widened. the bytes they gain
+// can push other jumps out of reach of 16 bits, which are widened in turn.
+static void widenJumps() {
+  Chunk *chunk = currentChunk();
+  // a jump may target the end of the code.
+  int count = chunk->size + 1;
+  int *targets = ALLOCATE(int, count);
+  int *moved = ALLOCATE(int, count);
+  bool *widened = ALLOCATE(bool, count);
+  for (int offset = 0; offset < count; ++offset) {
+    targets[offset] = -1;
+    widened[offset] = false;
+  }
+  for (int offset = 0; offset < chunk->size;
+       offset += instructionLength(chunk, offset)) {
+    if (isJumpOp(chunk->code[offset])) {
+      targets[offset] = jumpTarget(chunk, offset);
+    }
+  }
+  for (int i = 0; i < current->long_jump_count; i += 2) {
+    targets[current->long_jumps[i]] = current->long_jumps[i + 1];
+    widened[current->long_jumps[i]] = true;
+  }
+
+  int size;
+  bool grew;
+  do {
+    size = 0;
+    for (int offset = 0; offset < chunk->size;
+         offset += instructionLength(chunk, offset)) {
+      moved[offset] = size;
+      size += instructionLength(chunk, offset) + (widened[offset] ? 2 : 0);
+    }
+    moved[chunk->size] = size;
+
+    grew = false;
+    for (int offset = 0; offset < chunk->size;
+         offset += instructionLength(chunk, offset)) {
+      // long forms are their own long form.
+      uint8_t op = chunk->code[offset];
+      if (targets[offset] == -1 || widened[offset] || longJumpOp(op) == op) {
+        continue;
+      }
+
+      int end = moved[offset] + instructionLength(chunk, offset);
+      if (abs(moved[targets[offset]] - end) > UINT16_MAX) {
+        widened[offset] = true;
+        grew = true;
+      }
+    }
+  } while (grew);
+
+  uint8_t *code = ALLOCATE(uint8_t, size);
+  int *lines = ALLOCATE(int, size);
+  for (int offset = 0; offset < chunk->size;
+       offset += instructionLength(chunk, offset)) {
+    int length = instructionLength(chunk, offset);
+    int at = moved[offset];
+    memcpy(&code[at], &chunk->code[offset], length);
+    if (widened[offset]) length += 2;
+    for (int i = 0; i < length; ++i) lines[at + i] = chunk->lines[offset];
+    if (targets[offset] == -1) continue;
+
+    if (widened[offset]) code[at] = longJumpOp(code[at]);
+    storeJumpDistance(&code[at + length], longJumpOp(code[at]) == code[at],
+                      abs(moved[targets[offset]] - (at + length)));
+  }
+
+  FREE_ARRAY(chunk->code, uint8_t, chunk->capacity);
+  FREE_ARRAY(chunk->lines, int, chunk->capacity);
+  chunk->code = code;
+  chunk->lines = lines;
+  chunk->size = size;
+  chunk->capacity = size;
+
+  FREE_ARRAY(targets, int, count);
+  FREE_ARRAY(moved, int, count);
+  FREE_ARRAY(widened, bool, count);
+}
+
 static ObjFunction *endCompiler() {
+  // parameters and the receiver are the only locals left in scope.
+  for (int slot = current->local_count - 1; slot >= 0; --slot) {
+    resolveCaptures(slot);
+  }
+  // jumps may target the end even when the last statement returned. the
+  // optimizer drops this return when nothing reaches it.
+  emitReturn();
+  if (current->long_jump_count > 0) widenJumps();
   Chunk *chunk = currentChunk();
-  if (chunk->code[chunk->size - 1] != OP_RETURN) emitReturn();
+  if (compiler_options.optimize && !parser.had_error) optimizeChunk(chunk);
 
   ObjFunction *function = current->function;
+  allocateCaches(function);
+  if (!parser.had_error) chooseTier(function);
 
 #ifdef CLOX_DEBUG_PRINT_CODE
   if (!parser.had_error) {
     disassembleChunk(currentChunk(), function->name != NULL
                                          ? function->name->chars
                                          : "<script>");
+    if (function->registers) disassembleRegisters(function);
   }
 #endif
 
+  freeTable(&current->string_constants);
+  FREE_ARRAY(current->captures, int, current->capture_capacity);
+  FREE_ARRAY(current->long_jumps, int, current->long_jump_capacity);
   current = current->enclosing;
   return function;
 }
@@ -255,7 +602,8 @@ static void endScope() {
   --current->scope_depth;
 
   while (isTopLocalOutOfScope()) {
-    if (current->locals[current->local_count - 1].is_captured) {
+    int slot = current->local_count - 1;
+    if (current->locals[slot].is_captured && !resolveCaptures(slot)) {
       emitByte(OP_CLOSE_UPVALUE);
     } else {
       emitByte(OP_POP);
@@ -297,7 +645,7 @@ static void expression() { parsePrecedence(PREC_ASSIGNMENT); }
 
 static void expressionStatement() {
   expression();
-  emitByte(OP_POP);
+  emitPop();
   consume(TOKEN_SEMICOLON, "expected ';' after expression");
 }
 
@@ -319,48 +667,51 @@ static void ifStatement() {
   consume(TOKEN_LEFT_BRACE, "expected a block after condition");
   block();
 
-  int else_jump = match(TOKEN_ELSE) ? emitJump(OP_JUMP) : -1;
+  // the then branch already popped the condition, so it must skip the pop
+  // of the false path even without an else branch.
+  int else_jump = emitJump(OP_JUMP);
   patchJump(then_jump);
   emitByte(OP_POP);
 
-  if (else_jump != -1) {
+  if (match(TOKEN_ELSE)) {
     if (match(TOKEN_IF)) {
       ifStatement();
     } else {
       consume(TOKEN_LEFT_BRACE, "expected a block after 'else'");
       block();
     }
-    patchJump(else_jump);
   }
+  patchJump(else_jump);
 }
 
 static void loopStatement() {
   // loop_statement := loop (
   //    <var declaration>? <condition expression>(';' <increment expression>)?
   //  )? { <body> }
-  int start = currentChunk()->size;
+  int start = markJumpTarget();
   bool forever = check(TOKEN_LEFT_BRACE);
 
   bool has_declaration = !forever && match(TOKEN_LET);
   if (has_declaration) {
     beginScope();
     varDeclaration();
-    start = currentChunk()->size;
+    start = markJumpTarget();
   }
 
   int exit_jump = -1;
+  bool fused_exit = false;
   if (!forever) {
     expression();
-    exit_jump = emitJump(OP_JUMP_IF_FALSE);
-    emitByte(OP_POP);
+    exit_jump = emitLoopExit(start, &fused_exit);
+    if (!fused_exit) emitByte(OP_POP);
   }
 
   if (!forever && match(TOKEN_SEMICOLON)) {
     int jump = emitJump(OP_JUMP);
-    int increment_start = currentChunk()->size;
+    int increment_start = markJumpTarget();
 
     expression();
-    emitByte(OP_POP);
+    emitPop();
 
     emitLoop(start);
     start = increment_start;
@@ -372,8 +723,8 @@ static void loopStatement() {
   emitLoop(start);
 
   if (exit_jump != -1) {
-    patchJump(exit_jump);
-    emitByte(OP_POP);
+    patchJumpAt(exit_jump);
+    if (!fused_exit) emitByte(OP_POP);
   }
 
   if (has_declaration) endScope();
@@ -387,9 +738,12 @@ static void returnStatement() {
   if (match(TOKEN_SEMICOLON)) {
     emitReturn();
   } else {
+    if (current->type == TYPE_INITIALIZER) {
+      error("cannot return a value from an initializer");
+    }
     expression();
     consume(TOKEN_SEMICOLON, "expected ';' after expression");
-    emitByte(OP_RETURN);
+    emitValueReturn();
   }
 }
 
@@ -407,8 +761,59 @@ static void statement() {
   }
 }
 
+static uint32_t symbolHash(const char *chars, int length) {
+  uint32_t hash = (uint32_t)length;
+  hash = hash * 31 + (uint8_t)chars[0];
+  hash = hash * 31 + (uint8_t)chars[length / 2];
+  hash = hash * 31 + (uint8_t)chars[length - 1];
+  hash *= 2654435761u;
+  return hash ^ (hash >> 16);
+}
+
+static void growSymbols() {
+  int old_capacity = symbols.capacity;
+  ObjString **old_strings = symbols.strings;
+
+  symbols.capacity = GROW_CAPACITY(old_capacity);
+  symbols.strings = ALLOCATE(ObjString *, symbols.capacity);
+  memset(symbols.strings, 0, sizeof(ObjString *) * symbols.capacity);
+
+  uint32_t mask = symbols.capacity - 1;
+  for (int i = 0; i < old_capacity; ++i) {
+    ObjString *string = old_strings[i];
+    if (!string) continue;
+
+    uint32_t index = symbolHash(string->chars, string->length) & mask;
+    while (symbols.strings[index]) index = (index + 1) & mask;
+    symbols.strings[index] = string;
+  }
+
+  FREE_ARRAY(old_strings, ObjString *, old_capacity);
+}
+
+static ObjString *internIdentifier(Token *name) {
+  if (symbols.count + 1 > symbols.capacity / 2) growSymbols();
+
+  uint32_t mask = symbols.capacity - 1;
+  uint32_t index = symbolHash(name->start, name->length) & mask;
+  for (;;) {
+    ObjString *string = symbols.strings[index];
+    if (!string) break;
+    if (string->length == name->length &&
+        !memcmp(string->chars, name->start, name->length)) {
+      return string;
+    }
+    index = (index + 1) & mask;
+  }
+
+  ObjString *string = copyString(name->start, name->length);
+  symbols.strings[index] = string;
+  ++symbols.count;
+  return string;
+}
+
 static uint8_t identifierConstant(Token *name) {
-  return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+  return makeConstant(OBJ_VAL(internIdentifier(name)));
 }
 
 static bool identifiersEqual(Token *a, Token *b) {
@@ -425,6 +830,7 @@ static void addLocal(Token name) {
   Local *local = &current->locals[current->local_count++];
   local->name = name;
   local->is_captured = false;
+  local->is_assigned = false;
   local->depth = -1;
 }
 
@@ -479,8 +885,7 @@ static void varDeclaration() {
 static void function(FunctionType type) {
   Compiler compiler;
   initCompiler(&compiler, type);
-  current->function->name =
-      copyString(parser.previous.start, parser.previous.length);
+  current->function->name = internIdentifier(&parser.previous);
 
   consume(TOKEN_LEFT_PAREN, "expected '(' after function name");
   beginScope();
@@ -499,9 +904,12 @@ static void function(FunctionType type) {
   if (match(TOKEN_LEFT_BRACE)) {
     block();
   } else if (match(TOKEN_EQUAL)) {
+    if (type == TYPE_INITIALIZER) {
+      error("cannot return a value from an initializer");
+    }
     expression();
     consume(TOKEN_SEMICOLON, "expected ';' after expression");
-    emitByte(OP_RETURN);
+    emitValueReturn();
   } else {
     errorAtCurrent("expected '=' or '{' after parameters list");
   }
@@ -510,20 +918,99 @@ static void function(FunctionType type) {
   emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(f)));
 
   for (int i = 0; i < f->upvalue_count; ++i) {
-    emitByte(compiler.upvalues[i].is_local ? 1 : 0);
+    if (compiler.upvalues[i].is_local) {
+      addCapture(currentChunk()->size);
+      emitByte(CAPTURE_LOCAL);
+    } else {
+      emitByte(CAPTURE_UPVALUE);
+    }
     emitByte(compiler.upvalues[i].index);
   }
 }
 
+static void method() {
+  consume(TOKEN_IDENTIFIER, "expected a method name");
+  uint8_t constant = identifierConstant(&parser.previous);
+
+  FunctionType type = TYPE_METHOD;
+  if (parser.previous.length == 4 &&
+      !memcmp(parser.previous.start, "init", 4)) {
+    type = TYPE_INITIALIZER;
+  }
+  function(type);
+  emitBytes(OP_METHOD, constant);
+}
+
+static Token syntheticToken(const char *text) {
+  Token token;
+  token.type = TOKEN_IDENTIFIER;
+  token.start = text;
+  token.length = (int)strlen(text);
+  token.line = parser.previous.line;
+  return token;
+}
+
+static void namedVariable(Token name, bool can_assign);
+
+static void classDeclaration() {
+  consume(TOKEN_IDENTIFIER, "expected a class name");
+  Token class_name = parser.previous;
+  uint8_t name_constant = identifierConstant(&parser.previous);
+  declareVariable();
+
+  emitBytes(OP_CLASS, name_constant);
+  defineVariable(name_constant);
+
+  ClassCompiler class_compiler;
+  class_compiler.enclosing = current_class;
+  class_compiler.has_superclass = false;
+  current_class = &class_compiler;
+
+  if (match(TOKEN_LESS)) {
+    consume(TOKEN_IDENTIFIER, "expected a superclass name");
+    namedVariable(parser.previous, false);
+    if (identifiersEqual(&class_name, &parser.previous)) {
+      error("a class cannot inherit from itself");
+    }
+
+    // methods reach the superclass through a local named super.
+    beginScope();
+    addLocal(syntheticToken("super"));
+    defineVariable(0);
+
+    namedVariable(class_name, false);
+    emitByte(OP_INHERIT);
+    class_compiler.has_superclass = true;
+  }
+
+  namedVariable(class_name, false);
+  consume(TOKEN_LEFT_BRACE, "expected '{' before class body");
+  while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+    method();
+  }
+  consume(TOKEN_RIGHT_BRACE, "expected '}' after class body");
+  emitByte(OP_POP);
+
+  if (class_compiler.has_superclass) endScope();
+  current_class = current_class->enclosing;
+}
+
 static void funDeclaration() {
   uint8_t global = parseVariable("expected function name");
   markInitialized();
+  // a local function that calls itself captures its slot before the
+  // closure is stored there.
+  if (current->scope_depth > 0) {
+    current->locals[current->local_count - 1].is_assigned = true;
+  }
   function(TYPE_FUNCTION);
   defineVariable(global);
 }
 
 static void declaration() {
-  if (match(TOKEN_LET)) {
+  if (match(TOKEN_CLASS)) {
+    classDeclaration();
+  } else if (match(TOKEN_LET)) {
     varDeclaration();
   } else if (match(TOKEN_FUN)) {
     funDeclaration();
@@ -567,8 +1054,18 @@ static void literal(bool can_assign) {
 }
 
 static void number(bool can_assign) {
-  double value = strtod(parser.previous.start, NULL);
-  emitConstant(NUMBER_VAL(value));
+  // literals without a fraction are ints unless they are too big for one.
+  const char *start = parser.previous.start;
+  if (!memchr(start, '.', parser.previous.length)) {
+    errno = 0;
+    long long value = strtoll(start, NULL, 10);
+    if (errno == 0) {
+      emitConstant(INT_VAL(value));
+      return;
+    }
+  }
+
+  emitConstant(NUMBER_VAL(strtod(start, NULL)));
 }
 
 static void string(bool can_assign) {
@@ -624,8 +1121,18 @@ static int resolveUpValue(Compiler *compiler, Token *name) {
   return -1;
 }
 
-static void variable(bool can_assign) {
-  Token *name = &parser.previous;
+// marks the local an upvalue of compiler refers to as assigned.
+static void markAssigned(Compiler *compiler, int upvalue) {
+  Upvalue *captured = &compiler->upvalues[upvalue];
+  if (captured->is_local) {
+    compiler->enclosing->locals[captured->index].is_assigned = true;
+  } else {
+    markAssigned(compiler->enclosing, captured->index);
+  }
+}
+
+static void namedVariable(Token token, bool can_assign) {
+  Token *name = &token;
   int arg = resolveLocal(current, name);
   uint8_t get_op, set_op;
   if (arg != -1) {
@@ -641,13 +1148,74 @@ static void variable(bool can_assign) {
   }
 
   if (can_assign && match(TOKEN_EQUAL)) {
+    int value = currentChunk()->size;
+    current->last_get_local = -1;
     expression();
+    if (set_op == OP_SET_LOCAL && isAddLocalConst(value, (uint8_t)arg)) {
+      current->last_add_local = value;
+    }
+    if (set_op == OP_SET_LOCAL) current->locals[arg].is_assigned = true;
+    if (set_op == OP_SET_UPVALUE) markAssigned(current, arg);
     emitBytes(set_op, (uint8_t)arg);
+  } else if (get_op == OP_GET_LOCAL) {
+    emitGetLocal((uint8_t)arg);
   } else {
+    if (get_op == OP_GET_GLOBAL) {
+      current->last_get_global = currentChunk()->size;
+    }
     emitBytes(get_op, (uint8_t)arg);
   }
 }
 
+static void variable(bool can_assign) {
+  namedVariable(parser.previous, can_assign);
+}
+
+static void this_(bool can_assign) {
+  if (!current_class) {
+    error("cannot use 'this' outside of a class");
+    return;
+  }
+
+  namedVariable(syntheticToken("this"), false);
+}
+
+static uint8_t argumentList() {
+  uint8_t arg_count = 0;
+  while (!check(TOKEN_RIGHT_PAREN)) {
+    expression();
+    if (++arg_count >= 255) error("cannot have more than 255 arguments");
+    if (!match(TOKEN_COMMA)) break;
+  }
+
+  consume(TOKEN_RIGHT_PAREN, "expected ')' after argument list");
+  return arg_count;
+}
+
+static void super_(bool can_assign) {
+  if (!current_class) {
+    error("cannot use 'super' outside of a class");
+  } else if (!current_class->has_superclass) {
+    error("cannot use 'super' in a class with no superclass");
+  }
+
+  consume(TOKEN_DOT, "expected '.' after 'super'");
+  consume(TOKEN_IDENTIFIER, "expected a superclass method name");
+  uint8_t name = identifierConstant(&parser.previous);
+
+  namedVariable(syntheticToken("this"), false);
+  if (match(TOKEN_LEFT_PAREN)) {
+    // calls skip binding the method, like invoke.
+    uint8_t arg_count = argumentList();
+    namedVariable(syntheticToken("super"), false);
+    emitBytes(OP_SUPER_INVOKE, name);
+    emitByte(arg_count);
+  } else {
+    namedVariable(syntheticToken("super"), false);
+    emitBytes(OP_GET_SUPER, name);
+  }
+}
+
 static void binary(bool can_assign) {
   Token operator= parser.previous;
 
@@ -667,6 +1235,12 @@ static void binary(bool can_assign) {
     case TOKEN_SLASH:
       emitByteWithLine(OP_DIV, operator.line);
       break;
+    case TOKEN_PERCENT:
+      emitByteWithLine(OP_MOD, operator.line);
+      break;
+    case TOKEN_TILDE_SLASH:
+      emitByteWithLine(OP_QUOTIENT, operator.line);
+      break;
     case TOKEN_BANG_EQUAL:
       emitBytesWithLine(OP_EQUAL, OP_NOT, operator.line);
       break;
@@ -712,36 +1286,116 @@ static void grouping(bool can_assign) {
   consume(TOKEN_RIGHT_PAREN, "expected ')' after expression");
 }
 
-static uint8_t argumentList() {
-  uint8_t arg_count = 0;
-  while (!check(TOKEN_RIGHT_PAREN)) {
+static bool isNativeGlobal(uint8_t constant) {
+  Value value;
+  ObjString *name = AS_STRING(currentChunk()->constants.values[constant]);
+  return tableGet(&vm->globals, name, &value) && IS_NATIVE_FN(value) &&
+         !tableGet(&replaced_natives, name, &value);
+}
+
+static void call(bool can_assign) {
+  // calls of globals that hold a native when compiling skip pushing the
+  // callee, the vm falls back to a normal call if the global changed.
+  Chunk *chunk = currentChunk();
+  int callee = chunk->size - 2;
+  if (current->last_get_global == callee &&
+      current->last_jump_target != chunk->size &&
+      isNativeGlobal(chunk->code[callee + 1])) {
+    uint8_t name = chunk->code[callee + 1];
+    chunk->size = callee;
+    current->last_get_global = -1;
+
+    uint8_t arg_count = argumentList();
+    current->last_call = currentChunk()->size;
+    emitBytes(OP_CALL_NATIVE, name);
+    emitByte(arg_count);
+    return;
+  }
+
+  uint8_t arg_count = argumentList();
+  current->last_call = currentChunk()->size;
+  if (arg_count <= 3) {
+    emitByte(OP_CALL_0 + arg_count);
+  } else {
+    emitBytes(OP_CALL, arg_count);
+  }
+}
+
+static void list(bool can_assign) {
+  uint8_t item_count = 0;
+  while (!check(TOKEN_RIGHT_BRACKET)) {
     expression();
-    if (++arg_count >= 255) error("cannot have more than 255 arguments");
+    if (++item_count >= 255) error("cannot have more than 255 list items");
     if (!match(TOKEN_COMMA)) break;
   }
 
-  consume(TOKEN_RIGHT_PAREN, "expected ')' after argument list");
-  return arg_count;
+  consume(TOKEN_RIGHT_BRACKET, "expected ']' after list items");
+  emitBytes(OP_BUILD_LIST, item_count);
 }
 
-static void call(bool can_assign) {
-  uint8_t arg_count = argumentList();
-  emitBytes(OP_CALL, arg_count);
+static void map(bool can_assign) {
+  uint8_t entry_count = 0;
+  while (!check(TOKEN_RIGHT_BRACE)) {
+    expression();
+    consume(TOKEN_COLON, "expected ':' after map key");
+    expression();
+    if (++entry_count >= 255) error("cannot have more than 255 map entries");
+    if (!match(TOKEN_COMMA)) break;
+  }
+
+  consume(TOKEN_RIGHT_BRACE, "expected '}' after map entries");
+  emitBytes(OP_BUILD_MAP, entry_count);
+}
+
+static void subscript(bool can_assign) {
+  expression();
+  consume(TOKEN_RIGHT_BRACKET, "expected ']' after index");
+
+  if (can_assign && match(TOKEN_EQUAL)) {
+    expression();
+    emitByte(OP_INDEX_SET);
+  } else {
+    emitByte(OP_INDEX_GET);
+  }
+}
+
+static void dot(bool can_assign) {
+  consume(TOKEN_IDENTIFIER, "expected a property name after '.'");
+  uint8_t name = identifierConstant(&parser.previous);
+
+  if (can_assign && match(TOKEN_EQUAL)) {
+    expression();
+    emitBytes(OP_SET_PROPERTY, name);
+  } else if (match(TOKEN_LEFT_PAREN)) {
+    // a method call looks the method up and calls it without allocating a
+    // bound method.
+    uint8_t arg_count = argumentList();
+    emitBytes(OP_INVOKE, name);
+    emitByte(arg_count);
+  } else {
+    emitBytes(OP_GET_PROPERTY, name);
+  }
+  uint16_t cache = makeCache();
+  emitBytes((cache >> 8) & 0xff, cache & 0xff);
 }
 
 // has to be in the same order as TokenType enum
 ParseRule rules[] = {
     {grouping, call, PREC_CALL},      // TOKEN_LEFT_PAREN
     {NULL, NULL, PREC_NONE},          // TOKEN_RIGHT_PAREN
-    {NULL, NULL, PREC_NONE},          // TOKEN_LEFT_BRACE
+    {map, NULL, PREC_NONE},           // TOKEN_LEFT_BRACE
     {NULL, NULL, PREC_NONE},          // TOKEN_RIGHT_BRACE
+    {list, subscript, PREC_CALL},     // TOKEN_LEFT_BRACKET
+    {NULL, NULL, PREC_NONE},          // TOKEN_RIGHT_BRACKET
     {NULL, NULL, PREC_NONE},          // TOKEN_COMMA
-    {NULL, NULL, PREC_CALL},          // TOKEN_DOT
+    {NULL, NULL, PREC_NONE},          // TOKEN_COLON
+    {NULL, dot, PREC_CALL},           // TOKEN_DOT
     {unary, binary, PREC_TERM},       // TOKEN_MINUS
     {NULL, binary, PREC_TERM},        // TOKEN_PLUS
     {NULL, NULL, PREC_NONE},          // TOKEN_SEMICOLON
     {NULL, binary, PREC_FACTOR},      // TOKEN_SLASH
     {NULL, binary, PREC_FACTOR},      // TOKEN_STAR
+    {NULL, binary, PREC_FACTOR},      // TOKEN_PERCENT
     {unary, NULL, PREC_NONE},         // TOKEN_BANG
     {NULL, binary, PREC_EQUALITY},    // TOKEN_BANG_EQUAL
     {NULL, NULL, PREC_NONE},          // TOKEN_EQUAL
@@ -750,6 +1404,7 @@ ParseRule rules[] = {
     {NULL, binary, PREC_COMPARISON},  // TOKEN_GREATER_EQUAL
     {NULL, binary, PREC_COMPARISON},  // TOKEN_LESS
     {NULL, binary, PREC_COMPARISON},  // TOKEN_LESS_EQUAL
+    {NULL, binary, PREC_FACTOR},      // TOKEN_TILDE_SLASH
     {variable, NULL, PREC_NONE},      // TOKEN_IDENTIFIER
     {string, NULL, PREC_NONE},        // TOKEN_STRING
     {number, NULL, PREC_NONE},        // TOKEN_NUMBER
@@ -764,8 +1419,8 @@ ParseRule rules[] = {
     {literal, NULL, PREC_NONE},       // TOKEN_NIL
     {NULL, or_, PREC_OR},             // TOKEN_OR
     {NULL, NULL, PREC_NONE},          // TOKEN_RETURN
-    {NULL, NULL, PREC_NONE},          // TOKEN_SUPER
-    {NULL, NULL, PREC_NONE},          // TOKEN_THIS
+    {super_, NULL, PREC_NONE},        // TOKEN_SUPER
+    {this_, NULL, PREC_NONE},         // TOKEN_THIS
     {literal, NULL, PREC_NONE},       // TOKEN_TRUE
     {NULL, NULL, PREC_NONE},          // TOKEN_ERROR
     {NULL, NULL, PREC_NONE},          // TOKEN_EOF
@@ -773,10 +1428,49 @@ ParseRule rules[] = {
 
 static ParseRule *getRule(TokenType type) { return &rules[type]; }
 
+static void replaceNative(Token *name) {
+  ObjString *string = tableFindString(&vm->strings, name->start, name->length,
+                                      hashString(name->start, name->length));
+  Value value;
+  if (string && tableGet(&vm->globals, string, &value) &&
+      IS_NATIVE_FN(value)) {
+    tableSet(&replaced_natives, string, BOOL_VAL(true));
+  }
+}
+
+// a pass over the tokens before compiling, for the natives the script
+// declares at the top level, or assigns anywhere, under their own name.
+static void findReplacedNatives(const char *source) {
+  initScanner(source);
+  TokenType before = TOKEN_EOF;
+  Token previous = {.type = TOKEN_EOF};
+  int depth = 0;
+  for (Token token = scanToken(); token.type != TOKEN_EOF;
+       token = scanToken()) {
+    if (token.type == TOKEN_LEFT_BRACE) {
+      ++depth;
+    } else if (token.type == TOKEN_RIGHT_BRACE) {
+      --depth;
+    } else if (token.type == TOKEN_EQUAL &&
+               previous.type == TOKEN_IDENTIFIER && before != TOKEN_DOT) {
+      replaceNative(&previous);
+    } else if (token.type == TOKEN_IDENTIFIER && depth == 0 &&
+               (previous.type == TOKEN_LET || previous.type == TOKEN_FUN ||
+                previous.type == TOKEN_CLASS)) {
+      replaceNative(&token);
+    }
+    before = previous.type;
+    previous = token;
+  }
+}
+
 ObjFunction *compile(const char *source) {
+  initTable(&replaced_natives);
+  findReplacedNatives(source);
   initScanner(source);
   Compiler compiler;
   initCompiler(&compiler, TYPE_SCRIPT);
+  current_class = NULL;
   parser.had_error = false;
   parser.panic_mode = false;
 
@@ -787,5 +1481,22 @@ ObjFunction *compile(const char *source) {
   }
 
   ObjFunction *function = endCompiler();
+  FREE_ARRAY(symbols.strings, ObjString *, symbols.capacity);
+  symbols.count = 0;
+  symbols.capacity = 0;
+  symbols.strings = NULL;
+  freeTable(&replaced_natives);
   return parser.had_error ? NULL : function;
+}
+
+void chooseTier(ObjFunction *function) {
+  if (compiler_options.registers) {
+    function->registers = translateRegisters(function);
+  }
+
+  if (function->registers) {
+    function->tier = TIER_REGISTERS;
+  } else if (compiler_options.jit) {
+    function->tier = TIER_WARMING;
+  }
 }
\ No newline at end of file
@@ -2,15 +2,31 @@
 
 #include "debug.h"
 #include "object.h"
+#include "register.h"
 #include "value.h"
 
 static int simpleOp(const char *name, int offset);
 static int constantOp(const char *name, Chunk *chunk, int offset);
 static int byteOp(const char *name, Chunk *chunk, int offset);
+static int propertyOp(const char *name, Chunk *chunk, int offset);
+static int invokeOp(const char *name, Chunk *chunk, int offset);
+static int cachedInvokeOp(const char *name, Chunk *chunk, int offset);
+static int byteByteOp(const char *name, Chunk *chunk, int offset);
+static int byteConstantOp(const char *name, Chunk *chunk, int offset);
+static int localConstJumpOp(const char *name, Chunk *chunk, int offset);
 
-typedef enum { FORWARD = 1, BACKWARD = -1 } JumpDirection;
-static int jumpOp(const char *name, JumpDirection direction, Chunk *chunk,
-                  int offset);
+static const char *captureName(int kind) {
+  switch (kind) {
+    case CAPTURE_LOCAL:
+      return "local";
+    case CAPTURE_COPY:
+      return "copy";
+    default:
+      return "upvalue";
+  }
+}
+
+static int jumpOp(const char *name, Chunk *chunk, int offset);
 
 void disassembleChunk(Chunk *chunk, const char *name) {
   printf("[==================] %s [===================]\n", name);
@@ -44,6 +60,8 @@ int disassembleOp(Chunk *chunk, int offset) {
       return simpleOp("OP_POP", offset);
     case OP_GET_LOCAL:
       return byteOp("OP_GET_LOCAL", chunk, offset);
+    case OP_GET_LOCAL_GET_LOCAL:
+      return byteByteOp("OP_GET_LOCAL_GET_LOCAL", chunk, offset);
     case OP_SET_LOCAL:
       return byteOp("OP_SET_LOCAL", chunk, offset);
     case OP_GET_UPVALUE:
@@ -60,6 +78,12 @@ int disassembleOp(Chunk *chunk, int offset) {
       return simpleOp("OP_NEGATE", offset);
     case OP_RETURN:
       return simpleOp("OP_RETURN", offset);
+    case OP_CLASS:
+      return constantOp("OP_CLASS", chunk, offset);
+    case OP_INHERIT:
+      return simpleOp("OP_INHERIT", offset);
+    case OP_METHOD:
+      return constantOp("OP_METHOD", chunk, offset);
     case OP_ADD:
       return simpleOp("OP_ADD", offset);
     case OP_SUB:
@@ -68,6 +92,36 @@ int disassembleOp(Chunk *chunk, int offset) {
       return simpleOp("OP_MUL", offset);
     case OP_DIV:
       return simpleOp("OP_DIV", offset);
+    case OP_MOD:
+      return simpleOp("OP_MOD", offset);
+    case OP_QUOTIENT:
+      return simpleOp("OP_QUOTIENT", offset);
+    case OP_ADD_NUMBER:
+      return simpleOp("OP_ADD_NUMBER", offset);
+    case OP_ADD_STRING:
+      return simpleOp("OP_ADD_STRING", offset);
+    case OP_SUB_NUMBER:
+      return simpleOp("OP_SUB_NUMBER", offset);
+    case OP_MUL_NUMBER:
+      return simpleOp("OP_MUL_NUMBER", offset);
+    case OP_DIV_NUMBER:
+      return simpleOp("OP_DIV_NUMBER", offset);
+    case OP_GREATER_NUMBER:
+      return simpleOp("OP_GREATER_NUMBER", offset);
+    case OP_LESS_NUMBER:
+      return simpleOp("OP_LESS_NUMBER", offset);
+    case OP_ADD_INT:
+      return simpleOp("OP_ADD_INT", offset);
+    case OP_SUB_INT:
+      return simpleOp("OP_SUB_INT", offset);
+    case OP_MUL_INT:
+      return simpleOp("OP_MUL_INT", offset);
+    case OP_GREATER_INT:
+      return simpleOp("OP_GREATER_INT", offset);
+    case OP_LESS_INT:
+      return simpleOp("OP_LESS_INT", offset);
+    case OP_ADD_LOCAL_CONST:
+      return byteConstantOp("OP_ADD_LOCAL_CONST", chunk, offset);
     case OP_NOT:
       return simpleOp("OP_NOT", offset);
     case OP_EQUAL:
@@ -77,13 +131,67 @@ int disassembleOp(Chunk *chunk, int offset) {
     case OP_LESS:
       return simpleOp("OP_LESS", offset);
     case OP_JUMP:
-      return jumpOp("OP_JUMP", FORWARD, chunk, offset);
+      return jumpOp("OP_JUMP", chunk, offset);
     case OP_JUMP_IF_FALSE:
-      return jumpOp("OP_JUMP_IF_FALSE", FORWARD, chunk, offset);
+      return jumpOp("OP_JUMP_IF_FALSE", chunk, offset);
+    case OP_JUMP_IF_TRUE:
+      return jumpOp("OP_JUMP_IF_TRUE", chunk, offset);
     case OP_LOOP:
-      return jumpOp("OP_LOOP", BACKWARD, chunk, offset);
+      return jumpOp("OP_LOOP", chunk, offset);
+    case OP_LOCAL_LESS_CONST_JUMP:
+      return localConstJumpOp("OP_LOCAL_LESS_CONST_JUMP", chunk, offset);
+    case OP_LOCAL_LESS_CONST_JUMP_LONG:
+      return localConstJumpOp("OP_LOCAL_LESS_CONST_JUMP_LONG", chunk, offset);
+    case OP_JUMP_LONG:
+      return jumpOp("OP_JUMP_LONG", chunk, offset);
+    case OP_JUMP_IF_FALSE_LONG:
+      return jumpOp("OP_JUMP_IF_FALSE_LONG", chunk, offset);
+    case OP_JUMP_IF_TRUE_LONG:
+      return jumpOp("OP_JUMP_IF_TRUE_LONG", chunk, offset);
+    case OP_LOOP_LONG:
+      return jumpOp("OP_LOOP_LONG", chunk, offset);
     case OP_CALL:
       return byteOp("OP_CALL", chunk, offset);
+    case OP_CALL_0:
+      return simpleOp("OP_CALL_0", offset);
+    case OP_CALL_1:
+      return simpleOp("OP_CALL_1", offset);
+    case OP_CALL_2:
+      return simpleOp("OP_CALL_2", offset);
+    case OP_CALL_3:
+      return simpleOp("OP_CALL_3", offset);
+    case OP_TAIL_CALL:
+      return byteOp("OP_TAIL_CALL", chunk, offset);
+    case OP_TAIL_CALL_0:
+      return simpleOp("OP_TAIL_CALL_0", offset);
+    case OP_TAIL_CALL_1:
+      return simpleOp("OP_TAIL_CALL_1", offset);
+    case OP_TAIL_CALL_2:
+      return simpleOp("OP_TAIL_CALL_2", offset);
+    case OP_TAIL_CALL_3:
+      return simpleOp("OP_TAIL_CALL_3", offset);
+    case OP_CALL_NATIVE:
+      return invokeOp("OP_CALL_NATIVE", chunk, offset);
+    case OP_TAIL_CALL_NATIVE:
+      return invokeOp("OP_TAIL_CALL_NATIVE", chunk, offset);
+    case OP_BUILD_LIST:
+      return byteOp("OP_BUILD_LIST", chunk, offset);
+    case OP_BUILD_MAP:
+      return byteOp("OP_BUILD_MAP", chunk, offset);
+    case OP_INDEX_GET:
+      return simpleOp("OP_INDEX_GET", offset);
+    case OP_INDEX_SET:
+      return simpleOp("OP_INDEX_SET", offset);
+    case OP_GET_PROPERTY:
+      return propertyOp("OP_GET_PROPERTY", chunk, offset);
+    case OP_SET_PROPERTY:
+      return propertyOp("OP_SET_PROPERTY", chunk, offset);
+    case OP_GET_SUPER:
+      return constantOp("OP_GET_SUPER", chunk, offset);
+    case OP_INVOKE:
+      return cachedInvokeOp("OP_INVOKE", chunk, offset);
+    case OP_SUPER_INVOKE:
+      return invokeOp("OP_SUPER_INVOKE", chunk, offset);
     case OP_CLOSE_UPVALUE:
       return simpleOp("OP_CLOSE_UPVALUE", offset);
     case OP_CLOSURE: {
@@ -93,10 +201,10 @@ int disassembleOp(Chunk *chunk, int offset) {
       ObjFunction *function = AS_FUNCTION(chunk->constants.values[constant]);
 
       for (int i = 0; i < function->upvalue_count; ++i) {
-        int is_local = chunk->code[offset++];
+        int kind = chunk->code[offset++];
         int index = chunk->code[offset++];
         printf("        %04d |%-20s %s %d\n", offset - 2, " ",
-               is_local ? "local" : "upvalue", index);
+               captureName(kind), index);
       }
 
       return offset;
@@ -113,6 +221,36 @@ static int byteOp(const char *name, Chunk *chunk, int offset) {
   return offset + 2;
 }
 
+static int invokeOp(const char *name, Chunk *chunk, int offset) {
+  uint8_t constant = chunk->code[offset + 1];
+  uint8_t arg_count = chunk->code[offset + 2];
+  printf("%-16s (%d args) %4d (", name, arg_count, constant);
+  printValue(chunk->constants.values[constant]);
+  printf(")\n");
+  return offset + 3;
+}
+
+static int cachedInvokeOp(const char *name, Chunk *chunk, int offset) {
+  uint8_t constant = chunk->code[offset + 1];
+  uint8_t arg_count = chunk->code[offset + 2];
+  uint16_t cache =
+      (uint16_t)(chunk->code[offset + 3] << 8) | chunk->code[offset + 4];
+  printf("%-16s (%d args) %4d (", name, arg_count, constant);
+  printValue(chunk->constants.values[constant]);
+  printf(") cache %d\n", cache);
+  return offset + 5;
+}
+
+static int propertyOp(const char *name, Chunk *chunk, int offset) {
+  uint8_t constant = chunk->code[offset + 1];
+  uint16_t cache =
+      (uint16_t)(chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+  printf("%-16s %4d (", name, constant);
+  printValue(chunk->constants.values[constant]);
+  printf(") cache %d\n", cache);
+  return offset + 4;
+}
+
 static int constantOp(const char *name, Chunk *chunk, int offset) {
   uint8_t constant = chunk->code[offset + 1];
   printf("%-16s %4d (", name, constant);
@@ -126,9 +264,88 @@ static int simpleOp(const char *name, int offset) {
   return offset + 1;
 }
 
-static int jumpOp(const char *name, JumpDirection direction, Chunk *chunk,
-                  int offset) {
-  int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
-  printf("%-16s %4d\n", name, offset + 3 + direction * jump);
+static int jumpOp(const char *name, Chunk *chunk, int offset) {
+  printf("%-16s %4d\n", name, jumpTarget(chunk, offset));
+  return offset + instructionLength(chunk, offset);
+}
+
+static int byteByteOp(const char *name, Chunk *chunk, int offset) {
+  printf("%-16s %4d %4d\n", name, chunk->code[offset + 1],
+         chunk->code[offset + 2]);
   return offset + 3;
+}
+
+static int byteConstantOp(const char *name, Chunk *chunk, int offset) {
+  uint8_t slot = chunk->code[offset + 1];
+  uint8_t constant = chunk->code[offset + 2];
+  printf("%-16s %4d %4d (", name, slot, constant);
+  printValue(chunk->constants.values[constant]);
+  printf(")\n");
+  return offset + 3;
+}
+
+static int localConstJumpOp(const char *name, Chunk *chunk, int offset) {
+  uint8_t slot = chunk->code[offset + 1];
+  uint8_t constant = chunk->code[offset + 2];
+  printf("%-16s %4d %4d (", name, slot, constant);
+  printValue(chunk->constants.values[constant]);
+  printf(") %d\n", jumpTarget(chunk, offset));
+  return offset + instructionLength(chunk, offset);
+}
+void disassembleRegisters(ObjFunction *function) {
+  printf("[==================] %s (registers) [===================]\n",
+         function->name != NULL ? function->name->chars : "<script>");
+
+  for (int i = 0; i < function->registers->size;) {
+    i = disassembleRegisterOp(function, i);
+  }
+}
+
+int disassembleRegisterOp(ObjFunction *function, int offset) {
+  RegisterCode *registers = function->registers;
+  Chunk *chunk = &function->chunk;
+  uint8_t *code = registers->code;
+  int *lines = registers->lines;
+  if (offset > 0 && lines[offset] == lines[offset - 1]) {
+    printf("        ");
+  } else {
+    if (offset > 0) printf("\n");
+    printf(" %04d > ", lines[offset]);
+  }
+
+  printf("%04d %-25s", offset, register_ops[code[offset]].name);
+
+  int end = offset + registerInstructionLength(function, offset);
+  int at = offset + 1;
+  for (const char *operand = register_ops[code[offset]].operands; *operand;
+       ++operand) {
+    switch (*operand) {
+      case 'r':
+        printf(" r%d", code[at++]);
+        break;
+      case 'b':
+        printf(" %d", code[at++]);
+        break;
+      case 'k':
+        printf(" (");
+        printValue(chunk->constants.values[code[at++]]);
+        printf(")");
+        break;
+      case 'j':
+      case 'l': {
+        int jump = (code[at] << 8) | code[at + 1];
+        at += 2;
+        printf(" -> %d", *operand == 'j' ? end + jump : end - jump);
+        break;
+      }
+    }
+  }
+  printf("\n");
+
+  for (; at < end; at += 2) {
+    printf("        %04d |%-20s %s %d\n", at, " ",
+           captureName(code[at]), code[at + 1]);
+  }
+
+  return end;
 }
\ No newline at end of file
@@ -0,0 +1,219 @@
+// open, read, mmap and friends are not part of c99.
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "value.h"
+#include "vm.h"
+
+// makes the whole of a regular file read from its start the block, which
+// saves copying its bytes out of the page cache.
+static bool mapFile(ObjFile *file) {
+  struct stat info;
+  if (fstat(file->fd, &info) < 0 || !S_ISREG(info.st_mode) ||
+      info.st_size == 0 || lseek(file->fd, 0, SEEK_CUR) != 0) {
+    return false;
+  }
+
+  size_t size = (size_t)info.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+  if (mapping == MAP_FAILED) return false;
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  file->mapped = true;
+  file->at_end = true;
+  file->block = mapping;
+  file->capacity = size;
+  file->end = size;
+  return true;
+}
+
+// makes more bytes available after those not taken yet, which move to the
+// front of the block first. the block grows when they fill it. false at the
+// end of the file, which read errors count as.
+static bool fillBlock(ObjFile *file) {
+  if (file->at_end) return false;
+  if (!file->block) {
+    if (mapFile(file)) return true;
+    file->block = ALLOCATE(char, CLOX_FILE_BLOCK);
+    file->capacity = CLOX_FILE_BLOCK;
+  }
+
+  if (file->start > 0) {
+    memmove(file->block, file->block + file->start, file->end - file->start);
+    file->end -= file->start;
+    file->start = 0;
+  }
+  if (file->end == file->capacity) {
+    file->block =
+        GROW_ARRAY(file->block, char, file->capacity, file->capacity * 2);
+    file->capacity *= 2;
+  }
+
+  ssize_t count;
+  do {
+    count = read(file->fd, file->block + file->end,
+                 file->capacity - file->end);
+  } while (count < 0 && errno == EINTR);
+  if (count <= 0) {
+    file->at_end = true;
+    return false;
+  }
+
+  file->end += count;
+  return true;
+}
+
+void closeFile(ObjFile *file) {
+  if (file->mapped) {
+    munmap(file->block, file->capacity);
+  } else {
+    FREE_ARRAY(file->block, char, file->capacity);
+  }
+  if (file->fd > STDIN_FILENO) close(file->fd);
+
+  file->fd = -1;
+  file->mapped = false;
+  file->at_end = true;
+  file->block = NULL;
+  file->capacity = 0;
+  file->start = 0;
+  file->end = 0;
+}
+
+// takes the next length bytes as a string, and skip bytes after them.
+static bool takeString(ObjFile *file, size_t length, size_t skip,
+                       Value *result) {
+  if (length > INT_MAX) {
+    return nativeError("%zu bytes are too many for a string", length);
+  }
+
+  *result = OBJ_VAL(makeString(file->block + file->start, (int)length));
+  file->start += length + skip;
+  return true;
+}
+
+static bool isOpenFile(Value value) {
+  return IS_FILE(value) && AS_FILE(value)->fd >= 0;
+}
+
+// a file, or nil when it cannot be opened.
+static bool nativeFileOpen(int arg_count, Value *args, Value *result) {
+  if (!IS_STRING(args[0])) return nativeError("fileOpen() expects a path");
+
+  int fd;
+  do {
+    fd = open(AS_CSTRING(args[0]), O_RDONLY);
+  } while (fd < 0 && errno == EINTR);
+
+  *result = fd < 0 ? NIL_VAL : OBJ_VAL(newFile(fd));
+  return true;
+}
+
+// the next line without its newline, or nil at the end of the file.
+static bool nativeFileReadLine(int arg_count, Value *args, Value *result) {
+  if (!isOpenFile(args[0])) {
+    return nativeError("fileReadLine() expects an open file");
+  }
+
+  ObjFile *file = AS_FILE(args[0]);
+  size_t scanned = 0;  // bytes past start known to hold no newline.
+  do {
+    size_t available = file->end - file->start;
+    if (available > scanned) {
+      char *line = file->block + file->start;
+      char *newline = memchr(line + scanned, '\n', available - scanned);
+      if (newline) return takeString(file, newline - line, 1, result);
+      scanned = available;
+    }
+  } while (fillBlock(file));
+
+  if (file->start == file->end) {
+    *result = NIL_VAL;
+    return true;
+  }
+  return takeString(file, file->end - file->start, 0, result);
+}
+
+// a string of the next count bytes, fewer only at the end of the file, or
+// nil when nothing is left.
+static bool nativeFileRead(int arg_count, Value *args, Value *result) {
+  int count = isOpenFile(args[0]) ? elementIndex(args[1], INT_MAX) : -1;
+  if (count < 0) {
+    return nativeError("fileRead() expects an open file and a count");
+  }
+
+  ObjFile *file = AS_FILE(args[0]);
+  size_t length = count;
+  while (file->end - file->start < length) {
+    if (!fillBlock(file)) break;
+  }
+
+  size_t available = file->end - file->start;
+  if (available == 0 && length > 0) {
+    *result = NIL_VAL;
+    return true;
+  }
+  return takeString(file, available < length ? available : length, 0,
+                    result);
+}
+
+// copies the next bytes into a uint8 array or a buffer, as many as are in
+// the block up to its length, and returns how many. 0 at the end.
+static bool nativeFileReadInto(int arg_count, Value *args, Value *result) {
+  uint8_t *bytes = NULL;
+  int length = -1;
+  if (IS_ARRAY(args[1]) && AS_ARRAY(args[1])->kind == ARRAY_UINT8) {
+    bytes = AS_ARRAY(args[1])->elements.uint8;
+    length = AS_ARRAY(args[1])->length;
+  } else if (IS_BUFFER(args[1])) {
+    bytes = AS_BUFFER(args[1])->bytes;
+    length = AS_BUFFER(args[1])->length;
+  }
+  if (!isOpenFile(args[0]) || length < 0) {
+    return nativeError(
+        "fileReadInto() expects an open file and a uint8 array or a buffer");
+  }
+
+  ObjFile *file = AS_FILE(args[0]);
+  if (file->start == file->end && length > 0 && !fillBlock(file)) {
+    *result = INT_VAL(0);
+    return true;
+  }
+
+  size_t count = file->end - file->start;
+  if (count > (size_t)length) count = length;
+  if (count > 0) memcpy(bytes, file->block + file->start, count);
+  file->start += count;
+  *result = INT_VAL(count);
+  return true;
+}
+
+static bool nativeFileClose(int arg_count, Value *args, Value *result) {
+  if (!IS_FILE(args[0])) return nativeError("fileClose() expects a file");
+
+  closeFile(AS_FILE(args[0]));
+  *result = NIL_VAL;
+  return true;
+}
+
+void defineIoNatives() {
+  tableSet(&vm->globals, copyString("stdin", 5),
+           OBJ_VAL(newFile(STDIN_FILENO)));
+
+  defineNativeFn("fileOpen", 1, 0, nativeFileOpen);
+  defineNativeFn("fileReadLine", 1, 0, nativeFileReadLine);
+  defineNativeFn("fileRead", 2, 0, nativeFileRead);
+  defineNativeFn("fileReadInto", 2, 0, nativeFileReadInto);
+  defineNativeFn("fileClose", 1, 0, nativeFileClose);
+}
@@ -0,0 +1,1058 @@
+// mmap and MAP_ANONYMOUS are not part of c99.
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+
+#include <string.h>
+
+#include "memory.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+// the generated code keeps the state of the frame in callee saved registers
+// and follows the system v calling convention for the helpers it calls.
+enum {
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+};
+
+#define SP RBX         // the stack pointer of the vm, reloaded after calls.
+#define SLOTS R12      // frame->slots.
+#define CONSTANTS R13  // the constants of the chunk.
+#define FRAME R14      // the running frame.
+#define SP_PTR R15     // &vm->sp.
+#define XMM0 0
+#define XMM1 1
+
+// condition codes of jcc and setcc.
+#define CC_O 0x0
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_BE 0x6
+#define CC_A 0x7
+#define CC_L 0xc
+#define CC_GE 0xd
+#define CC_G 0xf
+
+#define VALUE_SIZE ((int32_t)sizeof(Value))
+#define PAYLOAD ((int32_t)offsetof(Value, as))
+// the byte holding the sign of a number payload.
+#define SIGN_BYTE (PAYLOAD + 7)
+
+// the numbers an arithmetic instruction is compiled for. the generic ones
+// check for ints and take the double path otherwise.
+typedef enum {
+  INTS = 1,
+  DOUBLES = 2,
+  NUMBERS = INTS | DOUBLES,
+} Operands;
+
+// what a rel32 of the generated code is patched to.
+typedef enum {
+  TO_INSTRUCTION,  // the code of the instruction at offset.
+  TO_DEOPT,        // the stub leaving to the interpreter at offset.
+  TO_FALLBACK,
+  TO_ERROR,
+  TO_RETURNED,
+} FixupKind;
+
+typedef struct {
+  int at;
+  FixupKind kind;
+  int offset;
+} Fixup;
+
+typedef struct {
+  Chunk *chunk;
+  uint8_t *code;
+  int size;
+  int capacity;
+  Fixup *fixups;
+  int fixup_count;
+  int fixup_capacity;
+  int *entries;  // code offset of each instruction.
+  int *deopts;   // code offset of the stub for each instruction.
+  PropertyCache *caches;  // of the function, which outlive its code.
+} Assembler;
+
+typedef JitExit (*NativeEntry)(CallFrame *frame, Value **sp, Value *constants,
+                               uint8_t *entry);
+
+static void emitByte(Assembler *as, uint8_t byte) {
+  if (as->size == as->capacity) {
+    int capacity = GROW_CAPACITY(as->capacity);
+    as->code = GROW_ARRAY(as->code, uint8_t, as->capacity, capacity);
+    as->capacity = capacity;
+  }
+  as->code[as->size++] = byte;
+}
+
+static void emit32(Assembler *as, uint32_t value) {
+  for (int i = 0; i < 4; ++i) emitByte(as, (value >> (8 * i)) & 0xff);
+}
+
+static void emit64(Assembler *as, uint64_t value) {
+  for (int i = 0; i < 8; ++i) emitByte(as, (value >> (8 * i)) & 0xff);
+}
+
+// emits the prefix, rex and opcode of an instruction on reg and rm. two byte
+// opcodes are spelled 0x0fxx.
+static void emitOpcode(Assembler *as, uint8_t prefix, bool wide, int opcode,
+                       int reg, int rm) {
+  if (prefix) emitByte(as, prefix);
+  uint8_t rex = 0x40 | wide << 3 | (reg >> 3) << 2 | rm >> 3;
+  if (rex != 0x40) emitByte(as, rex);
+  if (opcode > 0xff) emitByte(as, opcode >> 8);
+  emitByte(as, opcode & 0xff);
+}
+
+// an instruction on reg and [base + disp].
+static void emitMem(Assembler *as, uint8_t prefix, bool wide, int opcode,
+                    int reg, int base, int32_t disp) {
+  emitOpcode(as, prefix, wide, opcode, reg, base);
+
+  int mod = 2;
+  if (disp == 0 && (base & 7) != RBP) {
+    mod = 0;
+  } else if (disp >= INT8_MIN && disp <= INT8_MAX) {
+    mod = 1;
+  }
+  emitByte(as, mod << 6 | (reg & 7) << 3 | (base & 7));
+  if ((base & 7) == RSP) emitByte(as, 0x24);
+  if (mod == 1) emitByte(as, (uint8_t)disp);
+  if (mod == 2) emit32(as, (uint32_t)disp);
+}
+
+// an instruction on two registers.
+static void emitReg(Assembler *as, uint8_t prefix, bool wide, int opcode,
+                    int reg, int rm) {
+  emitOpcode(as, prefix, wide, opcode, reg, rm);
+  emitByte(as, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+static void emitFixup(Assembler *as, FixupKind kind, int offset) {
+  if (as->fixup_count == as->fixup_capacity) {
+    int capacity = GROW_CAPACITY(as->fixup_capacity);
+    as->fixups =
+        GROW_ARRAY(as->fixups, Fixup, as->fixup_capacity, capacity);
+    as->fixup_capacity = capacity;
+  }
+  as->fixups[as->fixup_count++] = (Fixup){as->size, kind, offset};
+  emit32(as, 0);
+}
+
+static void emitJump(Assembler *as, FixupKind kind, int offset) {
+  emitByte(as, 0xe9);
+  emitFixup(as, kind, offset);
+}
+
+static void emitJumpIf(Assembler *as, int cc, FixupKind kind, int offset) {
+  emitByte(as, 0x0f);
+  emitByte(as, 0x80 | cc);
+  emitFixup(as, kind, offset);
+}
+
+// emits a jcc rel8 to be patched once its target is emitted.
+static int emitShortJumpIf(Assembler *as, int cc) {
+  emitByte(as, 0x70 | cc);
+  emitByte(as, 0);
+  return as->size;
+}
+
+// emits a jmp rel8 to be patched like a short jcc.
+static int emitShortJump(Assembler *as) {
+  emitByte(as, 0xeb);
+  emitByte(as, 0);
+  return as->size;
+}
+
+static void patchShortJump(Assembler *as, int end) {
+  as->code[end - 1] = (uint8_t)(as->size - end);
+}
+
+static void emitMovImm64(Assembler *as, int reg, uint64_t value) {
+  emitByte(as, 0x48 | reg >> 3);
+  emitByte(as, 0xb8 | (reg & 7));
+  emit64(as, value);
+}
+
+static void emitMovImm32(Assembler *as, int reg, uint32_t value) {
+  if (reg >= R8) emitByte(as, 0x41);
+  emitByte(as, 0xb8 | (reg & 7));
+  emit32(as, value);
+}
+
+static void emitCall(Assembler *as, void *function) {
+  emitMovImm64(as, RAX, (uint64_t)(uintptr_t)function);
+  emitByte(as, 0xff);
+  emitByte(as, 0xd0);  // call rax
+}
+
+static void emitAdjustSp(Assembler *as, int values) {
+  emitReg(as, 0, true, 0x83, 0, SP);
+  emitByte(as, (uint8_t)(values * VALUE_SIZE));
+}
+
+static void emitSyncSp(Assembler *as) {
+  emitMem(as, 0, true, 0x89, SP, SP_PTR, 0);
+}
+
+static void emitReloadSp(Assembler *as) {
+  emitMem(as, 0, true, 0x8b, SP, SP_PTR, 0);
+}
+
+static void emitSetIp(Assembler *as, int offset) {
+  emitMovImm64(as, RAX, (uint64_t)(uintptr_t)&as->chunk->code[offset]);
+  emitMem(as, 0, true, 0x89, RAX, FRAME, offsetof(CallFrame, ip));
+}
+
+// jumps to the error exit when the helper just called returned false.
+static void emitCheckResult(Assembler *as) {
+  emitByte(as, 0x84);
+  emitByte(as, 0xc0);  // test al, al
+  emitJumpIf(as, CC_E, TO_ERROR, 0);
+}
+
+static void emitPushValue(Assembler *as, int base, int32_t disp) {
+  emitMem(as, 0, false, 0x0f10, XMM0, base, disp);  // movups
+  emitMem(as, 0, false, 0x0f11, XMM0, SP, 0);
+  emitAdjustSp(as, 1);
+}
+
+static void emitCopyValue(Assembler *as, int to, int32_t to_disp, int from,
+                          int32_t from_disp) {
+  emitMem(as, 0, false, 0x0f10, XMM0, from, from_disp);
+  emitMem(as, 0, false, 0x0f11, XMM0, to, to_disp);
+}
+
+static void emitPushLiteral(Assembler *as, ValueType type, int32_t payload) {
+  emitMem(as, 0, false, 0xc7, 0, SP, 0);
+  emit32(as, type);
+  emitMem(as, 0, true, 0xc7, 0, SP, PAYLOAD);
+  emit32(as, (uint32_t)payload);
+  emitAdjustSp(as, 1);
+}
+
+// loads the upvalue location of the closure into rax.
+static void emitUpvalue(Assembler *as, int index) {
+  emitMem(as, 0, true, 0x8b, RAX, FRAME, offsetof(CallFrame, closure));
+  emitMem(as, 0, true, 0x8b, RAX, RAX, offsetof(ObjClosure, upvalues));
+  emitMem(as, 0, true, 0x8b, RAX, RAX, index * (int32_t)sizeof(ObjUpvalue *));
+  emitMem(as, 0, true, 0x8b, RAX, RAX, offsetof(ObjUpvalue, location));
+}
+
+// jumps to the deopt stub unless the value at [base + disp] has the type.
+static void emitGuardType(Assembler *as, int base, int32_t disp,
+                          ValueType type, int offset) {
+  emitMem(as, 0, false, 0x83, 7, base, disp);  // cmp dword, imm8
+  emitByte(as, type);
+  emitJumpIf(as, CC_NE, TO_DEOPT, offset);
+}
+
+// a short jump taken unless the value at [base + disp] has the type.
+static int emitCheckType(Assembler *as, int base, int32_t disp,
+                         ValueType type) {
+  emitMem(as, 0, false, 0x83, 7, base, disp);
+  emitByte(as, type);
+  return emitShortJumpIf(as, CC_NE);
+}
+
+static void emitSetType(Assembler *as, int base, int32_t disp,
+                        ValueType type) {
+  emitMem(as, 0, false, 0xc7, 0, base, disp);
+  emit32(as, type);
+}
+
+// loads the number at [base + disp] into xmm as a double, converting an
+// int. anything else deopts.
+static void emitLoadDouble(Assembler *as, int xmm, int base, int32_t disp,
+                           int offset) {
+  int not_double = emitCheckType(as, base, disp, VAL_NUMBER);
+  emitMem(as, 0xf2, false, 0x0f10, xmm, base, disp + PAYLOAD);  // movsd
+  int done = emitShortJump(as);
+  patchShortJump(as, not_double);
+  emitGuardType(as, base, disp, VAL_INT, offset);
+  emitMem(as, 0xf2, true, 0x0f2a, xmm, base, disp + PAYLOAD);  // cvtsi2sd
+  patchShortJump(as, done);
+}
+
+// the double forms take an int and a double, and leave two ints to the
+// interpreter.
+static void emitDeoptOnInts(Assembler *as, int offset) {
+  int not_int = emitCheckType(as, SP, -2 * VALUE_SIZE, VAL_INT);
+  emitMem(as, 0, false, 0x83, 7, SP, -VALUE_SIZE);
+  emitByte(as, VAL_INT);
+  emitJumpIf(as, CC_E, TO_DEOPT, offset);
+  patchShortJump(as, not_int);
+}
+
+// takes the int path of an instruction on the two numbers on top, leaving
+// a in rax, or returns the short jumps to its double path.
+static void emitIntOperands(Assembler *as, Operands operands, int not_ints[2],
+                            int offset) {
+  int32_t a = -2 * VALUE_SIZE;
+  int32_t b = -VALUE_SIZE;
+  if (operands == INTS) {
+    emitGuardType(as, SP, a, VAL_INT, offset);
+    emitGuardType(as, SP, b, VAL_INT, offset);
+  } else {
+    not_ints[0] = emitCheckType(as, SP, a, VAL_INT);
+    not_ints[1] = emitCheckType(as, SP, b, VAL_INT);
+  }
+  emitMem(as, 0, true, 0x8b, RAX, SP, a + PAYLOAD);
+}
+
+// replaces the two numbers on top with the result of int_opcode on ints,
+// deopting when it overflows, or of sse_opcode on doubles and mixes of
+// both. division has no int_opcode, its quotient is always a double.
+static void emitArithmetic(Assembler *as, Operands operands, int int_opcode,
+                           int sse_opcode, int offset) {
+  int32_t a = -2 * VALUE_SIZE;
+  int32_t b = -VALUE_SIZE;
+  int not_ints[2];
+  int done = -1;
+
+  if (int_opcode && (operands & INTS)) {
+    emitIntOperands(as, operands, not_ints, offset);
+    emitMem(as, 0, true, int_opcode, RAX, SP, b + PAYLOAD);
+    emitJumpIf(as, CC_O, TO_DEOPT, offset);
+    emitMem(as, 0, true, 0x89, RAX, SP, a + PAYLOAD);
+    if (operands == INTS) {
+      emitAdjustSp(as, -1);
+      return;
+    }
+    done = emitShortJump(as);
+    patchShortJump(as, not_ints[0]);
+    patchShortJump(as, not_ints[1]);
+  } else if (operands == DOUBLES) {
+    emitDeoptOnInts(as, offset);
+  }
+
+  emitLoadDouble(as, XMM0, SP, a, offset);
+  emitLoadDouble(as, XMM1, SP, b, offset);
+  emitReg(as, 0xf2, false, sse_opcode, XMM0, XMM1);
+  emitMem(as, 0xf2, false, 0x0f11, XMM0, SP, a + PAYLOAD);
+  emitSetType(as, SP, a, VAL_NUMBER);
+  if (done >= 0) patchShortJump(as, done);
+  emitAdjustSp(as, -1);
+}
+
+// replaces the two numbers on top with a > b, or with b > a when swapped, so
+// that unordered operands compare false.
+static void emitCompare(Assembler *as, Operands operands, bool swapped,
+                        int offset) {
+  int32_t a = -2 * VALUE_SIZE;
+  int32_t b = -VALUE_SIZE;
+  int not_ints[2];
+  int done = -1;
+
+  if (operands & INTS) {
+    emitIntOperands(as, operands, not_ints, offset);
+    emitMem(as, 0, true, 0x3b, RAX, SP, b + PAYLOAD);              // cmp
+    emitReg(as, 0, false, 0x0f90 | (swapped ? CC_L : CC_G), 0, RAX);  // setcc
+    if (operands != INTS) {
+      done = emitShortJump(as);
+      patchShortJump(as, not_ints[0]);
+      patchShortJump(as, not_ints[1]);
+    }
+  }
+
+  if (operands & DOUBLES) {
+    if (operands == DOUBLES) emitDeoptOnInts(as, offset);
+    emitLoadDouble(as, XMM0, SP, swapped ? b : a, offset);
+    emitLoadDouble(as, XMM1, SP, swapped ? a : b, offset);
+    emitReg(as, 0x66, false, 0x0f2e, XMM0, XMM1);  // ucomisd
+    emitReg(as, 0, false, 0x0f90 | CC_A, 0, RAX);  // seta al
+  }
+
+  if (done >= 0) patchShortJump(as, done);
+  emitReg(as, 0, false, 0x0fb6, RAX, RAX);  // movzx
+  emitMem(as, 0, true, 0x89, RAX, SP, a + PAYLOAD);
+  emitSetType(as, SP, a, VAL_BOOL);
+  emitAdjustSp(as, -1);
+}
+
+// jumps to target when the value on top is falsy, or truthy.
+static void emitBranch(Assembler *as, bool if_true, int target) {
+  int skip;
+  emitMem(as, 0, false, 0x83, 7, SP, -VALUE_SIZE);
+  emitByte(as, VAL_NIL);
+  if (if_true) {
+    skip = emitShortJumpIf(as, CC_E);
+  } else {
+    emitJumpIf(as, CC_E, TO_INSTRUCTION, target);
+  }
+  emitMem(as, 0, false, 0x83, 7, SP, -VALUE_SIZE);
+  emitByte(as, VAL_BOOL);
+  if (if_true) {
+    emitJumpIf(as, CC_NE, TO_INSTRUCTION, target);
+  } else {
+    skip = emitShortJumpIf(as, CC_NE);
+  }
+  emitMem(as, 0, false, 0x80, 7, SP, PAYLOAD - VALUE_SIZE);  // cmp byte
+  emitByte(as, 0);
+  emitJumpIf(as, if_true ? CC_NE : CC_E, TO_INSTRUCTION, target);
+  patchShortJump(as, skip);
+}
+
+static bool jitGetGlobal(Value *sp, ObjString *name) {
+  return tableGet(&vm->globals, name, sp);
+}
+
+static bool jitSetGlobal(Value *sp, ObjString *name) {
+  Value value;
+  if (!tableGet(&vm->globals, name, &value)) return false;
+  tableSet(&vm->globals, name, sp[-1]);
+  return true;
+}
+
+static void jitDefineGlobal(Value *sp, ObjString *name) {
+  tableSet(&vm->globals, name, sp[-1]);
+}
+
+static void jitEqual(Value *sp) {
+  sp[-2] = BOOL_VAL(valuesEqual(sp[-2], sp[-1]));
+}
+
+static bool jitRemainder(Value *sp) {
+  if (!IS_NUMERIC(sp[-2]) || !IS_NUMERIC(sp[-1])) return false;
+  return remainderNumbers(sp[-2], sp[-1], &sp[-2]);
+}
+
+static bool jitQuotient(Value *sp) {
+  if (!IS_NUMERIC(sp[-2]) || !IS_NUMERIC(sp[-1])) return false;
+  return quotientNumbers(sp[-2], sp[-1], &sp[-2]);
+}
+
+static bool jitIndexGet(Value *sp) {
+  if (IS_MAP(sp[-2])) {
+    if (!isTableKey(sp[-1])) return false;
+    Table *table = &AS_MAP(sp[-2])->table;
+    if (!tableGetValue(table, sp[-1], &sp[-2])) sp[-2] = NIL_VAL;
+    return true;
+  }
+
+  if (IS_ARRAY(sp[-2])) {
+    ObjArray *array = AS_ARRAY(sp[-2]);
+    int element = elementIndex(sp[-1], array->length);
+    if (element < 0) return false;
+    sp[-2] = arrayLoad(array, element);
+    return true;
+  }
+
+  if (!IS_LIST(sp[-2])) return false;
+  ObjList *list = AS_LIST(sp[-2]);
+  int item = listIndex(list, sp[-1]);
+  if (item < 0) return false;
+
+  sp[-2] = list->items.values[item];
+  return true;
+}
+
+static bool jitIndexSet(Value *sp) {
+  if (IS_MAP(sp[-3])) {
+    if (!isTableKey(sp[-2])) return false;
+    tableSetValue(&AS_MAP(sp[-3])->table, sp[-2], sp[-1]);
+  } else if (IS_ARRAY(sp[-3])) {
+    ObjArray *array = AS_ARRAY(sp[-3]);
+    int element = elementIndex(sp[-2], array->length);
+    if (element < 0 || !arrayStore(array, element, sp[-1])) return false;
+  } else {
+    if (!IS_LIST(sp[-3])) return false;
+    ObjList *list = AS_LIST(sp[-3]);
+    int item = listIndex(list, sp[-2]);
+    if (item < 0) return false;
+    list->items.values[item] = sp[-1];
+  }
+
+  sp[-3] = sp[-1];
+  return true;
+}
+
+static void jitNot(Value *sp) {
+  Value value = sp[-1];
+  sp[-1] = BOOL_VAL(IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value)));
+}
+
+// a field of an instance whose shape the cache holds is loaded or stored in
+// line. other receivers, methods and fields being added go to the runtime,
+// which refills the cache.
+static void emitProperty(Assembler *as, bool set, uint8_t *ip, int next) {
+  PropertyCache *cache = &as->caches[ip[2] << 8 | ip[3]];
+  int32_t receiver = (set ? -2 : -1) * VALUE_SIZE;
+  int misses[4];
+
+  emitMem(as, 0, false, 0x83, 7, SP, receiver);  // cmp dword, imm8
+  emitByte(as, VAL_OBJ);
+  misses[0] = emitShortJumpIf(as, CC_NE);
+  emitMem(as, 0, true, 0x8b, RAX, SP, receiver + PAYLOAD);
+  emitMem(as, 0, false, 0x83, 7, RAX, offsetof(Obj, type));
+  emitByte(as, OBJ_INSTANCE);
+  misses[1] = emitShortJumpIf(as, CC_NE);
+  emitMovImm64(as, RCX, (uint64_t)(uintptr_t)cache);
+  emitMem(as, 0, true, 0x8b, RDX, RAX, offsetof(ObjInstance, shape));
+  emitMem(as, 0, true, 0x3b, RDX, RCX, offsetof(PropertyCache, shape));
+  misses[2] = emitShortJumpIf(as, CC_NE);
+  emitMem(as, 0, true, 0x83, 7, RCX,
+          set ? offsetof(PropertyCache, transition)
+              : offsetof(PropertyCache, method));  // cmp qword, imm8
+  emitByte(as, 0);
+  misses[3] = emitShortJumpIf(as, CC_NE);
+
+  // rdx = &fields[slot].
+  emitMem(as, 0, true, 0x63, RDX, RCX, offsetof(PropertyCache, slot));
+  emitReg(as, 0, true, 0xc1, 4, RDX);  // shl rdx, imm8
+  emitByte(as, 4);
+  emitMem(as, 0, true, 0x03, RDX, RAX, offsetof(ObjInstance, fields));
+  if (set) {
+    emitCopyValue(as, RDX, 0, SP, -VALUE_SIZE);
+    emitCopyValue(as, SP, receiver, SP, -VALUE_SIZE);
+    emitAdjustSp(as, -1);
+  } else {
+    emitCopyValue(as, SP, receiver, RDX, 0);
+  }
+  int done = emitShortJump(as);
+
+  for (int i = 0; i < 4; ++i) patchShortJump(as, misses[i]);
+  emitSetIp(as, next);
+  emitSyncSp(as);
+  emitMem(as, 0, true, 0x8b, RDI, CONSTANTS, ip[1] * VALUE_SIZE + PAYLOAD);
+  emitMovImm64(as, RSI, (uint64_t)(uintptr_t)cache);
+  emitCall(as, set ? (void *)jitSetProperty : (void *)jitGetProperty);
+  emitCheckResult(as);
+  emitReloadSp(as);
+  patchShortJump(as, done);
+}
+
+// calls helper(sp, name) for the global named by the constant.
+static void emitGlobal(Assembler *as, void *helper, uint8_t constant) {
+  emitSyncSp(as);
+  emitReg(as, 0, true, 0x89, SP, RDI);
+  emitMem(as, 0, true, 0x8b, RSI, CONSTANTS,
+          constant * VALUE_SIZE + PAYLOAD);
+  emitCall(as, helper);
+}
+
+static void emitInstruction(Assembler *as, int offset) {
+  Chunk *chunk = as->chunk;
+  uint8_t *ip = &chunk->code[offset];
+  int next = offset + instructionLength(chunk, offset);
+  Value *constants = chunk->constants.values;
+
+  OpCode op = ip[0];
+  switch (op) {
+    case OP_CONSTANT:
+      emitPushValue(as, CONSTANTS, ip[1] * VALUE_SIZE);
+      break;
+    case OP_NIL:
+      emitPushLiteral(as, VAL_NIL, 0);
+      break;
+    case OP_TRUE:
+      emitPushLiteral(as, VAL_BOOL, 1);
+      break;
+    case OP_FALSE:
+      emitPushLiteral(as, VAL_BOOL, 0);
+      break;
+    case OP_POP:
+      emitAdjustSp(as, -1);
+      break;
+    case OP_GET_LOCAL:
+      emitPushValue(as, SLOTS, ip[1] * VALUE_SIZE);
+      break;
+    case OP_GET_LOCAL_GET_LOCAL:
+      emitPushValue(as, SLOTS, ip[1] * VALUE_SIZE);
+      emitPushValue(as, SLOTS, ip[2] * VALUE_SIZE);
+      break;
+    case OP_SET_LOCAL:
+      emitCopyValue(as, SLOTS, ip[1] * VALUE_SIZE, SP, -VALUE_SIZE);
+      break;
+    case OP_GET_UPVALUE:
+      emitUpvalue(as, ip[1]);
+      emitPushValue(as, RAX, 0);
+      break;
+    case OP_SET_UPVALUE:
+      emitUpvalue(as, ip[1]);
+      emitCopyValue(as, RAX, 0, SP, -VALUE_SIZE);
+      break;
+    case OP_DEF_GLOBAL:
+      emitGlobal(as, jitDefineGlobal, ip[1]);
+      emitAdjustSp(as, -1);
+      break;
+    case OP_GET_GLOBAL:
+      // misses are reported by the interpreter.
+      emitGlobal(as, jitGetGlobal, ip[1]);
+      emitByte(as, 0x84);
+      emitByte(as, 0xc0);
+      emitJumpIf(as, CC_E, TO_DEOPT, offset);
+      emitAdjustSp(as, 1);
+      break;
+    case OP_SET_GLOBAL:
+      emitGlobal(as, jitSetGlobal, ip[1]);
+      emitByte(as, 0x84);
+      emitByte(as, 0xc0);
+      emitJumpIf(as, CC_E, TO_DEOPT, offset);
+      break;
+    case OP_NOT:
+      emitReg(as, 0, true, 0x89, SP, RDI);
+      emitCall(as, jitNot);
+      break;
+    case OP_EQUAL:
+      emitReg(as, 0, true, 0x89, SP, RDI);
+      emitCall(as, jitEqual);
+      emitAdjustSp(as, -1);
+      break;
+    case OP_GREATER:
+      emitCompare(as, NUMBERS, false, offset);
+      break;
+    case OP_GREATER_NUMBER:
+      emitCompare(as, DOUBLES, false, offset);
+      break;
+    case OP_GREATER_INT:
+      emitCompare(as, INTS, false, offset);
+      break;
+    case OP_LESS:
+      emitCompare(as, NUMBERS, true, offset);
+      break;
+    case OP_LESS_NUMBER:
+      emitCompare(as, DOUBLES, true, offset);
+      break;
+    case OP_LESS_INT:
+      emitCompare(as, INTS, true, offset);
+      break;
+    case OP_NEGATE: {
+      // ints other than INT64_MIN are negated in place.
+      int not_int = emitCheckType(as, SP, -VALUE_SIZE, VAL_INT);
+      emitMem(as, 0, true, 0xf7, 3, SP, PAYLOAD - VALUE_SIZE);  // neg
+      emitJumpIf(as, CC_O, TO_DEOPT, offset);
+      int done = emitShortJump(as);
+      patchShortJump(as, not_int);
+      emitGuardType(as, SP, -VALUE_SIZE, VAL_NUMBER, offset);
+      emitMem(as, 0, false, 0x80, 6, SP, SIGN_BYTE - VALUE_SIZE);  // xor
+      emitByte(as, 0x80);
+      patchShortJump(as, done);
+      break;
+    }
+    case OP_ADD:
+      // strings are concatenated by the interpreter.
+      emitArithmetic(as, NUMBERS, 0x03, 0x0f58, offset);
+      break;
+    case OP_ADD_NUMBER:
+      emitArithmetic(as, DOUBLES, 0x03, 0x0f58, offset);
+      break;
+    case OP_ADD_INT:
+      emitArithmetic(as, INTS, 0x03, 0x0f58, offset);
+      break;
+    case OP_ADD_STRING:
+      emitJump(as, TO_DEOPT, offset);
+      break;
+    case OP_SUB:
+      emitArithmetic(as, NUMBERS, 0x2b, 0x0f5c, offset);
+      break;
+    case OP_SUB_NUMBER:
+      emitArithmetic(as, DOUBLES, 0x2b, 0x0f5c, offset);
+      break;
+    case OP_SUB_INT:
+      emitArithmetic(as, INTS, 0x2b, 0x0f5c, offset);
+      break;
+    case OP_MUL:
+      emitArithmetic(as, NUMBERS, 0x0faf, 0x0f59, offset);
+      break;
+    case OP_MUL_NUMBER:
+      emitArithmetic(as, DOUBLES, 0x0faf, 0x0f59, offset);
+      break;
+    case OP_MUL_INT:
+      emitArithmetic(as, INTS, 0x0faf, 0x0f59, offset);
+      break;
+    case OP_DIV:
+      emitArithmetic(as, NUMBERS, 0, 0x0f5e, offset);
+      break;
+    case OP_DIV_NUMBER:
+      emitArithmetic(as, DOUBLES, 0, 0x0f5e, offset);
+      break;
+    case OP_MOD:
+      // division by zero is reported by the interpreter.
+      emitReg(as, 0, true, 0x89, SP, RDI);
+      emitCall(as, jitRemainder);
+      emitByte(as, 0x84);
+      emitByte(as, 0xc0);
+      emitJumpIf(as, CC_E, TO_DEOPT, offset);
+      emitAdjustSp(as, -1);
+      break;
+    case OP_QUOTIENT:
+      emitReg(as, 0, true, 0x89, SP, RDI);
+      emitCall(as, jitQuotient);
+      emitByte(as, 0x84);
+      emitByte(as, 0xc0);
+      emitJumpIf(as, CC_E, TO_DEOPT, offset);
+      emitAdjustSp(as, -1);
+      break;
+    case OP_ADD_LOCAL_CONST: {
+      int32_t local = ip[1] * VALUE_SIZE;
+      int32_t constant = ip[2] * VALUE_SIZE + PAYLOAD;
+      if (IS_INT(constants[ip[2]])) {
+        int not_int = emitCheckType(as, SLOTS, local, VAL_INT);
+        // the slot is only written once the sum is known not to overflow,
+        // the interpreter redoes the add on deopt.
+        emitMem(as, 0, true, 0x8b, RAX, SLOTS, local + PAYLOAD);
+        emitMem(as, 0, true, 0x03, RAX, CONSTANTS, constant);  // add
+        emitJumpIf(as, CC_O, TO_DEOPT, offset);
+        emitMem(as, 0, true, 0x89, RAX, SLOTS, local + PAYLOAD);
+        int done = emitShortJump(as);
+        patchShortJump(as, not_int);
+        emitGuardType(as, SLOTS, local, VAL_NUMBER, offset);
+        emitMem(as, 0xf2, true, 0x0f2a, XMM0, CONSTANTS, constant);
+        emitMem(as, 0xf2, false, 0x0f58, XMM0, SLOTS, local + PAYLOAD);
+        emitMem(as, 0xf2, false, 0x0f11, XMM0, SLOTS, local + PAYLOAD);
+        patchShortJump(as, done);
+        break;
+      }
+      if (!IS_NUMBER(constants[ip[2]])) {
+        emitJump(as, TO_DEOPT, offset);
+        break;
+      }
+      emitLoadDouble(as, XMM0, SLOTS, local, offset);
+      emitMem(as, 0xf2, false, 0x0f58, XMM0, CONSTANTS, constant);
+      emitMem(as, 0xf2, false, 0x0f11, XMM0, SLOTS, local + PAYLOAD);
+      emitSetType(as, SLOTS, local, VAL_NUMBER);
+      break;
+    }
+    case OP_JUMP:
+    case OP_LOOP:
+    case OP_JUMP_LONG:
+    case OP_LOOP_LONG:
+      emitJump(as, TO_INSTRUCTION, jumpTarget(chunk, offset));
+      break;
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_FALSE_LONG:
+      emitBranch(as, false, jumpTarget(chunk, offset));
+      break;
+    case OP_JUMP_IF_TRUE:
+    case OP_JUMP_IF_TRUE_LONG:
+      emitBranch(as, true, jumpTarget(chunk, offset));
+      break;
+    case OP_LOCAL_LESS_CONST_JUMP:
+    case OP_LOCAL_LESS_CONST_JUMP_LONG: {
+      int32_t local = ip[1] * VALUE_SIZE;
+      int32_t constant = ip[2] * VALUE_SIZE + PAYLOAD;
+      int target = jumpTarget(chunk, offset);
+      if (IS_INT(constants[ip[2]])) {
+        int not_int = emitCheckType(as, SLOTS, local, VAL_INT);
+        emitMem(as, 0, true, 0x8b, RAX, SLOTS, local + PAYLOAD);
+        emitMem(as, 0, true, 0x3b, RAX, CONSTANTS, constant);  // cmp
+        emitJumpIf(as, CC_GE, TO_INSTRUCTION, target);
+        int done = emitShortJump(as);
+        patchShortJump(as, not_int);
+        emitGuardType(as, SLOTS, local, VAL_NUMBER, offset);
+        emitMem(as, 0xf2, true, 0x0f2a, XMM0, CONSTANTS, constant);
+        emitMem(as, 0x66, false, 0x0f2e, XMM0, SLOTS, local + PAYLOAD);
+        emitJumpIf(as, CC_BE, TO_INSTRUCTION, target);
+        patchShortJump(as, done);
+        break;
+      }
+      if (!IS_NUMBER(constants[ip[2]])) {
+        emitJump(as, TO_DEOPT, offset);
+        break;
+      }
+      // jumps unless constant > local, unordered included.
+      emitMem(as, 0xf2, false, 0x0f10, XMM0, CONSTANTS, constant);
+      emitLoadDouble(as, XMM1, SLOTS, local, offset);
+      emitReg(as, 0x66, false, 0x0f2e, XMM0, XMM1);  // ucomisd
+      emitJumpIf(as, CC_BE, TO_INSTRUCTION, target);
+      break;
+    }
+    case OP_BUILD_LIST:
+      emitSyncSp(as);
+      emitMovImm32(as, RDI, ip[1]);
+      emitCall(as, jitBuildList);
+      emitReloadSp(as);
+      break;
+    case OP_BUILD_MAP:
+      emitSetIp(as, next);
+      emitSyncSp(as);
+      emitMovImm32(as, RDI, ip[1]);
+      emitCall(as, jitBuildMap);
+      emitCheckResult(as);
+      emitReloadSp(as);
+      break;
+    case OP_INDEX_GET:
+      // bad operands are reported by the interpreter.
+      emitReg(as, 0, true, 0x89, SP, RDI);
+      emitCall(as, jitIndexGet);
+      emitByte(as, 0x84);
+      emitByte(as, 0xc0);
+      emitJumpIf(as, CC_E, TO_DEOPT, offset);
+      emitAdjustSp(as, -1);
+      break;
+    case OP_INDEX_SET:
+      emitReg(as, 0, true, 0x89, SP, RDI);
+      emitCall(as, jitIndexSet);
+      emitByte(as, 0x84);
+      emitByte(as, 0xc0);
+      emitJumpIf(as, CC_E, TO_DEOPT, offset);
+      emitAdjustSp(as, -2);
+      break;
+    case OP_GET_PROPERTY:
+      emitProperty(as, false, ip, next);
+      break;
+    case OP_SET_PROPERTY:
+      emitProperty(as, true, ip, next);
+      break;
+    case OP_INVOKE:
+      emitSetIp(as, next);
+      emitSyncSp(as);
+      emitMem(as, 0, true, 0x8b, RDI, CONSTANTS, ip[1] * VALUE_SIZE + PAYLOAD);
+      emitMovImm32(as, RSI, ip[2]);
+      emitMovImm64(as, RDX,
+                   (uint64_t)(uintptr_t)&as->caches[ip[3] << 8 | ip[4]]);
+      emitCall(as, jitInvoke);
+      emitCheckResult(as);
+      emitReloadSp(as);
+      break;
+    case OP_SUPER_INVOKE:
+      emitSetIp(as, next);
+      emitSyncSp(as);
+      emitMem(as, 0, true, 0x8b, RDI, CONSTANTS, ip[1] * VALUE_SIZE + PAYLOAD);
+      emitMovImm32(as, RSI, ip[2]);
+      emitCall(as, jitInvokeSuper);
+      emitCheckResult(as);
+      emitReloadSp(as);
+      break;
+    case OP_GET_SUPER:
+    case OP_CLASS:
+    case OP_INHERIT:
+    case OP_METHOD:
+      // run once per class or super call, the interpreter handles them.
+      emitJump(as, TO_DEOPT, offset);
+      break;
+    case OP_CLOSE_UPVALUE:
+      emitSyncSp(as);
+      emitMem(as, 0, true, 0x8d, RDI, SP, -VALUE_SIZE);  // lea
+      emitCall(as, jitCloseUpvalue);
+      emitAdjustSp(as, -1);
+      break;
+    case OP_CLOSURE:
+      emitSetIp(as, offset + 1);
+      emitSyncSp(as);
+      emitReg(as, 0, true, 0x89, FRAME, RDI);
+      emitCall(as, jitClosure);
+      emitReloadSp(as);
+      break;
+    case OP_CALL:
+    case OP_CALL_0:
+    case OP_CALL_1:
+    case OP_CALL_2:
+    case OP_CALL_3:
+      // the ip of the caller is kept for the lines of runtime errors.
+      emitSetIp(as, next);
+      emitSyncSp(as);
+      emitMovImm32(as, RDI, op == OP_CALL ? ip[1] : op - OP_CALL_0);
+      emitCall(as, jitCall);
+      emitCheckResult(as);
+      emitReloadSp(as);
+      break;
+    case OP_TAIL_CALL_NATIVE:
+    case OP_CALL_NATIVE:
+      if (op == OP_TAIL_CALL_NATIVE) {
+        // a closure in the global is left to the interpreter, which reuses
+        // the frame for it.
+        emitMem(as, 0, true, 0x8b, RDI, CONSTANTS,
+                ip[1] * VALUE_SIZE + PAYLOAD);
+        emitCall(as, jitHoldsNative);
+        emitByte(as, 0x84);
+        emitByte(as, 0xc0);  // test al, al
+        emitJumpIf(as, CC_E, TO_DEOPT, offset);
+      }
+      emitSetIp(as, next);
+      emitSyncSp(as);
+      emitMem(as, 0, true, 0x8b, RDI, CONSTANTS, ip[1] * VALUE_SIZE + PAYLOAD);
+      emitMovImm32(as, RSI, ip[2]);
+      emitCall(as, jitCallGlobal);
+      emitCheckResult(as);
+      emitReloadSp(as);
+      break;
+    case OP_TAIL_CALL:
+    case OP_TAIL_CALL_0:
+    case OP_TAIL_CALL_1:
+    case OP_TAIL_CALL_2:
+    case OP_TAIL_CALL_3:
+      // the interpreter reuses the frame.
+      emitJump(as, TO_DEOPT, offset);
+      break;
+    case OP_RETURN:
+      emitSyncSp(as);
+      emitReg(as, 0, true, 0x89, FRAME, RDI);
+      emitCall(as, jitReturn);
+      emitJump(as, TO_RETURNED, 0);
+      break;
+  }
+}
+
+static void emitPrologue(Assembler *as) {
+  static const uint8_t prologue[] = {
+      0x55,                    // push rbp
+      0x48, 0x89, 0xe5,        // mov rbp, rsp
+      0x53,                    // push rbx
+      0x41, 0x54,              // push r12
+      0x41, 0x55,              // push r13
+      0x41, 0x56,              // push r14
+      0x41, 0x57,              // push r15
+      0x48, 0x83, 0xec, 0x08,  // sub rsp, 8
+  };
+  for (size_t i = 0; i < sizeof(prologue); ++i) emitByte(as, prologue[i]);
+
+  emitReg(as, 0, true, 0x89, RDI, FRAME);
+  emitReg(as, 0, true, 0x89, RSI, SP_PTR);
+  emitReg(as, 0, true, 0x89, RDX, CONSTANTS);
+  emitReloadSp(as);
+  emitMem(as, 0, true, 0x8b, SLOTS, FRAME, offsetof(CallFrame, slots));
+  emitByte(as, 0xff);
+  emitByte(as, 0xe1);  // jmp rcx
+}
+
+// emits the deopt stubs and the exits, and returns where each exit starts.
+static void emitExits(Assembler *as, int exits[]) {
+  int fixup_count = as->fixup_count;
+  for (int i = 0; i < fixup_count; ++i) {
+    Fixup *fixup = &as->fixups[i];
+    if (fixup->kind != TO_DEOPT || as->deopts[fixup->offset] >= 0) continue;
+
+    as->deopts[fixup->offset] = as->size;
+    emitSetIp(as, fixup->offset);
+    emitJump(as, TO_FALLBACK, 0);
+  }
+
+  static const uint8_t epilogue[] = {
+      0x48, 0x83, 0xc4, 0x08,  // add rsp, 8
+      0x41, 0x5f,              // pop r15
+      0x41, 0x5e,              // pop r14
+      0x41, 0x5d,              // pop r13
+      0x41, 0x5c,              // pop r12
+      0x5b,                    // pop rbx
+      0x5d,                    // pop rbp
+      0xc3,                    // ret
+  };
+
+  exits[TO_FALLBACK] = as->size;
+  emitSyncSp(as);
+  emitMovImm32(as, RAX, JIT_FALLBACK);
+  int done = as->size;
+  for (size_t i = 0; i < sizeof(epilogue); ++i) emitByte(as, epilogue[i]);
+
+  exits[TO_RETURNED] = as->size;
+  emitMovImm32(as, RAX, JIT_RETURNED);
+  emitByte(as, 0xeb);
+  emitByte(as, (uint8_t)(done - (as->size + 1)));
+
+  exits[TO_ERROR] = as->size;
+  emitMovImm32(as, RAX, JIT_ERROR);
+  emitByte(as, 0xeb);
+  emitByte(as, (uint8_t)(done - (as->size + 1)));
+}
+
+static void patchFixups(Assembler *as, int exits[]) {
+  for (int i = 0; i < as->fixup_count; ++i) {
+    Fixup *fixup = &as->fixups[i];
+    int target;
+    switch (fixup->kind) {
+      case TO_INSTRUCTION:
+        target = as->entries[fixup->offset];
+        break;
+      case TO_DEOPT:
+        target = as->deopts[fixup->offset];
+        break;
+      default:
+        target = exits[fixup->kind];
+        break;
+    }
+
+    uint32_t rel = (uint32_t)(target - (fixup->at + 4));
+    memcpy(&as->code[fixup->at], &rel, sizeof(rel));
+  }
+}
+
+JitCode *compileNative(ObjFunction *function) {
+  Chunk *chunk = &function->chunk;
+  Assembler as = {.chunk = chunk, .caches = function->caches};
+  as.entries = ALLOCATE(int, chunk->size);
+  as.deopts = ALLOCATE(int, chunk->size);
+  for (int i = 0; i < chunk->size; ++i) as.entries[i] = as.deopts[i] = -1;
+
+  emitPrologue(&as);
+  for (int offset = 0; offset < chunk->size;
+       offset += instructionLength(chunk, offset)) {
+    as.entries[offset] = as.size;
+    emitInstruction(&as, offset);
+  }
+
+  int exits[TO_RETURNED + 1];
+  emitExits(&as, exits);
+  patchFixups(&as, exits);
+
+  FREE_ARRAY(as.deopts, int, chunk->size);
+  FREE_ARRAY(as.fixups, Fixup, as.fixup_capacity);
+
+  uint8_t *code = mmap(NULL, as.size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code != MAP_FAILED) {
+    memcpy(code, as.code, as.size);
+    if (mprotect(code, as.size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(code, as.size);
+      code = MAP_FAILED;
+    }
+  }
+  FREE_ARRAY(as.code, uint8_t, as.capacity);
+
+  if (code == MAP_FAILED) {
+    FREE_ARRAY(as.entries, int, chunk->size);
+    return NULL;
+  }
+
+  JitCode *jit = ALLOCATE(JitCode, 1);
+  jit->code = code;
+  jit->size = as.size;
+  jit->entries = as.entries;
+  jit->entry_count = chunk->size;
+  return jit;
+}
+
+void freeJitCode(JitCode *code) {
+  munmap(code->code, code->size);
+  FREE_ARRAY(code->entries, int, code->entry_count);
+  FREE(code, JitCode);
+}
+
+JitExit enterNative(JitCode *code, CallFrame *frame, int offset) {
+  if (code->entries[offset] < 0) return JIT_FALLBACK;
+
+  NativeEntry entry = (NativeEntry)code->code;
+  return entry(frame, &vm->sp, frame->closure->function->chunk.constants.values,
+               code->code + code->entries[offset]);
+}
+
+#else
+
+JitCode *compileNative(ObjFunction *function) { return NULL; }
+
+void freeJitCode(JitCode *code) {}
+
+JitExit enterNative(JitCode *code, CallFrame *frame, int offset) {
+  return JIT_FALLBACK;
+}
+
+#endif
@@ -1,27 +1,60 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "chunk.h"
 #include "common.h"
+#include "compiler.h"
 #include "debug.h"
+#include "scanner.h"
 #include "vm.h"
 
 static void repl();
 static void runFile(const char *path);
+static void lexFile(const char *path);
+
+static void usage(const char *program) {
+  printf("%s: usage: %s [-O] [--registers] [--jit] [--lex-only] [path]\n",
+         program, program);
+  exit(64);
+}
 
 int main(int argc, const char *argv[]) {
-  initVM();
+  const char *path = NULL;
+  bool lex_only = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--lex-only")) {
+      lex_only = true;
+    } else if (!strcmp(argv[i], "-O")) {
+      compiler_options.optimize = true;
+    } else if (!strcmp(argv[i], "--registers")) {
+      compiler_options.registers = true;
+    } else if (!strcmp(argv[i], "--jit")) {
+      compiler_options.jit = true;
+    } else if (argv[i][0] == '-' || path) {
+      usage(argv[0]);
+    } else {
+      path = argv[i];
+    }
+  }
+
+  if (lex_only) {
+    if (!path) usage(argv[0]);
+    lexFile(path);
+    return 0;
+  }
+
+  VM *instance = newVM();
 
-  if (argc == 1) {
+  if (!path) {
     repl();
-  } else if (argc == 2) {
-    runFile(argv[1]);
   } else {
-    printf("%s: usage: %s [path]\n", argv[0], argv[0]);
+    runFile(path);
   }
 
-  freeVM();
+  freeVM(instance);
 }
 
 static void repl() {
@@ -69,6 +102,22 @@ static char *readFile(const char *path) {
   return source;
 }
 
+static void lexFile(const char *path) {
+  char *source = readFile(path);
+
+  clock_t start = clock();
+  initScanner(source);
+  long tokens = 0;
+  while (scanToken().type != TOKEN_EOF) ++tokens;
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  free(source);
+
+  printf("%ld tokens in %.3fs", tokens, seconds);
+  if (seconds > 0) printf(" (%.0f tokens/sec)", tokens / seconds);
+  printf("\n");
+}
+
 static void runFile(const char *path) {
   char *source = readFile(path);
 
@@ -1,6 +1,10 @@
 #include <stdlib.h>
 
+#include "io.h"
+#include "jit.h"
 #include "memory.h"
+#include "program.h"
+#include "register.h"
 #include "vm.h"
 
 void *reallocate(void *previous, size_t old_size, size_t new_size) {
@@ -21,13 +25,24 @@ static void freeObject(Obj *object) {
     }
     case OBJ_FUNCTION: {
       ObjFunction *function = (ObjFunction *)object;
-      freeChunk(&function->chunk);
+      if (function->program) {
+        freeValueArray(&function->chunk.constants);
+        releaseProgram(function->program);
+      } else {
+        freeChunk(&function->chunk);
+      }
+      if (function->registers) freeRegisterCode(function->registers);
+      if (function->jit) freeJitCode(function->jit);
+      FREE_ARRAY(function->caches, PropertyCache, function->cache_count);
       FREE(function, ObjFunction);
       break;
     }
     case OBJ_CLOSURE: {
       ObjClosure *closure = (ObjClosure *)object;
       FREE_ARRAY(closure->upvalues, ObjUpvalue *, closure->upvalue_count);
+      if (closure->copies) {
+        FREE_ARRAY(closure->copies, ObjUpvalue, closure->upvalue_count);
+      }
       FREE(closure, ObjClosure);
       break;
     }
@@ -39,11 +54,72 @@ static void freeObject(Obj *object) {
       FREE(object, ObjUpvalue);
       break;
     }
+    case OBJ_BUFFER: {
+      ObjBuffer *buffer = (ObjBuffer *)object;
+      if (!buffer->is_external) {
+        FREE_ARRAY(buffer->bytes, uint8_t, buffer->length);
+      }
+      FREE(buffer, ObjBuffer);
+      break;
+    }
+    case OBJ_ARRAY: {
+      ObjArray *array = (ObjArray *)object;
+      FREE_ARRAY(array->elements.uint8, uint8_t,
+                 arrayElementSize(array->kind) * array->length);
+      FREE(array, ObjArray);
+      break;
+    }
+    case OBJ_STRING_BUILDER: {
+      ObjStringBuilder *builder = (ObjStringBuilder *)object;
+      FREE_ARRAY(builder->chars, char, builder->capacity);
+      FREE(builder, ObjStringBuilder);
+      break;
+    }
+    case OBJ_FILE: {
+      ObjFile *file = (ObjFile *)object;
+      closeFile(file);
+      FREE(file, ObjFile);
+      break;
+    }
+    case OBJ_LIST: {
+      ObjList *list = (ObjList *)object;
+      freeValueArray(&list->items);
+      FREE(list, ObjList);
+      break;
+    }
+    case OBJ_MAP: {
+      ObjMap *map = (ObjMap *)object;
+      freeTable(&map->table);
+      FREE(map, ObjMap);
+      break;
+    }
+    case OBJ_CLASS: {
+      ObjClass *klass = (ObjClass *)object;
+      freeTable(&klass->methods);
+      FREE(klass, ObjClass);
+      break;
+    }
+    case OBJ_INSTANCE: {
+      ObjInstance *instance = (ObjInstance *)object;
+      FREE_ARRAY(instance->fields, Value, instance->field_capacity);
+      FREE(instance, ObjInstance);
+      break;
+    }
+    case OBJ_BOUND_METHOD: {
+      FREE(object, ObjBoundMethod);
+      break;
+    }
+    case OBJ_SHAPE: {
+      ObjShape *shape = (ObjShape *)object;
+      freeTable(&shape->transitions);
+      FREE(shape, ObjShape);
+      break;
+    }
   }
 }
 
 void freeObjects() {
-  Obj *object = vm.objects;
+  Obj *object = vm->objects;
   while (object) {
     Obj *next = object->next;
     freeObject(object);
@@ -0,0 +1,333 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+
+// doubles are printed with grisu3, from loitsch's "printing floating-point
+// numbers quickly and accurately with integers". it scales the double and
+// the halfway points to its neighbours by a cached power of ten, and
+// generates digits until they fall between those. for about one double in
+// two hundred the rounding of that scaling leaves the result in doubt, and
+// the c library finds the digits instead.
+
+// a number f * 2^e.
+typedef struct {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+#define SIGNIFICAND_BITS 52
+#define HIDDEN_BIT (1ull << SIGNIFICAND_BITS)
+#define EXPONENT_BIAS (1023 + SIGNIFICAND_BITS)
+
+// the normalized powers 10^-348, 10^-340, ..., 10^340, rounded.
+static const struct {
+  uint64_t f;
+  int e;
+} cached_powers[] = {
+    {0xfa8fd5a0081c0288, -1220}, {0xbaaee17fa23ebf76, -1193},
+    {0x8b16fb203055ac76, -1166}, {0xcf42894a5dce35ea, -1140},
+    {0x9a6bb0aa55653b2d, -1113}, {0xe61acf033d1a45df, -1087},
+    {0xab70fe17c79ac6ca, -1060}, {0xff77b1fcbebcdc4f, -1034},
+    {0xbe5691ef416bd60c, -1007}, {0x8dd01fad907ffc3c, -980},
+    {0xd3515c2831559a83, -954}, {0x9d71ac8fada6c9b5, -927},
+    {0xea9c227723ee8bcb, -901}, {0xaecc49914078536d, -874},
+    {0x823c12795db6ce57, -847}, {0xc21094364dfb5637, -821},
+    {0x9096ea6f3848984f, -794}, {0xd77485cb25823ac7, -768},
+    {0xa086cfcd97bf97f4, -741}, {0xef340a98172aace5, -715},
+    {0xb23867fb2a35b28e, -688}, {0x84c8d4dfd2c63f3b, -661},
+    {0xc5dd44271ad3cdba, -635}, {0x936b9fcebb25c996, -608},
+    {0xdbac6c247d62a584, -582}, {0xa3ab66580d5fdaf6, -555},
+    {0xf3e2f893dec3f126, -529}, {0xb5b5ada8aaff80b8, -502},
+    {0x87625f056c7c4a8b, -475}, {0xc9bcff6034c13053, -449},
+    {0x964e858c91ba2655, -422}, {0xdff9772470297ebd, -396},
+    {0xa6dfbd9fb8e5b88f, -369}, {0xf8a95fcf88747d94, -343},
+    {0xb94470938fa89bcf, -316}, {0x8a08f0f8bf0f156b, -289},
+    {0xcdb02555653131b6, -263}, {0x993fe2c6d07b7fac, -236},
+    {0xe45c10c42a2b3b06, -210}, {0xaa242499697392d3, -183},
+    {0xfd87b5f28300ca0e, -157}, {0xbce5086492111aeb, -130},
+    {0x8cbccc096f5088cc, -103}, {0xd1b71758e219652c, -77},
+    {0x9c40000000000000, -50}, {0xe8d4a51000000000, -24},
+    {0xad78ebc5ac620000, 3}, {0x813f3978f8940984, 30},
+    {0xc097ce7bc90715b3, 56}, {0x8f7e32ce7bea5c70, 83},
+    {0xd5d238a4abe98068, 109}, {0x9f4f2726179a2245, 136},
+    {0xed63a231d4c4fb27, 162}, {0xb0de65388cc8ada8, 189},
+    {0x83c7088e1aab65db, 216}, {0xc45d1df942711d9a, 242},
+    {0x924d692ca61be758, 269}, {0xda01ee641a708dea, 295},
+    {0xa26da3999aef774a, 322}, {0xf209787bb47d6b85, 348},
+    {0xb454e4a179dd1877, 375}, {0x865b86925b9bc5c2, 402},
+    {0xc83553c5c8965d3d, 428}, {0x952ab45cfa97a0b3, 455},
+    {0xde469fbd99a05fe3, 481}, {0xa59bc234db398c25, 508},
+    {0xf6c69a72a3989f5c, 534}, {0xb7dcbf5354e9bece, 561},
+    {0x88fcf317f22241e2, 588}, {0xcc20ce9bd35c78a5, 614},
+    {0x98165af37b2153df, 641}, {0xe2a0b5dc971f303a, 667},
+    {0xa8d9d1535ce3b396, 694}, {0xfb9b7cd9a4a7443c, 720},
+    {0xbb764c4ca7a44410, 747}, {0x8bab8eefb6409c1a, 774},
+    {0xd01fef10a657842c, 800}, {0x9b10a4e5e9913129, 827},
+    {0xe7109bfba19c0c9d, 853}, {0xac2820d9623bf429, 880},
+    {0x80444b5e7aa7cf85, 907}, {0xbf21e44003acdd2d, 933},
+    {0x8e679c2f5e44ff8f, 960}, {0xd433179d9c8cb841, 986},
+    {0x9e19db92b4e31ba9, 1013}, {0xeb96bf6ebadf77d9, 1039},
+    {0xaf87023b9bf0ee6b, 1066},
+};
+
+static const uint64_t powers_of_ten[] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+static DiyFp fromDouble(double number) {
+  uint64_t bits;
+  memcpy(&bits, &number, sizeof(bits));
+  int biased = (int)(bits >> SIGNIFICAND_BITS) & 0x7ff;
+  uint64_t significand = bits & (HIDDEN_BIT - 1);
+  if (biased == 0) return (DiyFp){significand, 1 - EXPONENT_BIAS};
+  return (DiyFp){significand + HIDDEN_BIT, biased - EXPONENT_BIAS};
+}
+
+static DiyFp normalize(DiyFp x) {
+  int shift = __builtin_clzll(x.f);
+  return (DiyFp){x.f << shift, x.e - shift};
+}
+
+// the upper 64 bits of the product, rounded.
+static DiyFp multiply(DiyFp x, DiyFp y) {
+  uint64_t a = x.f >> 32, b = x.f & 0xffffffff;
+  uint64_t c = y.f >> 32, d = y.f & 0xffffffff;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t middle = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff);
+  middle += 1ull << 31;
+  return (DiyFp){ac + (ad >> 32) + (bc >> 32) + (middle >> 32),
+                 x.e + y.e + 64};
+}
+
+// the halfway points to the neighbouring doubles, with the exponent of the
+// normalized upper one.
+static void boundaries(DiyFp v, DiyFp *minus, DiyFp *plus) {
+  *plus = normalize((DiyFp){(v.f << 1) + 1, v.e - 1});
+  // below a power of two the neighbour is half as far.
+  if (v.f == HIDDEN_BIT) {
+    *minus = (DiyFp){(v.f << 2) - 1, v.e - 2};
+  } else {
+    *minus = (DiyFp){(v.f << 1) - 1, v.e - 1};
+  }
+  minus->f <<= minus->e - plus->e;
+  minus->e = plus->e;
+}
+
+// the cached 10^-k that brings a number of exponent e to one between -60
+// and -32, so its integral part fits 32 bits.
+static DiyFp cachedPower(int e, int *k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ceiling = (int)dk;
+  if (dk - ceiling > 0) ++ceiling;
+
+  int index = (ceiling >> 3) + 1;
+  *k = 348 - index * 8;
+  return (DiyFp){cached_powers[index].f, cached_powers[index].e};
+}
+
+// moves the last digit down towards w while the digits stay in range and
+// get closer to it. false when the imprecision of the scaled numbers, unit,
+// leaves it unclear whether they are the closest.
+static bool roundWeed(char *digits, int length, uint64_t too_high_w,
+                      uint64_t unsafe, uint64_t rest, uint64_t ten_kappa,
+                      uint64_t unit) {
+  uint64_t small = too_high_w - unit;
+  uint64_t big = too_high_w + unit;
+  while (rest < small && unsafe - rest >= ten_kappa &&
+         (rest + ten_kappa < small ||
+          small - rest >= rest + ten_kappa - small)) {
+    --digits[length - 1];
+    rest += ten_kappa;
+  }
+
+  if (rest < big && unsafe - rest >= ten_kappa &&
+      (rest + ten_kappa < big || big - rest > rest + ten_kappa - big)) {
+    return false;
+  }
+  return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+// the fewest digits of w that fall strictly between low and high, widened
+// by the error of scaling them. k is set to the decimal exponent of the
+// last digit. false when they may not be the shortest or closest.
+static bool generateDigits(DiyFp low, DiyFp w, DiyFp high, char *digits,
+                           int *length, int *k) {
+  uint64_t unit = 1;
+  uint64_t too_high = high.f + unit;
+  uint64_t unsafe = too_high - (low.f - unit);
+  int shift = -w.e;
+  uint64_t one = 1ull << shift;
+  uint32_t integral = (uint32_t)(too_high >> shift);
+  uint64_t fraction = too_high & (one - 1);
+
+  int kappa = 1;
+  while (kappa < 10 && integral >= powers_of_ten[kappa]) ++kappa;
+
+  *length = 0;
+  while (kappa > 0) {
+    uint32_t power = (uint32_t)powers_of_ten[--kappa];
+    uint32_t digit = integral / power;
+    integral %= power;
+    if (digit || *length) digits[(*length)++] = (char)('0' + digit);
+
+    uint64_t rest = ((uint64_t)integral << shift) + fraction;
+    if (rest < unsafe) {
+      *k += kappa;
+      return roundWeed(digits, *length, too_high - w.f, unsafe, rest,
+                       (uint64_t)power << shift, unit);
+    }
+  }
+
+  for (;;) {
+    fraction *= 10;
+    unit *= 10;
+    unsafe *= 10;
+    char digit = (char)(fraction >> shift);
+    if (digit || *length) digits[(*length)++] = (char)('0' + digit);
+    fraction &= one - 1;
+    --kappa;
+
+    if (fraction < unsafe) {
+      *k += kappa;
+      return roundWeed(digits, *length, (too_high - w.f) * unit, unsafe,
+                       fraction, one, unit);
+    }
+  }
+}
+
+// the digits of a positive double, which is digits * 10^k, or false in the
+// rare cases grisu cannot vouch for them.
+static bool grisu3(double number, char *digits, int *length, int *k) {
+  DiyFp v = fromDouble(number);
+  DiyFp minus, plus;
+  boundaries(v, &minus, &plus);
+
+  DiyFp c = cachedPower(plus.e, k);
+  return generateDigits(multiply(minus, c), multiply(normalize(v), c),
+                        multiply(plus, c), digits, length, k);
+}
+
+// the shortest digits through the c library, trying the precisions that can
+// be needed. with at most 15 digits printing rounds to them exactly.
+static int exactDigits(double number, char *digits, int *k) {
+  char text[32];
+  for (int precision = 15;; ++precision) {
+    snprintf(text, sizeof(text), "%.*e", precision - 1, number);
+    if (precision == 17 || strtod(text, NULL) == number) break;
+  }
+
+  int length = 0;
+  char *at = text;
+  for (; *at != 'e'; ++at) {
+    if (*at != '.') digits[length++] = *at;
+  }
+  *k = atoi(at + 1) - (length - 1);
+  while (length > 1 && digits[length - 1] == '0') {
+    --length;
+    ++*k;
+  }
+  return length;
+}
+
+static int copyText(const char *from, char *text) {
+  int length = (int)strlen(from);
+  memcpy(text, from, length + 1);
+  return length;
+}
+
+int formatInt(int64_t integer, char *text) {
+  // the magnitude as unsigned, which holds that of INT64_MIN.
+  uint64_t magnitude = integer < 0 ? -(uint64_t)integer : (uint64_t)integer;
+  char reversed[20];
+  int count = 0;
+  do {
+    reversed[count++] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+
+  char *at = text;
+  if (integer < 0) *at++ = '-';
+  while (count > 0) *at++ = reversed[--count];
+  *at = '\0';
+  return (int)(at - text);
+}
+
+// like repr in python: positional unless the exponent is below -4 or above
+// 15, and whole doubles without a fraction.
+int formatDouble(double number, char *text) {
+  if (isnan(number)) return copyText("nan", text);
+  if (isinf(number)) return copyText(number < 0 ? "-inf" : "inf", text);
+
+  char *at = text;
+  if (signbit(number)) {
+    *at++ = '-';
+    number = -number;
+  }
+  if (number == 0) {
+    *at++ = '0';
+    *at = '\0';
+    return (int)(at - text);
+  }
+
+  char digits[20];
+  int length, k;
+  if (!grisu3(number, digits, &length, &k)) {
+    length = exactDigits(number, digits, &k);
+  }
+  int exponent = length + k - 1;  // of the first digit.
+
+  if (exponent < -4 || exponent > 15) {
+    *at++ = digits[0];
+    if (length > 1) {
+      *at++ = '.';
+      memcpy(at, digits + 1, length - 1);
+      at += length - 1;
+    }
+    *at++ = 'e';
+    *at++ = exponent < 0 ? '-' : '+';
+    if (exponent < 0) exponent = -exponent;
+    if (exponent < 10) *at++ = '0';
+    at += formatInt(exponent, at);
+  } else if (exponent < 0) {
+    *at++ = '0';
+    *at++ = '.';
+    for (int i = -1; i > exponent; --i) *at++ = '0';
+    memcpy(at, digits, length);
+    at += length;
+  } else if (exponent + 1 >= length) {
+    memcpy(at, digits, length);
+    at += length;
+    for (int i = length; i <= exponent; ++i) *at++ = '0';
+  } else {
+    memcpy(at, digits, exponent + 1);
+    at += exponent + 1;
+    *at++ = '.';
+    memcpy(at, digits + exponent + 1, length - exponent - 1);
+    at += length - exponent - 1;
+  }
+
+  *at = '\0';
+  return (int)(at - text);
+}
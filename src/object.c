@@ -1,9 +1,9 @@
-#include <stdio.h>
 #include <string.h>
 
 #include "chunk.h"
 #include "memory.h"
 #include "object.h"
+#include "output.h"
 #include "table.h"
 #include "vm.h"
 
@@ -13,6 +13,8 @@
 static Obj *allocateObj(size_t size, ObjType type) {
   Obj *object = (Obj *)reallocate(NULL, 0, size);
   object->type = type;
+  object->next = vm->objects;
+  vm->objects = object;
   return object;
 }
 
@@ -20,6 +22,9 @@ ObjString *newString(const int length) {
   ObjString *string =
       (ObjString *)allocateObj(sizeof(*string) + length + 1, OBJ_STRING);
   string->length = length;
+  string->hashed = false;
+  string->interned = false;
+  string->chars[length] = '\0';
 
   return string;
 }
@@ -38,40 +43,56 @@ uint32_t hashString(const char *key, const int length) {
 
 ObjString *copyString(const char *chars, int length) {
   uint32_t hash = hashString(chars, length);
-  ObjString *string = tableFindString(&vm.strings, chars, length, hash);
+  ObjString *string = tableFindString(&vm->strings, chars, length, hash);
   if (string) return string;
 
   string = newString(length);
   memcpy(string->chars, chars, length);
-  string->chars[length] = '\0';
   string->hash = hash;
+  string->hashed = true;
+  string->interned = true;
 
-  tableSet(&vm.strings, string, NIL_VAL);
+  tableSet(&vm->strings, string, NIL_VAL);
 
   return string;
 }
 
-ObjString *stringConcat(ObjString *a, ObjString *b) {
-  int length = a->length + b->length;
-
+ObjString *makeString(const char *chars, int length) {
   ObjString *string = newString(length);
+  memcpy(string->chars, chars, length);
+  return string;
+}
+
+ObjString *findInterned(ObjString *string) {
+  if (string->interned) return string;
+  return tableFindString(&vm->strings, string->chars, string->length,
+                         stringHash(string));
+}
+
+ObjString *internString(ObjString *string) {
+  ObjString *interned = findInterned(string);
+  if (interned) return interned;
+
+  string->interned = true;
+  tableSet(&vm->strings, string, NIL_VAL);
+
+  return string;
+}
+
+ObjString *stringConcat(ObjString *a, ObjString *b) {
+  ObjString *string = newString(a->length + b->length);
   memcpy(string->chars, a->chars, a->length);
   memcpy(string->chars + a->length, b->chars, b->length);
-  string->chars[length] = '\0';
+  if (string->length > CLOX_INTERN_MAX) return string;
 
-  uint32_t hash = hashString(string->chars, length);
-  ObjString *internal =
-      tableFindString(&vm.strings, string->chars, length, hash);
-  if (internal) {
+  ObjString *interned = internString(string);
+  if (interned != string) {
+    // the new string is the most recently allocated object.
+    vm->objects = string->obj.next;
     FREE(string, ObjString);
-    return internal;
   }
 
-  string->length = length;
-  string->hash = hash;
-  tableSet(&vm.strings, string, NIL_VAL);
-
-  return string;
+  return interned;
 }
 
 ObjFunction *newFunction() {
@@ -80,9 +101,23 @@ ObjFunction *newFunction() {
   function->arity = 0;
   function->upvalue_count = 0;
   function->name = NULL;
+  function->program = NULL;
+  function->tier = TIER_STACK;
+  function->hotness = 0;
+  function->registers = NULL;
+  function->jit = NULL;
+  function->caches = NULL;
+  function->cache_count = 0;
   return function;
 }
 
+void allocateCaches(ObjFunction *function) {
+  if (function->cache_count == 0) return;
+
+  function->caches = ALLOCATE(PropertyCache, function->cache_count);
+  memset(function->caches, 0, sizeof(PropertyCache) * function->cache_count);
+}
+
 ObjClosure *newClosure(ObjFunction *function) {
   ObjClosure *closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
   closure->function = function;
@@ -92,15 +127,221 @@ ObjClosure *newClosure(ObjFunction *function) {
   }
   closure->upvalues = upvalues;
   closure->upvalue_count = function->upvalue_count;
+  closure->copies = NULL;
   return closure;
 }
 
-ObjNativeFn *newNativeFn(NativeFn function) {
+ObjNativeFn *newNativeFn(NativeFn function, int arity, uint8_t flags) {
   ObjNativeFn *nativeFn = ALLOCATE_OBJ(ObjNativeFn, OBJ_NATIVE_FN);
   nativeFn->function = function;
+  nativeFn->host = NULL;
+  nativeFn->arity = arity;
+  nativeFn->flags = flags;
   return nativeFn;
 }
 
+ObjBuffer *newBuffer(int length) {
+  ObjBuffer *buffer = ALLOCATE_OBJ(ObjBuffer, OBJ_BUFFER);
+  buffer->length = length;
+  buffer->bytes = ALLOCATE(uint8_t, length);
+  buffer->is_external = false;
+  return buffer;
+}
+
+ObjBuffer *wrapBuffer(uint8_t *bytes, int length) {
+  ObjBuffer *buffer = ALLOCATE_OBJ(ObjBuffer, OBJ_BUFFER);
+  buffer->length = length;
+  buffer->bytes = bytes;
+  buffer->is_external = true;
+  return buffer;
+}
+
+ObjArray *newArray(ArrayKind kind, int length) {
+  ObjArray *array = ALLOCATE_OBJ(ObjArray, OBJ_ARRAY);
+  size_t size = arrayElementSize(kind) * length;
+  array->kind = kind;
+  array->length = length;
+  array->elements.uint8 = ALLOCATE(uint8_t, size);
+  if (size > 0) memset(array->elements.uint8, 0, size);
+  return array;
+}
+
+const char *arrayKindName(ArrayKind kind) {
+  switch (kind) {
+    case ARRAY_FLOAT64:
+      return "float64";
+    case ARRAY_INT32:
+      return "int32";
+    case ARRAY_UINT8:
+      return "uint8";
+  }
+
+  return NULL;  // unreachable.
+}
+
+size_t arrayElementSize(ArrayKind kind) {
+  switch (kind) {
+    case ARRAY_FLOAT64:
+      return sizeof(double);
+    case ARRAY_INT32:
+      return sizeof(int32_t);
+    case ARRAY_UINT8:
+      return sizeof(uint8_t);
+  }
+
+  return 0;  // unreachable.
+}
+
+// int elements take ints and whole doubles within their range.
+static bool wholeNumberIn(Value value, int64_t min, int64_t max,
+                          int64_t *number) {
+  if (IS_INT(value)) {
+    *number = AS_INT(value);
+  } else if (IS_NUMBER(value) && AS_NUMBER(value) >= min &&
+             AS_NUMBER(value) <= max &&
+             AS_NUMBER(value) == (int64_t)AS_NUMBER(value)) {
+    *number = (int64_t)AS_NUMBER(value);
+  } else {
+    return false;
+  }
+  return *number >= min && *number <= max;
+}
+
+bool arrayStore(ObjArray *array, int index, Value value) {
+  int64_t number;
+  switch (array->kind) {
+    case ARRAY_FLOAT64:
+      if (!IS_NUMERIC(value)) return false;
+      array->elements.float64[index] = AS_DOUBLE(value);
+      return true;
+    case ARRAY_INT32:
+      if (!wholeNumberIn(value, INT32_MIN, INT32_MAX, &number)) return false;
+      array->elements.int32[index] = (int32_t)number;
+      return true;
+    case ARRAY_UINT8:
+      if (!wholeNumberIn(value, 0, UINT8_MAX, &number)) return false;
+      array->elements.uint8[index] = (uint8_t)number;
+      return true;
+  }
+
+  return false;  // unreachable.
+}
+
+ObjStringBuilder *newStringBuilder() {
+  ObjStringBuilder *builder =
+      ALLOCATE_OBJ(ObjStringBuilder, OBJ_STRING_BUILDER);
+  builder->length = 0;
+  builder->capacity = 0;
+  builder->chars = NULL;
+  return builder;
+}
+
+void appendChars(ObjStringBuilder *builder, const char *chars, int length) {
+  if (builder->capacity < builder->length + length) {
+    int capacity = builder->capacity;
+    while (capacity < builder->length + length) {
+      capacity = GROW_CAPACITY(capacity);
+    }
+    builder->chars =
+        GROW_ARRAY(builder->chars, char, builder->capacity, capacity);
+    builder->capacity = capacity;
+  }
+
+  memcpy(builder->chars + builder->length, chars, length);
+  builder->length += length;
+}
+
+ObjFile *newFile(int fd) {
+  ObjFile *file = ALLOCATE_OBJ(ObjFile, OBJ_FILE);
+  file->fd = fd;
+  file->mapped = false;
+  file->at_end = false;
+  file->block = NULL;
+  file->capacity = 0;
+  file->start = 0;
+  file->end = 0;
+  return file;
+}
+
+ObjList *newList() {
+  ObjList *list = ALLOCATE_OBJ(ObjList, OBJ_LIST);
+  initValueArray(&list->items);
+  return list;
+}
+
+ObjMap *newMap() {
+  ObjMap *map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+  initTable(&map->table);
+  return map;
+}
+
+static ObjShape *newShape(ObjShape *parent, ObjString *name,
+                          ObjClass *klass) {
+  ObjShape *shape = ALLOCATE_OBJ(ObjShape, OBJ_SHAPE);
+  shape->parent = parent;
+  shape->name = name;
+  shape->slot_count = parent ? parent->slot_count + 1 : 0;
+  shape->klass = klass;
+  initTable(&shape->transitions);
+  return shape;
+}
+
+ObjClass *newClass(ObjString *name) {
+  ObjClass *klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
+  klass->name = name;
+  initTable(&klass->methods);
+  klass->shape = newShape(NULL, NULL, klass);
+  klass->field_count = 0;
+  return klass;
+}
+
+ObjInstance *newInstance(ObjClass *klass) {
+  ObjInstance *instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
+  instance->shape = klass->shape;
+  instance->fields = NULL;
+  instance->field_capacity = 0;
+  if (klass->field_count > 0) growFields(instance, klass->field_count);
+  return instance;
+}
+
+ObjBoundMethod *newBoundMethod(Value receiver, ObjClosure *method) {
+  ObjBoundMethod *bound = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
+  bound->receiver = receiver;
+  bound->method = method;
+  return bound;
+}
+
+int shapeSlot(ObjShape *shape, ObjString *name) {
+  for (; shape->name; shape = shape->parent) {
+    if (shape->name == name) return shape->slot_count - 1;
+  }
+  return -1;
+}
+
+ObjShape *shapeTransition(ObjShape *shape, ObjString *name) {
+  Value next;
+  if (tableGet(&shape->transitions, name, &next)) {
+    return (ObjShape *)AS_OBJ(next);
+  }
+
+  ObjShape *child = newShape(shape, name, shape->klass);
+  tableSet(&shape->transitions, name, OBJ_VAL(child));
+  return child;
+}
+
+void growFields(ObjInstance *instance, int count) {
+  if (count <= instance->field_capacity) return;
+
+  int capacity = GROW_CAPACITY(instance->field_capacity);
+  if (capacity < count) capacity = count;
+  instance->fields =
+      GROW_ARRAY(instance->fields, Value, instance->field_capacity, capacity);
+  instance->field_capacity = capacity;
+
+  ObjClass *klass = instance->shape->klass;
+  if (klass->field_count < count) klass->field_count = count;
+}
+
 ObjUpvalue *newUpvalue(Value *slot) {
   ObjUpvalue *upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
   upvalue->location = slot;
@@ -108,42 +349,164 @@ ObjUpvalue *newUpvalue(Value *slot) {
   return upvalue;
 }
 
-void printFunction(ObjFunction *function) {
+static void writeFunction(ObjFunction *function) {
   if (function->name == NULL) {
-    printf("<script>");
+    writeText("<script>");
+    return;
+  }
+  writeText("<fn ");
+  writeChars(function->name->chars, function->name->length);
+  writeText(">");
+}
+
+// the lists and maps being printed, innermost first, so that one holding
+// itself prints as [...] or {...} instead of recursing forever.
+typedef struct Printing {
+  Obj *object;
+  struct Printing *outer;
+} Printing;
+
+static CLOX_THREAD_LOCAL Printing *printing = NULL;
+
+static bool isPrinting(Obj *object) {
+  for (Printing *p = printing; p; p = p->outer) {
+    if (p->object == object) return true;
+  }
+  return false;
+}
+
+static void writeList(ObjList *list) {
+  if (isPrinting(&list->obj)) {
+    writeText("[...]");
+    return;
+  }
+
+  Printing self = {&list->obj, printing};
+  printing = &self;
+  writeText("[");
+  for (int i = 0; i < list->items.size; ++i) {
+    if (i > 0) writeText(", ");
+    writeValue(list->items.values[i]);
+  }
+  writeText("]");
+  printing = self.outer;
+}
+
+static void writeMap(ObjMap *map) {
+  if (isPrinting(&map->obj)) {
+    writeText("{...}");
     return;
   }
-  printf("<fn %s>", function->name->chars);
+
+  Printing self = {&map->obj, printing};
+  printing = &self;
+  writeText("{");
+  bool first = true;
+  for (int i = 0; i < map->table.size; ++i) {
+    Entry *entry = &map->table.entries[i];
+    if (IS_NIL(entry->key)) continue;
+
+    if (!first) writeText(", ");
+    first = false;
+    writeValue(entry->key);
+    writeText(": ");
+    writeValue(entry->value);
+  }
+  writeText("}");
+  printing = self.outer;
 }
 
-void printObject(Value value) {
+// the text of objects shown by their size, like <buffer 3>.
+static void writeSized(const char *kind, int size) {
+  writeText("<");
+  writeText(kind);
+  writeText(" ");
+  writeNumber(INT_VAL(size));
+  writeText(">");
+}
+
+void writeObject(Value value) {
   switch (OBJ_TYPE(value)) {
     case OBJ_STRING:
-      printf("%s", AS_CSTRING(value));
+      writeChars(AS_CSTRING(value), AS_STRING(value)->length);
       break;
     case OBJ_FUNCTION:
-      printFunction(AS_FUNCTION(value));
+      writeFunction(AS_FUNCTION(value));
       break;
     case OBJ_CLOSURE:
-      printFunction(AS_CLOSURE(value)->function);
+      writeFunction(AS_CLOSURE(value)->function);
       break;
     case OBJ_NATIVE_FN:
-      printf("<native fn>");
+      writeText("<native fn>");
       break;
     case OBJ_UPVALUE:
-      printf("upvalue");
+      writeText("upvalue");
+      break;
+    case OBJ_BUFFER:
+      writeSized("buffer", AS_BUFFER(value)->length);
+      break;
+    case OBJ_STRING_BUILDER:
+      writeSized("string builder", AS_STRING_BUILDER(value)->length);
+      break;
+    case OBJ_ARRAY:
+      writeText("<");
+      writeText(arrayKindName(AS_ARRAY(value)->kind));
+      writeText(" array ");
+      writeNumber(INT_VAL(AS_ARRAY(value)->length));
+      writeText(">");
+      break;
+    case OBJ_FILE:
+      writeText("<file>");
+      break;
+    case OBJ_LIST:
+      writeList(AS_LIST(value));
+      break;
+    case OBJ_MAP:
+      writeMap(AS_MAP(value));
+      break;
+    case OBJ_CLASS:
+      writeText("<class ");
+      writeText(AS_CLASS(value)->name->chars);
+      writeText(">");
+      break;
+    case OBJ_INSTANCE:
+      writeText("<");
+      writeText(AS_INSTANCE(value)->shape->klass->name->chars);
+      writeText(" instance>");
+      break;
+    case OBJ_BOUND_METHOD:
+      writeFunction(AS_BOUND_METHOD(value)->method->function);
+      break;
+    case OBJ_SHAPE:
+      writeText("<shape>");
+      break;
   }
 }
 
+// for strings that are not the same object. interned ones then differ, and
+// hashes already computed rule most others out before comparing characters.
+static bool stringsEqual(ObjString *a, ObjString *b) {
+  if (a->interned && b->interned) return false;
+  if (a->length != b->length) return false;
+  if (a->hashed && b->hashed && a->hash != b->hash) return false;
+  return !memcmp(a->chars, b->chars, a->length);
+}
+
 bool objectsEqual(Value a, Value b) {
   if (OBJ_TYPE(a) != OBJ_TYPE(b)) return false;
 
   switch (OBJ_TYPE(a)) {
-    case OBJ_STRING: {
-      // string interning guarantees string objects with the same
-      // address are equal.
+    case OBJ_STRING:
+      return AS_OBJ(a) == AS_OBJ(b) ||
+             stringsEqual(AS_STRING(a), AS_STRING(b));
+    case OBJ_ARRAY:
+    case OBJ_STRING_BUILDER:
+    case OBJ_FILE:
+    case OBJ_LIST:
+    case OBJ_MAP:
+    case OBJ_CLASS:
+    case OBJ_INSTANCE:
       return AS_OBJ(a) == AS_OBJ(b);
-    }
     default:
       return false;
   }
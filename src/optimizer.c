@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "optimizer.h"
+
+typedef struct {
+  // jumps are normalized to their short forward opcode, and OP_LOOP to
+  // OP_JUMP. the encoder picks the direction and the long form again.
+  uint8_t op;
+  bool live;
+  int offset;  // in the original code.
+  int length;  // of the short form of jumps.
+  int line;
+  int target;  // index of the instruction a jump goes to.
+} Instr;
+
+typedef struct {
+  int count;
+  Instr *instrs;
+  int *targeted;  // number of live jumps to each instruction.
+} Code;
+
+static uint8_t normalizeOp(uint8_t op) {
+  switch (op) {
+    case OP_LOOP:
+    case OP_JUMP_LONG:
+    case OP_LOOP_LONG:
+      return OP_JUMP;
+    case OP_JUMP_IF_FALSE_LONG:
+      return OP_JUMP_IF_FALSE;
+    case OP_JUMP_IF_TRUE_LONG:
+      return OP_JUMP_IF_TRUE;
+    case OP_LOCAL_LESS_CONST_JUMP_LONG:
+      return OP_LOCAL_LESS_CONST_JUMP;
+    default:
+      return op;
+  }
+}
+
+static bool isJump(uint8_t op) {
+  return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE ||
+         op == OP_LOCAL_LESS_CONST_JUMP;
+}
+
+// conditional jumps that test the value on top of the stack.
+static bool isBranch(uint8_t op) {
+  return op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE;
+}
+
+static void decode(Chunk *chunk, Code *code) {
+  code->count = 0;
+  for (int offset = 0; offset < chunk->size;) {
+    offset += instructionLength(chunk, offset);
+    ++code->count;
+  }
+
+  code->instrs = ALLOCATE(Instr, code->count);
+  code->targeted = ALLOCATE(int, code->count);
+  int *index_of = ALLOCATE(int, chunk->size);
+
+  for (int i = 0, offset = 0; i < code->count; ++i) {
+    Instr *instr = &code->instrs[i];
+    instr->op = normalizeOp(chunk->code[offset]);
+    instr->live = true;
+    instr->offset = offset;
+    instr->length = instructionLength(chunk, offset);
+    instr->line = chunk->lines[offset];
+    instr->target = -1;
+    index_of[offset] = i;
+    offset += instr->length;
+    if (isJump(instr->op) && longJumpOp(chunk->code[instr->offset]) ==
+                                 chunk->code[instr->offset]) {
+      instr->length -= 2;
+    }
+  }
+
+  for (int i = 0; i < code->count; ++i) {
+    Instr *instr = &code->instrs[i];
+    if (!isJump(instr->op)) continue;
+
+    instr->target = index_of[jumpTarget(chunk, instr->offset)];
+  }
+
+  FREE_ARRAY(index_of, int, chunk->size);
+}
+
+static int nextLive(Code *code, int i) {
+  while (i < code->count && !code->instrs[i].live) ++i;
+  return i;
+}
+
+static void countTargets(Code *code) {
+  memset(code->targeted, 0, sizeof(int) * code->count);
+  for (int i = 0; i < code->count; ++i) {
+    Instr *instr = &code->instrs[i];
+    if (!instr->live || !isJump(instr->op)) continue;
+
+    instr->target = nextLive(code, instr->target);
+    if (instr->target < code->count) ++code->targeted[instr->target];
+  }
+}
+
+static bool removeUnreachable(Code *code) {
+  bool *reached = ALLOCATE(bool, code->count);
+  int *work = ALLOCATE(int, code->count);
+  memset(reached, 0, sizeof(bool) * code->count);
+
+  int work_count = 0;
+  int entry = nextLive(code, 0);
+  if (entry < code->count) {
+    reached[entry] = true;
+    work[work_count++] = entry;
+  }
+
+  while (work_count > 0) {
+    int i = work[--work_count];
+    Instr *instr = &code->instrs[i];
+    int successors[2];
+    int successor_count = 0;
+
+    if (isJump(instr->op)) {
+      successors[successor_count++] = nextLive(code, instr->target);
+    }
+    if (instr->op != OP_JUMP && instr->op != OP_RETURN) {
+      successors[successor_count++] = nextLive(code, i + 1);
+    }
+
+    for (int s = 0; s < successor_count; ++s) {
+      int next = successors[s];
+      if (next == code->count || reached[next]) continue;
+      reached[next] = true;
+      work[work_count++] = next;
+    }
+  }
+
+  bool changed = false;
+  for (int i = 0; i < code->count; ++i) {
+    if (code->instrs[i].live && !reached[i]) {
+      code->instrs[i].live = false;
+      changed = true;
+    }
+  }
+
+  FREE_ARRAY(work, int, code->count);
+  FREE_ARRAY(reached, bool, code->count);
+  return changed;
+}
+
+static bool threadJumps(Code *code) {
+  bool changed = false;
+
+  for (int i = 0; i < code->count; ++i) {
+    Instr *instr = &code->instrs[i];
+    if (!instr->live || !isJump(instr->op)) continue;
+
+    int target = nextLive(code, instr->target);
+    // the hop limit stops on jump cycles such as an empty endless loop.
+    for (int hops = 0; hops < code->count && target < code->count; ++hops) {
+      Instr *next = &code->instrs[target];
+      int followed;
+      if (next->op == OP_JUMP ||
+          (isBranch(instr->op) && next->op == instr->op)) {
+        // conditional jumps do not pop, so the same test gives the same
+        // answer at the target.
+        followed = next->target;
+      } else if (isBranch(instr->op) && isBranch(next->op)) {
+        followed = target + 1;
+      } else {
+        break;
+      }
+
+      followed = nextLive(code, followed);
+      if (instr->op != OP_JUMP && followed <= i) break;
+      if (followed == target) break;
+      target = followed;
+    }
+
+    if (target != instr->target) changed = true;
+    instr->target = target;
+  }
+
+  return changed;
+}
+
+static bool isPure(uint8_t op) {
+  switch (op) {
+    case OP_CONSTANT:
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_GET_LOCAL:
+    case OP_GET_UPVALUE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool rewritePatterns(Code *code) {
+  bool changed = false;
+  countTargets(code);
+
+  for (int i = nextLive(code, 0); i < code->count;) {
+    Instr *instr = &code->instrs[i];
+    int j = nextLive(code, i + 1);
+    Instr *next = j < code->count ? &code->instrs[j] : NULL;
+
+    if ((instr->op == OP_JUMP || isBranch(instr->op)) &&
+        instr->target == j) {
+      // jumps to the next instruction, including conditional ones since
+      // they leave the condition on the stack.
+      instr->live = false;
+      --code->targeted[j];
+      changed = true;
+    } else if (instr->op == OP_JUMP_IF_FALSE && next && next->op == OP_JUMP &&
+               code->targeted[j] == 0 && next->target > j &&
+               instr->target == nextLive(code, j + 1)) {
+      // a conditional jump over a forward jump, as emitted for 'or'.
+      instr->live = false;
+      next->op = OP_JUMP_IF_TRUE;
+      changed = true;
+    } else if (isPure(instr->op) && next && next->op == OP_POP &&
+               code->targeted[j] == 0) {
+      instr->live = false;
+      next->live = false;
+      changed = true;
+    } else if (instr->op == OP_NOT && next && isBranch(next->op) &&
+               code->targeted[j] == 0) {
+      // both ways out must discard the condition for the negation to be
+      // dropped.
+      int fall = nextLive(code, j + 1);
+      int target = next->target;
+      if (fall < code->count && code->instrs[fall].op == OP_POP &&
+          target < code->count && code->instrs[target].op == OP_POP) {
+        instr->live = false;
+        next->op = next->op == OP_JUMP_IF_FALSE ? OP_JUMP_IF_TRUE
+                                                 : OP_JUMP_IF_FALSE;
+        changed = true;
+      }
+    }
+
+    i = nextLive(code, i + 1);
+  }
+
+  return changed;
+}
+
+// the distance from the end of a jump at offset of length bytes to target.
+static int jumpDistance(int offset, int length, int target) {
+  return abs(target - (offset + length));
+}
+
+static bool encode(Chunk *chunk, Code *code) {
+  int *offsets = ALLOCATE(int, code->count);
+  bool *wide = ALLOCATE(bool, code->count);
+  memset(wide, 0, sizeof(bool) * code->count);
+
+  // a jump in its long form moves the code after it, which can push other
+  // jumps out of reach of 16 bits.
+  int size;
+  bool grew;
+  do {
+    size = 0;
+    for (int i = 0; i < code->count; ++i) {
+      offsets[i] = size;
+      Instr *instr = &code->instrs[i];
+      if (instr->live) size += instr->length + (wide[i] ? 2 : 0);
+    }
+
+    grew = false;
+    for (int i = 0; i < code->count; ++i) {
+      Instr *instr = &code->instrs[i];
+      if (!instr->live || !isJump(instr->op) || wide[i]) continue;
+
+      int target = nextLive(code, instr->target);
+      if (target < code->count &&
+          jumpDistance(offsets[i], instr->length, offsets[target]) >
+              UINT16_MAX) {
+        wide[i] = true;
+        grew = true;
+      }
+    }
+  } while (grew);
+
+  uint8_t *bytes = ALLOCATE(uint8_t, size);
+  int *lines = ALLOCATE(int, size);
+  bool encoded = true;
+
+  for (int i = 0; i < code->count && encoded; ++i) {
+    Instr *instr = &code->instrs[i];
+    if (!instr->live) continue;
+
+    int at = offsets[i];
+    int length = instr->length + (wide[i] ? 2 : 0);
+    for (int b = 0; b < length; ++b) lines[at + b] = instr->line;
+
+    if (!isJump(instr->op)) {
+      memcpy(&bytes[at], &chunk->code[instr->offset], length);
+      continue;
+    }
+
+    int target = nextLive(code, instr->target);
+    if (target == code->count) {
+      encoded = false;
+      break;
+    }
+
+    // the operands before the distance stay as they were.
+    memcpy(&bytes[at], &chunk->code[instr->offset], instr->length - 2);
+    uint8_t op = instr->op;
+    if (offsets[target] < at + length) {
+      if (op != OP_JUMP) {
+        encoded = false;
+        break;
+      }
+      op = OP_LOOP;
+    }
+
+    bytes[at] = wide[i] ? longJumpOp(op) : op;
+    storeJumpDistance(&bytes[at + length], wide[i],
+                      jumpDistance(at, length, offsets[target]));
+  }
+
+  FREE_ARRAY(offsets, int, code->count);
+  FREE_ARRAY(wide, bool, code->count);
+  if (!encoded) {
+    FREE_ARRAY(bytes, uint8_t, size);
+    FREE_ARRAY(lines, int, size);
+    return false;
+  }
+
+  FREE_ARRAY(chunk->code, uint8_t, chunk->capacity);
+  FREE_ARRAY(chunk->lines, int, chunk->capacity);
+  chunk->code = bytes;
+  chunk->lines = lines;
+  chunk->size = size;
+  chunk->capacity = size;
+  return true;
+}
+
+void optimizeChunk(Chunk *chunk) {
+  Code code;
+  decode(chunk, &code);
+
+  // a few passes reach a fixed point on any code the compiler emits; the
+  // bound only guards against jump cycles that keep re-threading.
+  bool changed = removeUnreachable(&code);
+  bool again = true;
+  for (int pass = 0; again && pass < 8; ++pass) {
+    again = threadJumps(&code);
+    again |= rewritePatterns(&code);
+    again |= removeUnreachable(&code);
+    changed |= again;
+  }
+
+  if (changed) encode(chunk, &code);
+
+  FREE_ARRAY(code.targeted, int, code.count);
+  FREE_ARRAY(code.instrs, Instr, code.count);
+}
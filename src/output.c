@@ -0,0 +1,69 @@
+// fileno and isatty are not part of c99.
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "vm.h"
+
+void initOutput(Output *output) {
+  output->length = 0;
+  output->line_buffered = isatty(fileno(stdout));
+}
+
+void flushOutput() {
+  Output *output = &vm->output;
+  if (output->length > 0) {
+    fwrite(output->bytes, 1, output->length, stdout);
+    output->length = 0;
+  }
+  fflush(stdout);
+}
+
+void writeChars(const char *chars, int length) {
+  Output *output = &vm->output;
+  if (output->length + length > CLOX_OUTPUT_SIZE) {
+    flushOutput();
+    // too long to be worth copying.
+    if (length > CLOX_OUTPUT_SIZE / 2) {
+      fwrite(chars, 1, length, stdout);
+      return;
+    }
+  }
+
+  memcpy(output->bytes + output->length, chars, length);
+  output->length += length;
+}
+
+void writeText(const char *text) { writeChars(text, (int)strlen(text)); }
+
+void writeNumber(Value number) {
+  Output *output = &vm->output;
+  if (output->length + NUMBER_TEXT_MAX > CLOX_OUTPUT_SIZE) flushOutput();
+  output->length += formatNumber(number, output->bytes + output->length);
+}
+
+void writeValue(Value value) {
+  switch (value.type) {
+    case VAL_BOOL:
+      writeText(AS_BOOL(value) ? "true" : "false");
+      break;
+    case VAL_NIL:
+      writeText("nil");
+      break;
+    case VAL_NUMBER:
+    case VAL_INT:
+      writeNumber(value);
+      break;
+    case VAL_OBJ:
+      writeObject(value);
+      break;
+  }
+}
+
+void writeLine() {
+  writeChars("\n", 1);
+  if (vm->output.line_buffered) flushOutput();
+}
@@ -0,0 +1,175 @@
+#include <string.h>
+
+#include "compiler.h"
+#include "memory.h"
+#include "program.h"
+#include "vm.h"
+
+static char *copyChars(const char *chars, int length) {
+  char *copy = ALLOCATE(char, length + 1);
+  memcpy(copy, chars, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+static int freezeFunction(Program *program, ObjFunction *function) {
+  if (program->function_capacity < program->function_count + 1) {
+    int old_capacity = program->function_capacity;
+    program->function_capacity = GROW_CAPACITY(old_capacity);
+    program->functions =
+        GROW_ARRAY(program->functions, FunctionProto, old_capacity,
+                   program->function_capacity);
+  }
+  int index = program->function_count++;
+
+  Chunk *chunk = &function->chunk;
+  int literal_count = chunk->constants.size;
+  Literal *literals = ALLOCATE(Literal, literal_count);
+  for (int i = 0; i < literal_count; ++i) {
+    Value value = chunk->constants.values[i];
+    Literal *literal = &literals[i];
+
+    if (IS_NUMBER(value)) {
+      literal->type = LITERAL_NUMBER;
+      literal->as.number = AS_NUMBER(value);
+    } else if (IS_INT(value)) {
+      literal->type = LITERAL_INT;
+      literal->as.integer = AS_INT(value);
+    } else if (IS_STRING(value)) {
+      ObjString *string = AS_STRING(value);
+      literal->type = LITERAL_STRING;
+      literal->as.string.length = string->length;
+      literal->as.string.chars = copyChars(string->chars, string->length);
+    } else {
+      literal->type = LITERAL_FUNCTION;
+      literal->as.function = freezeFunction(program, AS_FUNCTION(value));
+    }
+  }
+
+  // nested functions may have grown the array, so only take the address now.
+  FunctionProto *proto = &program->functions[index];
+  proto->arity = function->arity;
+  proto->upvalue_count = function->upvalue_count;
+  proto->name = NULL;
+  proto->name_length = 0;
+  if (function->name) {
+    proto->name = copyChars(function->name->chars, function->name->length);
+    proto->name_length = function->name->length;
+  }
+
+  proto->size = chunk->size;
+  proto->code = ALLOCATE(uint8_t, chunk->size);
+  memcpy(proto->code, chunk->code, chunk->size);
+  proto->lines = ALLOCATE(int, chunk->size);
+  memcpy(proto->lines, chunk->lines, sizeof(int) * chunk->size);
+  proto->literal_count = literal_count;
+  proto->literals = literals;
+  proto->cache_count = function->cache_count;
+
+  return index;
+}
+
+Program *compileProgram(const char *source) {
+  // compile in a scratch vm so the program holds no objects of the caller.
+  VM *caller = vm;
+  VM *scratch = newVM();
+
+  Program *program = NULL;
+  ObjFunction *script = compile(source);
+  if (script) {
+    program = ALLOCATE(Program, 1);
+    program->ref_count = 1;
+    program->function_count = 0;
+    program->function_capacity = 0;
+    program->functions = NULL;
+    freezeFunction(program, script);
+  }
+
+  freeVM(scratch);
+  switchVM(caller);
+  return program;
+}
+
+Program *retainProgram(Program *program) {
+  __atomic_add_fetch(&program->ref_count, 1, __ATOMIC_RELAXED);
+  return program;
+}
+
+static void freeProto(FunctionProto *proto) {
+  for (int i = 0; i < proto->literal_count; ++i) {
+    Literal *literal = &proto->literals[i];
+    if (literal->type == LITERAL_STRING) {
+      FREE_ARRAY(literal->as.string.chars, char,
+                 literal->as.string.length + 1);
+    }
+  }
+  FREE_ARRAY(proto->literals, Literal, proto->literal_count);
+  FREE_ARRAY(proto->code, uint8_t, proto->size);
+  FREE_ARRAY(proto->lines, int, proto->size);
+  if (proto->name) FREE_ARRAY(proto->name, char, proto->name_length + 1);
+}
+
+void releaseProgram(Program *program) {
+  if (__atomic_sub_fetch(&program->ref_count, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+  for (int i = 0; i < program->function_count; ++i) {
+    freeProto(&program->functions[i]);
+  }
+  FREE_ARRAY(program->functions, FunctionProto, program->function_capacity);
+  FREE(program, Program);
+}
+
+static Value literalValue(Literal *literal, ObjFunction **functions) {
+  switch (literal->type) {
+    case LITERAL_NUMBER:
+      return NUMBER_VAL(literal->as.number);
+    case LITERAL_INT:
+      return INT_VAL(literal->as.integer);
+    case LITERAL_STRING:
+      return OBJ_VAL(
+          copyString(literal->as.string.chars, literal->as.string.length));
+    case LITERAL_FUNCTION:
+      return OBJ_VAL(functions[literal->as.function]);
+  }
+
+  return NIL_VAL;  // unreachable.
+}
+
+ObjFunction *loadProgram(Program *program) {
+  ObjFunction **functions = ALLOCATE(ObjFunction *, program->function_count);
+
+  // functions refer to each other through their constants, so create all of
+  // them before materializing any constant.
+  for (int i = 0; i < program->function_count; ++i) {
+    FunctionProto *proto = &program->functions[i];
+    ObjFunction *function = newFunction();
+    function->arity = proto->arity;
+    function->upvalue_count = proto->upvalue_count;
+    if (proto->name) {
+      function->name = copyString(proto->name, proto->name_length);
+    }
+
+    function->chunk.size = proto->size;
+    function->chunk.code = proto->code;
+    function->chunk.lines = proto->lines;
+    function->program = retainProgram(program);
+    function->cache_count = proto->cache_count;
+    allocateCaches(function);
+    functions[i] = function;
+  }
+
+  for (int i = 0; i < program->function_count; ++i) {
+    FunctionProto *proto = &program->functions[i];
+    for (int j = 0; j < proto->literal_count; ++j) {
+      writeValueArray(&functions[i]->chunk.constants,
+                      literalValue(&proto->literals[j], functions));
+    }
+  }
+
+  // translating needs the closures among the constants.
+  for (int i = 0; i < program->function_count; ++i) chooseTier(functions[i]);
+
+  ObjFunction *script = functions[0];
+  FREE_ARRAY(functions, ObjFunction *, program->function_count);
+  return script;
+}
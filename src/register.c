@@ -0,0 +1,702 @@
+#include "memory.h"
+#include "register.h"
+
+const RegisterOpInfo register_ops[] = {
+    [REG_MOVE] = {"REG_MOVE", "rr"},
+    [REG_CONSTANT] = {"REG_CONSTANT", "rk"},
+    [REG_NIL] = {"REG_NIL", "r"},
+    [REG_TRUE] = {"REG_TRUE", "r"},
+    [REG_FALSE] = {"REG_FALSE", "r"},
+    [REG_GET_UPVALUE] = {"REG_GET_UPVALUE", "rb"},
+    [REG_SET_UPVALUE] = {"REG_SET_UPVALUE", "br"},
+    [REG_DEF_GLOBAL] = {"REG_DEF_GLOBAL", "kr"},
+    [REG_GET_GLOBAL] = {"REG_GET_GLOBAL", "rk"},
+    [REG_SET_GLOBAL] = {"REG_SET_GLOBAL", "kr"},
+    [REG_NOT] = {"REG_NOT", "rr"},
+    [REG_NEGATE] = {"REG_NEGATE", "rr"},
+    [REG_EQUAL] = {"REG_EQUAL", "rrr"},
+    [REG_GREATER] = {"REG_GREATER", "rrr"},
+    [REG_LESS] = {"REG_LESS", "rrr"},
+    [REG_ADD] = {"REG_ADD", "rrr"},
+    [REG_SUB] = {"REG_SUB", "rrr"},
+    [REG_MUL] = {"REG_MUL", "rrr"},
+    [REG_DIV] = {"REG_DIV", "rrr"},
+    [REG_EQUAL_K] = {"REG_EQUAL_K", "rrk"},
+    [REG_GREATER_K] = {"REG_GREATER_K", "rrk"},
+    [REG_LESS_K] = {"REG_LESS_K", "rrk"},
+    [REG_ADD_K] = {"REG_ADD_K", "rrk"},
+    [REG_SUB_K] = {"REG_SUB_K", "rrk"},
+    [REG_MUL_K] = {"REG_MUL_K", "rrk"},
+    [REG_DIV_K] = {"REG_DIV_K", "rrk"},
+    [REG_JUMP] = {"REG_JUMP", "j"},
+    [REG_LOOP] = {"REG_LOOP", "l"},
+    [REG_JUMP_IF_FALSE] = {"REG_JUMP_IF_FALSE", "rj"},
+    [REG_JUMP_IF_TRUE] = {"REG_JUMP_IF_TRUE", "rj"},
+    [REG_JUMP_IF_NOT_EQUAL] = {"REG_JUMP_IF_NOT_EQUAL", "rrj"},
+    [REG_JUMP_IF_NOT_GREATER] = {"REG_JUMP_IF_NOT_GREATER", "rrj"},
+    [REG_JUMP_IF_NOT_LESS] = {"REG_JUMP_IF_NOT_LESS", "rrj"},
+    [REG_JUMP_IF_NOT_EQUAL_K] = {"REG_JUMP_IF_NOT_EQUAL_K", "rkj"},
+    [REG_JUMP_IF_NOT_GREATER_K] = {"REG_JUMP_IF_NOT_GREATER_K", "rkj"},
+    [REG_JUMP_IF_NOT_LESS_K] = {"REG_JUMP_IF_NOT_LESS_K", "rkj"},
+    [REG_CALL] = {"REG_CALL", "rb"},
+    [REG_TAIL_CALL] = {"REG_TAIL_CALL", "rb"},
+    [REG_CALL_NATIVE] = {"REG_CALL_NATIVE", "rkb"},
+    [REG_TAIL_CALL_NATIVE] = {"REG_TAIL_CALL_NATIVE", "rkb"},
+    [REG_CLOSURE] = {"REG_CLOSURE", "rk"},
+    [REG_CLOSE_UPVALUE] = {"REG_CLOSE_UPVALUE", "r"},
+    [REG_RETURN] = {"REG_RETURN", "r"},
+};
+
+static int fixedLength(uint8_t op) {
+  int length = 1;
+  for (const char *operand = register_ops[op].operands; *operand; ++operand) {
+    length += *operand == 'j' || *operand == 'l' ? 2 : 1;
+  }
+  return length;
+}
+
+int registerInstructionLength(ObjFunction *function, int offset) {
+  uint8_t *code = function->registers->code;
+  int length = fixedLength(code[offset]);
+  if (code[offset] == REG_CLOSURE) {
+    Value closure = function->chunk.constants.values[code[offset + 2]];
+    length += 2 * AS_FUNCTION(closure)->upvalue_count;
+  }
+  return length;
+}
+
+void freeRegisterCode(RegisterCode *code) {
+  FREE_ARRAY(code->code, uint8_t, code->size);
+  FREE_ARRAY(code->lines, int, code->size);
+  FREE(code, RegisterCode);
+}
+
+typedef enum {
+  OPERAND_REGISTER,
+  OPERAND_CONSTANT,
+  OPERAND_NIL,
+  OPERAND_TRUE,
+  OPERAND_FALSE,
+} OperandType;
+
+// where the value of a stack slot is until it has to be in its own register.
+// a slot only ever refers to a register below it, and a local that is
+// written to its own register stays there.
+typedef struct {
+  OperandType type;
+  uint8_t index;
+} Operand;
+
+typedef struct {
+  int op;      // offset of the jump in the register code.
+  int end;     // the distance is counted from the end of the jump.
+  int target;  // offset of the target in the stack code.
+} Fixup;
+
+typedef struct {
+  Chunk *chunk;
+  RegisterCode *out;
+  int capacity;
+  int line;
+  bool failed;
+
+  Operand slots[UINT8_COUNT];
+  int depth;
+  bool captured[UINT8_COUNT];  // registers captured by a closure.
+  bool *targets;               // stack offsets some jump goes to.
+  int *depths;                 // depth at each target, -1 until reached.
+  int *offsets;                // register offset of each stack offset.
+  int last_value;  // the instruction that wrote the top slot, or -1.
+
+  Fixup *fixups;
+  int fixup_count;
+  int fixup_capacity;
+} Translator;
+
+static const Operand home = {OPERAND_REGISTER, 0};
+
+static bool isHome(Translator *t, int slot) {
+  return t->slots[slot].type == OPERAND_REGISTER &&
+         t->slots[slot].index == slot;
+}
+
+static void setHome(Translator *t, int slot) {
+  t->slots[slot] = home;
+  t->slots[slot].index = slot;
+}
+
+static void emitByte(Translator *t, uint8_t byte) {
+  RegisterCode *out = t->out;
+  if (t->capacity < out->size + 1) {
+    int old_capacity = t->capacity;
+    t->capacity = GROW_CAPACITY(old_capacity);
+    out->code = GROW_ARRAY(out->code, uint8_t, old_capacity, t->capacity);
+    out->lines = GROW_ARRAY(out->lines, int, old_capacity, t->capacity);
+  }
+
+  out->code[out->size] = byte;
+  out->lines[out->size] = t->line;
+  ++out->size;
+}
+
+static void emitBytes(Translator *t, uint8_t byte1, uint8_t byte2) {
+  emitByte(t, byte1);
+  emitByte(t, byte2);
+}
+
+static void reachTarget(Translator *t, int target) {
+  if (t->depths[target] == -1) {
+    t->depths[target] = t->depth;
+  } else if (t->depths[target] != t->depth) {
+    t->failed = true;
+  }
+}
+
+// the jump op has been emitted at op along with its other operands.
+static void emitJumpTo(Translator *t, int op, int target) {
+  emitBytes(t, 0xff, 0xff);
+  reachTarget(t, target);
+
+  if (t->fixup_capacity < t->fixup_count + 1) {
+    int old_capacity = t->fixup_capacity;
+    t->fixup_capacity = GROW_CAPACITY(old_capacity);
+    t->fixups =
+        GROW_ARRAY(t->fixups, Fixup, old_capacity, t->fixup_capacity);
+  }
+  t->fixups[t->fixup_count++] = (Fixup){op, t->out->size, target};
+}
+
+static void emitLoad(Translator *t, uint8_t dst, Operand value) {
+  switch (value.type) {
+    case OPERAND_REGISTER:
+      if (value.index == dst) return;
+      emitBytes(t, REG_MOVE, dst);
+      emitByte(t, value.index);
+      break;
+    case OPERAND_CONSTANT:
+      emitBytes(t, REG_CONSTANT, dst);
+      emitByte(t, value.index);
+      break;
+    case OPERAND_NIL:
+      emitBytes(t, REG_NIL, dst);
+      break;
+    case OPERAND_TRUE:
+      emitBytes(t, REG_TRUE, dst);
+      break;
+    case OPERAND_FALSE:
+      emitBytes(t, REG_FALSE, dst);
+      break;
+  }
+}
+
+static void materialize(Translator *t, int slot) {
+  if (isHome(t, slot)) return;
+  emitLoad(t, slot, t->slots[slot]);
+  setHome(t, slot);
+}
+
+// returns the register holding the value of a slot.
+static uint8_t readSlot(Translator *t, int slot) {
+  if (t->slots[slot].type != OPERAND_REGISTER) materialize(t, slot);
+  return t->slots[slot].index;
+}
+
+static void flushSlots(Translator *t) {
+  for (int slot = 0; slot < t->depth; ++slot) materialize(t, slot);
+}
+
+// copies what still refers to a register before it is overwritten.
+static void flushReferences(Translator *t, int reg) {
+  for (int slot = reg + 1; slot < t->depth; ++slot) {
+    if (t->slots[slot].type == OPERAND_REGISTER &&
+        t->slots[slot].index == reg) {
+      materialize(t, slot);
+    }
+  }
+}
+
+// a callee may write captured registers through its upvalues.
+static void flushCaptured(Translator *t, int below) {
+  for (int slot = 0; slot < below; ++slot) {
+    Operand *operand = &t->slots[slot];
+    if (operand->type == OPERAND_REGISTER && operand->index != slot &&
+        t->captured[operand->index]) {
+      materialize(t, slot);
+    }
+  }
+}
+
+static bool require(Translator *t, int count) {
+  if (t->depth < count) t->failed = true;
+  return !t->failed;
+}
+
+// the last register is left free for the natives called by name, which
+// slide their arguments up by one when the global is not a native.
+static bool pushOperand(Translator *t, Operand operand) {
+  if (t->depth >= UINT8_MAX - 1) {
+    t->failed = true;
+    return false;
+  }
+  t->slots[t->depth++] = operand;
+  return true;
+}
+
+static int pushTemp(Translator *t) {
+  if (!pushOperand(t, home)) return 0;
+  setHome(t, t->depth - 1);
+  return t->depth - 1;
+}
+
+static void emitValue(Translator *t, uint8_t op, uint8_t dst) {
+  t->last_value = t->out->size;
+  emitBytes(t, op, dst);
+}
+
+static void unary(Translator *t, uint8_t op) {
+  if (!require(t, 1)) return;
+  int dst = t->depth - 1;
+  uint8_t src = readSlot(t, dst);
+  emitValue(t, op, dst);
+  emitByte(t, src);
+  setHome(t, dst);
+}
+
+static void binary(Translator *t, uint8_t op, uint8_t constant_op) {
+  if (!require(t, 2)) return;
+  int dst = t->depth - 2;
+  Operand right = t->slots[dst + 1];
+  uint8_t left = readSlot(t, dst);
+
+  if (right.type == OPERAND_CONSTANT) {
+    emitValue(t, constant_op, dst);
+    emitBytes(t, left, right.index);
+  } else {
+    uint8_t right_reg = readSlot(t, dst + 1);
+    emitValue(t, op, dst);
+    emitBytes(t, left, right_reg);
+  }
+
+  --t->depth;
+  setHome(t, dst);
+}
+
+// true when the top slot was just written by a single instruction whose
+// destination can still be changed.
+static bool isFresh(Translator *t, int last_value) {
+  return last_value != -1 &&
+         last_value + fixedLength(t->out->code[last_value]) == t->out->size &&
+         t->out->code[last_value + 1] == t->depth - 1;
+}
+
+static void setLocal(Translator *t, int last_value, uint8_t local) {
+  if (!require(t, local + 2)) return;
+  int top = t->depth - 1;
+  flushReferences(t, local);
+
+  if (isFresh(t, last_value)) {
+    // compute straight into the local instead of moving the result there.
+    t->out->code[last_value + 1] = local;
+    setHome(t, local);
+    t->slots[top] = t->slots[local];
+  } else {
+    emitLoad(t, local, t->slots[top]);
+    setHome(t, local);
+  }
+}
+
+static bool isCompare(uint8_t op) {
+  return op == REG_EQUAL || op == REG_GREATER || op == REG_LESS ||
+         op == REG_EQUAL_K || op == REG_GREATER_K || op == REG_LESS_K;
+}
+
+static uint8_t fusedCompare(uint8_t op) {
+  switch (op) {
+    case REG_EQUAL:
+      return REG_JUMP_IF_NOT_EQUAL;
+    case REG_GREATER:
+      return REG_JUMP_IF_NOT_GREATER;
+    case REG_LESS:
+      return REG_JUMP_IF_NOT_LESS;
+    case REG_EQUAL_K:
+      return REG_JUMP_IF_NOT_EQUAL_K;
+    case REG_GREATER_K:
+      return REG_JUMP_IF_NOT_GREATER_K;
+    default:
+      return REG_JUMP_IF_NOT_LESS_K;
+  }
+}
+
+static void branch(Translator *t, int offset, bool if_true, int last_value) {
+  if (!require(t, 1)) return;
+  Chunk *chunk = t->chunk;
+  int target = jumpTarget(chunk, offset);
+  int next = offset + instructionLength(chunk, offset);
+  // the condition is dead when both ways out drop it.
+  bool pops = next < chunk->size && target < chunk->size &&
+              chunk->code[next] == OP_POP && chunk->code[target] == OP_POP;
+
+  int top = t->depth - 1;
+  for (int slot = 0; slot < top; ++slot) materialize(t, slot);
+  if (!pops) materialize(t, top);
+
+  uint8_t *code = t->out->code;
+  if (pops && !if_true && isFresh(t, last_value) &&
+      isCompare(code[last_value])) {
+    uint8_t op = fusedCompare(code[last_value]);
+    uint8_t left = code[last_value + 2];
+    uint8_t right = code[last_value + 3];
+    t->out->size = last_value;
+    int at = t->out->size;
+    emitBytes(t, op, left);
+    emitByte(t, right);
+    emitJumpTo(t, at, target);
+    return;
+  }
+
+  uint8_t condition = readSlot(t, top);
+  int at = t->out->size;
+  emitBytes(t, if_true ? REG_JUMP_IF_TRUE : REG_JUMP_IF_FALSE, condition);
+  emitJumpTo(t, at, target);
+}
+
+static void call(Translator *t, uint8_t op, int arg_count) {
+  if (!require(t, arg_count + 1)) return;
+  int base = t->depth - arg_count - 1;
+  flushCaptured(t, base);
+  for (int slot = base; slot < t->depth; ++slot) materialize(t, slot);
+
+  emitBytes(t, op, base);
+  emitByte(t, arg_count);
+  t->depth = base + 1;
+}
+
+static void callNative(Translator *t, uint8_t op, uint8_t name,
+                       int arg_count) {
+  if (!require(t, arg_count)) return;
+  int base = t->depth - arg_count;
+  flushCaptured(t, base);
+  for (int slot = base; slot < t->depth; ++slot) materialize(t, slot);
+
+  t->depth = base;
+  pushTemp(t);
+  emitBytes(t, op, base);
+  emitBytes(t, name, arg_count);
+}
+
+static void closure(Translator *t, uint8_t *code) {
+  ObjFunction *function = AS_FUNCTION(t->chunk->constants.values[code[1]]);
+  for (int i = 0; i < function->upvalue_count; ++i) {
+    uint8_t kind = code[2 + 2 * i];
+    uint8_t index = code[3 + 2 * i];
+    if (kind == CAPTURE_UPVALUE) continue;
+    if (!require(t, index + 1)) return;
+    materialize(t, index);
+  }
+
+  int dst = pushTemp(t);
+  emitBytes(t, REG_CLOSURE, dst);
+  emitByte(t, code[1]);
+  for (int i = 0; i < 2 * function->upvalue_count; ++i) {
+    emitByte(t, code[2 + i]);
+  }
+}
+
+// returns false when the instruction never falls through.
+static bool translateOp(Translator *t, int offset) {
+  uint8_t *code = &t->chunk->code[offset];
+  int last_value = t->last_value;
+  t->last_value = -1;
+
+  switch (code[0]) {
+    case OP_CONSTANT:
+      pushOperand(t, (Operand){OPERAND_CONSTANT, code[1]});
+      break;
+    case OP_NIL:
+      pushOperand(t, (Operand){OPERAND_NIL, 0});
+      break;
+    case OP_TRUE:
+      pushOperand(t, (Operand){OPERAND_TRUE, 0});
+      break;
+    case OP_FALSE:
+      pushOperand(t, (Operand){OPERAND_FALSE, 0});
+      break;
+    case OP_POP:
+      if (require(t, 1)) --t->depth;
+      break;
+    case OP_GET_LOCAL_GET_LOCAL:
+      // the second local may be the one the first just initialized.
+      if (require(t, code[1] + 1)) pushOperand(t, t->slots[code[1]]);
+      if (require(t, code[2] + 1)) pushOperand(t, t->slots[code[2]]);
+      break;
+    case OP_GET_LOCAL:
+      if (require(t, code[1] + 1)) pushOperand(t, t->slots[code[1]]);
+      break;
+    case OP_SET_LOCAL:
+      setLocal(t, last_value, code[1]);
+      break;
+    case OP_GET_UPVALUE:
+      emitValue(t, REG_GET_UPVALUE, pushTemp(t));
+      emitByte(t, code[1]);
+      break;
+    case OP_SET_UPVALUE: {
+      if (!require(t, 1)) break;
+      uint8_t src = readSlot(t, t->depth - 1);
+      emitBytes(t, REG_SET_UPVALUE, code[1]);
+      emitByte(t, src);
+      break;
+    }
+    case OP_DEF_GLOBAL:
+    case OP_SET_GLOBAL: {
+      if (!require(t, 1)) break;
+      uint8_t src = readSlot(t, t->depth - 1);
+      emitBytes(t, code[0] == OP_DEF_GLOBAL ? REG_DEF_GLOBAL : REG_SET_GLOBAL,
+                code[1]);
+      emitByte(t, src);
+      if (code[0] == OP_DEF_GLOBAL) --t->depth;
+      break;
+    }
+    case OP_GET_GLOBAL:
+      emitValue(t, REG_GET_GLOBAL, pushTemp(t));
+      emitByte(t, code[1]);
+      break;
+    case OP_NOT:
+      unary(t, REG_NOT);
+      break;
+    case OP_NEGATE:
+      unary(t, REG_NEGATE);
+      break;
+    case OP_EQUAL:
+      binary(t, REG_EQUAL, REG_EQUAL_K);
+      break;
+    case OP_GREATER:
+      binary(t, REG_GREATER, REG_GREATER_K);
+      break;
+    case OP_LESS:
+      binary(t, REG_LESS, REG_LESS_K);
+      break;
+    case OP_ADD:
+      binary(t, REG_ADD, REG_ADD_K);
+      break;
+    case OP_SUB:
+      binary(t, REG_SUB, REG_SUB_K);
+      break;
+    case OP_MUL:
+      binary(t, REG_MUL, REG_MUL_K);
+      break;
+    case OP_DIV:
+      binary(t, REG_DIV, REG_DIV_K);
+      break;
+    case OP_ADD_LOCAL_CONST:
+      if (!require(t, code[1] + 1)) break;
+      materialize(t, code[1]);
+      flushReferences(t, code[1]);
+      emitBytes(t, REG_ADD_K, code[1]);
+      emitBytes(t, code[1], code[2]);
+      break;
+    case OP_JUMP:
+    case OP_JUMP_LONG:
+    case OP_LOOP:
+    case OP_LOOP_LONG: {
+      flushSlots(t);
+      int at = t->out->size;
+      emitByte(t, REG_JUMP);
+      emitJumpTo(t, at, jumpTarget(t->chunk, offset));
+      return false;
+    }
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_FALSE_LONG:
+      branch(t, offset, false, last_value);
+      break;
+    case OP_JUMP_IF_TRUE:
+    case OP_JUMP_IF_TRUE_LONG:
+      branch(t, offset, true, last_value);
+      break;
+    case OP_LOCAL_LESS_CONST_JUMP:
+    case OP_LOCAL_LESS_CONST_JUMP_LONG: {
+      flushSlots(t);
+      int at = t->out->size;
+      emitBytes(t, REG_JUMP_IF_NOT_LESS_K, code[1]);
+      emitByte(t, code[2]);
+      emitJumpTo(t, at, jumpTarget(t->chunk, offset));
+      break;
+    }
+    case OP_CALL:
+      call(t, REG_CALL, code[1]);
+      break;
+    case OP_CALL_0:
+    case OP_CALL_1:
+    case OP_CALL_2:
+    case OP_CALL_3:
+      call(t, REG_CALL, code[0] - OP_CALL_0);
+      break;
+    case OP_TAIL_CALL:
+      call(t, REG_TAIL_CALL, code[1]);
+      break;
+    case OP_TAIL_CALL_0:
+    case OP_TAIL_CALL_1:
+    case OP_TAIL_CALL_2:
+    case OP_TAIL_CALL_3:
+      call(t, REG_TAIL_CALL, code[0] - OP_TAIL_CALL_0);
+      break;
+    case OP_CALL_NATIVE:
+      callNative(t, REG_CALL_NATIVE, code[1], code[2]);
+      break;
+    case OP_TAIL_CALL_NATIVE:
+      callNative(t, REG_TAIL_CALL_NATIVE, code[1], code[2]);
+      break;
+    case OP_CLOSURE:
+      closure(t, code);
+      break;
+    case OP_CLOSE_UPVALUE:
+      if (!require(t, 1)) break;
+      materialize(t, t->depth - 1);
+      emitBytes(t, REG_CLOSE_UPVALUE, --t->depth);
+      break;
+    case OP_RETURN:
+      if (!require(t, 1)) break;
+      emitBytes(t, REG_RETURN, readSlot(t, t->depth - 1));
+      --t->depth;
+      return false;
+    default:
+      t->failed = true;
+      break;
+  }
+
+  return true;
+}
+
+// marks jump targets and the locals that closures capture.
+static void scan(Translator *t) {
+  Chunk *chunk = t->chunk;
+  for (int offset = 0; offset < chunk->size;) {
+    uint8_t *code = &chunk->code[offset];
+    switch (code[0]) {
+      case OP_JUMP:
+      case OP_JUMP_IF_FALSE:
+      case OP_JUMP_IF_TRUE:
+      case OP_LOOP:
+      case OP_LOCAL_LESS_CONST_JUMP:
+      case OP_JUMP_LONG:
+      case OP_JUMP_IF_FALSE_LONG:
+      case OP_JUMP_IF_TRUE_LONG:
+      case OP_LOOP_LONG:
+      case OP_LOCAL_LESS_CONST_JUMP_LONG: {
+        int target = jumpTarget(chunk, offset);
+        if (target < 0 || target > chunk->size) {
+          t->failed = true;
+        } else {
+          t->targets[target] = true;
+        }
+        break;
+      }
+      case OP_CLOSURE: {
+        Value function = chunk->constants.values[code[1]];
+        for (int i = 0; i < AS_FUNCTION(function)->upvalue_count; ++i) {
+          if (code[2 + 2 * i] == CAPTURE_LOCAL) {
+            t->captured[code[3 + 2 * i]] = true;
+          }
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    offset += instructionLength(chunk, offset);
+  }
+}
+
+static void patchJumps(Translator *t) {
+  uint8_t *code = t->out->code;
+  for (int i = 0; i < t->fixup_count && !t->failed; ++i) {
+    Fixup *fixup = &t->fixups[i];
+    int target = t->offsets[fixup->target];
+    if (target == -1) {
+      t->failed = true;
+      break;
+    }
+
+    int distance = target - fixup->end;
+    if (distance < 0) {
+      // only unconditional jumps go backwards.
+      if (code[fixup->op] != REG_JUMP) t->failed = true;
+      code[fixup->op] = REG_LOOP;
+      distance = -distance;
+    }
+    if (distance > UINT16_MAX) t->failed = true;
+
+    code[fixup->end - 2] = (distance >> 8) & 0xff;
+    code[fixup->end - 1] = distance & 0xff;
+  }
+}
+
+RegisterCode *translateRegisters(ObjFunction *function) {
+  Chunk *chunk = &function->chunk;
+  Translator t;
+  t.chunk = chunk;
+  t.out = ALLOCATE(RegisterCode, 1);
+  t.out->size = 0;
+  t.out->code = NULL;
+  t.out->lines = NULL;
+  t.capacity = 0;
+  t.line = 0;
+  t.failed = false;
+  t.last_value = -1;
+  t.fixups = NULL;
+  t.fixup_count = 0;
+  t.fixup_capacity = 0;
+
+  // the closure and the arguments are already in their registers.
+  t.depth = function->arity + 1;
+  for (int slot = 0; slot < t.depth; ++slot) setHome(&t, slot);
+  for (int reg = 0; reg < UINT8_COUNT; ++reg) t.captured[reg] = false;
+
+  // a jump may target the end of the code.
+  int count = chunk->size + 1;
+  t.targets = ALLOCATE(bool, count);
+  t.depths = ALLOCATE(int, count);
+  t.offsets = ALLOCATE(int, count);
+  for (int i = 0; i < count; ++i) {
+    t.targets[i] = false;
+    t.depths[i] = -1;
+    t.offsets[i] = -1;
+  }
+
+  scan(&t);
+
+  bool reachable = true;
+  for (int offset = 0; offset < chunk->size && !t.failed;
+       offset += instructionLength(chunk, offset)) {
+    t.line = chunk->lines[offset];
+    if (!reachable) {
+      // every jump leaves all slots in their registers. code no jump has
+      // reached yet keeps the depth of the code before it.
+      if (t.depths[offset] != -1) t.depth = t.depths[offset];
+      for (int slot = 0; slot < t.depth; ++slot) setHome(&t, slot);
+    }
+    if (t.targets[offset]) {
+      flushSlots(&t);
+      reachTarget(&t, offset);
+      t.last_value = -1;
+    }
+
+    t.offsets[offset] = t.out->size;
+    reachable = translateOp(&t, offset);
+  }
+
+  patchJumps(&t);
+
+  FREE_ARRAY(t.targets, bool, count);
+  FREE_ARRAY(t.depths, int, count);
+  FREE_ARRAY(t.offsets, int, count);
+  FREE_ARRAY(t.fixups, Fixup, t.fixup_capacity);
+
+  RegisterCode *out = t.out;
+  out->code = GROW_ARRAY(out->code, uint8_t, t.capacity, out->size);
+  out->lines = GROW_ARRAY(out->lines, int, t.capacity, out->size);
+  if (t.failed) {
+    freeRegisterCode(out);
+    return NULL;
+  }
+  return out;
+}
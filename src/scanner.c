@@ -4,13 +4,18 @@
 #include "common.h"
 #include "scanner.h"
 
+#if defined(__SSE2__) && !defined(__SANITIZE_ADDRESS__)
+#include <emmintrin.h>
+#define CLOX_SCANNER_SSE2
+#endif
+
 typedef struct {
   const char *start;
   const char *current;
   int line;
 } Scanner;
 
-Scanner scanner;
+CLOX_THREAD_LOCAL Scanner scanner;
 
 void initScanner(const char *source) {
   scanner.start = scanner.current = source;
@@ -49,13 +54,86 @@ static bool match(const char expected) {
   return true;
 }
 
-static bool isDigit(const char c) { return c >= '0' && c <= '9'; }
+enum {
+  A = 1 << 0,  // alpha.
+  D = 1 << 1,  // digit.
+  B = 1 << 2,  // blank, whitespace other than newlines.
+};
+
+static const uint8_t char_classes[UINT8_COUNT] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, B, 0, 0, 0, B, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    B, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static uint8_t charClass(const char c) { return char_classes[(uint8_t)c]; }
+
+static bool isDigit(const char c) { return charClass(c) & D; }
+
+static bool isAlpha(const char c) { return charClass(c) & A; }
+
+static bool isAlphanum(const char c) { return charClass(c) & (A | D); }
+
+#ifdef CLOX_SCANNER_SSE2
+// the source is only read with aligned 16 bytes loads, which never cross a
+// page, so reading past its terminator is safe.
+static const __m128i *alignedBlock(const char *p, int *skip) {
+  *skip = (int)((uintptr_t)p & 15);
+  return (const __m128i *)(p - *skip);
+}
 
-static bool isAlpha(const char c) {
-  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+static int matchMask(const __m128i *block, char a, char b, char c) {
+  __m128i chars = _mm_load_si128(block);
+  __m128i matches = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(a)),
+                   _mm_cmpeq_epi8(chars, _mm_set1_epi8(b))),
+      _mm_cmpeq_epi8(chars, _mm_set1_epi8(c)));
+  return _mm_movemask_epi8(matches);
+}
+#endif
+
+// finds the first of the given characters, one of them has to be '\0'.
+static const char *findChar(const char *p, char a, char b, char c) {
+#ifdef CLOX_SCANNER_SSE2
+  int skip;
+  const __m128i *block = alignedBlock(p, &skip);
+  int mask = (matchMask(block, a, b, c) >> skip) << skip;
+  while (!mask) mask = matchMask(++block, a, b, c);
+  return (const char *)block + __builtin_ctz(mask);
+#else
+  while (*p != a && *p != b && *p != c) ++p;
+  return p;
+#endif
 }
 
-static bool isAlphanum(const char c) { return isAlpha(c) || isDigit(c); }
+static const char *skipBlanks(const char *p) {
+  // blanks mostly come alone between tokens, only runs are worth a vector.
+  if (!(charClass(*++p) & B)) return p;
+
+#ifdef CLOX_SCANNER_SSE2
+  int skip;
+  const __m128i *block = alignedBlock(p, &skip);
+  int mask = ((~matchMask(block, ' ', '\t', '\r') & 0xffff) >> skip) << skip;
+  while (!mask) mask = ~matchMask(++block, ' ', '\t', '\r') & 0xffff;
+  return (const char *)block + __builtin_ctz(mask);
+#else
+  while (charClass(*p) & B) ++p;
+  return p;
+#endif
+}
 
 static void skipWhitespace() {
   for (;;) {
@@ -67,75 +145,72 @@ static void skipWhitespace() {
       case ' ':
       case '\t':
       case '\r':
-        advance();
+        scanner.current = skipBlanks(scanner.current);
         break;
       case '/':
         if (peekNext() == '/') {
-          while (peek() != '\n' && !isAtEnd()) advance();
+          scanner.current = findChar(scanner.current + 2, '\n', '\0', '\0');
           break;
         }
+        return;
       default:
         return;
     }
   }
 }
 
-static TokenType checkKeyword(int start, int length, const char *rest,
-                              TokenType type) {
-  if (scanner.current - scanner.start == start + length &&
-      !memcmp(scanner.start + start, rest, length)) {
-    return type;
-  }
+// keywords are classified with a minimal perfect hash, their length plus the
+// values associated with their first and last characters maps each of them to
+// its own slot. characters that never start or end a keyword map every
+// identifier using them out of range. the tables are printed by
+// util/keyword_hash.py, rerun it after changing the keywords.
+#define X 64
+#define KEYWORD_HASH_OFFSET 9
 
-  return TOKEN_IDENTIFIER;
-}
+static const uint8_t keyword_first_values[26] = {
+    1, X, 0, X, 3, 13, X, X, 10, X, X, 5, X,
+    5, 11, X, X, 7, 10, 4, X, X, X, X, X, X,
+};
+
+static const uint8_t keyword_last_values[26] = {
+    X, X, X, 12, 3, 5, X, X, X, X, X, 5, X,
+    2, X, 5, X, 7, 4, 11, X, X, X, X, X, X,
+};
+
+#undef X
+
+typedef struct {
+  const char *chars;
+  int length;
+  TokenType type;
+} Keyword;
+
+static const Keyword keywords[] = {
+    {"class", 5, TOKEN_CLASS},   {"else", 4, TOKEN_ELSE},
+    {"true", 4, TOKEN_TRUE},     {"this", 4, TOKEN_THIS},
+    {"nil", 3, TOKEN_NIL},       {"loop", 4, TOKEN_LOOP},
+    {"return", 6, TOKEN_RETURN}, {"and", 3, TOKEN_AND},
+    {"if", 2, TOKEN_IF},         {"fun", 3, TOKEN_FUN},
+    {"let", 3, TOKEN_LET},       {"or", 2, TOKEN_OR},
+    {"false", 5, TOKEN_FALSE},   {"super", 5, TOKEN_SUPER},
+};
+
+#define KEYWORDS_COUNT (int)(sizeof(keywords) / sizeof(keywords[0]))
 
 static TokenType identifierType() {
-  /* hardcoded trie */
-  switch (scanner.start[0]) {
-    case 'a':
-      return checkKeyword(1, 2, "nd", TOKEN_AND);
-    case 'c':
-      return checkKeyword(1, 4, "lass", TOKEN_CLASS);
-    case 'e':
-      return checkKeyword(1, 3, "lse", TOKEN_ELSE);
-    case 'f': {
-      if (scanner.current - scanner.start <= 1) break;
-      switch (scanner.start[1]) {
-        case 'a':
-          return checkKeyword(2, 3, "lse", TOKEN_FALSE);
-        case 'u':
-          return checkKeyword(2, 1, "n", TOKEN_FUN);
-      }
-    }
-    case 'i':
-      return checkKeyword(1, 1, "f", TOKEN_IF);
-    case 'l': {
-      if (scanner.current - scanner.start <= 1) break;
-      switch (scanner.start[1]) {
-        case 'o':
-          return checkKeyword(2, 2, "op", TOKEN_LOOP);
-        case 'e':
-          return checkKeyword(2, 1, "t", TOKEN_LET);
-      }
-    }
-    case 'n':
-      return checkKeyword(1, 2, "il", TOKEN_NIL);
-    case 'o':
-      return checkKeyword(1, 1, "r", TOKEN_OR);
-    case 'r':
-      return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
-    case 's':
-      return checkKeyword(1, 4, "uper", TOKEN_SUPER);
-    case 't': {
-      if (scanner.current - scanner.start <= 1) break;
-      switch (scanner.start[1]) {
-        case 'h':
-          return checkKeyword(2, 2, "is", TOKEN_THIS);
-        case 'r':
-          return checkKeyword(2, 2, "ue", TOKEN_TRUE);
-      }
-    }
+  int length = (int)(scanner.current - scanner.start);
+  uint8_t first = (uint8_t)(scanner.start[0] - 'a');
+  uint8_t last = (uint8_t)(scanner.current[-1] - 'a');
+  if (length > 6 || first >= 26 || last >= 26) return TOKEN_IDENTIFIER;
+
+  unsigned hash = (unsigned)(length + keyword_first_values[first] +
+                             keyword_last_values[last] - KEYWORD_HASH_OFFSET);
+  if (hash >= KEYWORDS_COUNT) return TOKEN_IDENTIFIER;
+
+  const Keyword *keyword = &keywords[hash];
+  if (keyword->length == length &&
+      !memcmp(scanner.start, keyword->chars, length)) {
+    return keyword->type;
   }
 
   return TOKEN_IDENTIFIER;
@@ -159,8 +234,10 @@ static Token numberToken() {
 }
 
 static Token stringToken() {
-  while (!isAtEnd() && peek() != '"') {
-    if (peek() == '\n') ++scanner.line;
+  for (;;) {
+    scanner.current = findChar(scanner.current, '"', '\n', '\0');
+    if (peek() != '\n') break;
+    ++scanner.line;
     advance();
   }
 
@@ -190,8 +267,14 @@ Token scanToken() {
       return makeToken(TOKEN_LEFT_BRACE);
     case '}':
       return makeToken(TOKEN_RIGHT_BRACE);
+    case '[':
+      return makeToken(TOKEN_LEFT_BRACKET);
+    case ']':
+      return makeToken(TOKEN_RIGHT_BRACKET);
     case ',':
       return makeToken(TOKEN_COMMA);
+    case ':':
+      return makeToken(TOKEN_COLON);
     case '.':
       return makeToken(TOKEN_DOT);
     case '-':
@@ -204,6 +287,8 @@ Token scanToken() {
       return makeToken(TOKEN_SLASH);
     case '*':
       return makeToken(TOKEN_STAR);
+    case '%':
+      return makeToken(TOKEN_PERCENT);
     case '!':
       return makeToken(match('=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
     case '=':
@@ -212,6 +297,10 @@ Token scanToken() {
       return makeToken(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
     case '<':
       return makeToken(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+    case '~':
+      // integer division, as '//' starts a comment.
+      if (match('/')) return makeToken(TOKEN_TILDE_SLASH);
+      break;
     case '"':
       return stringToken();
     default: {}
@@ -1,3 +1,4 @@
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -6,136 +7,250 @@
 #include "table.h"
 #include "value.h"
 
-// hash table maximum load factor.
-#define TABLE_MAX_LOAD 0.75
-
-#define TOMBSTONE_VAL BOOL_VAL(true)
+// markers of the index slots that hold no entry.
+#define SLOT_EMPTY -1
+#define SLOT_DELETED -2
 
 void initTable(Table *table) {
   table->count = 0;
+  table->size = 0;
   table->capacity = 0;
   table->entries = NULL;
+  table->index = NULL;
 }
 
 void freeTable(Table *table) {
   FREE_ARRAY(table->entries, Entry, table->capacity);
+  FREE_ARRAY(table->index, int, table->capacity * 2);
   initTable(table);
 }
 
-static Entry *findEntry(Entry *entries, int capacity, ObjString *key) {
-  uint32_t index = key->hash % capacity;
-  Entry *tombstone = NULL;
-
-  for (;;) {
-    Entry *entry = &entries[index];
+// spreads every bit of the input over the low bits the index masks with.
+static uint32_t mixBits(uint64_t bits) {
+  bits ^= bits >> 33;
+  bits *= 0xff51afd7ed558ccdull;
+  bits ^= bits >> 33;
+  bits *= 0xc4ceb9fe1a85ec53ull;
+  bits ^= bits >> 33;
+  return (uint32_t)bits;
+}
 
-    if (!entry->key) {
-      if (IS_NIL(entry->value)) {
-        return tombstone != NULL ? tombstone : entry;
-      } else {
-        if (!tombstone) tombstone = entry;
+static uint32_t hashValue(Value key) {
+  switch (key.type) {
+    case VAL_BOOL:
+      return AS_BOOL(key) ? 1231 : 1237;
+    case VAL_NIL:
+      return 0;
+    case VAL_NUMBER: {
+      // whole doubles hash like the ints they equal, -0 included.
+      double number = AS_NUMBER(key);
+      if (number >= -0x1p63 && number < 0x1p63 &&
+          number == (double)(int64_t)number) {
+        return mixBits((uint64_t)(int64_t)number);
       }
-    } else if (entry->key == key) {
-      // string interning guarantees string objects with the same
-      // address are equal.
-      return entry;
+      uint64_t bits;
+      memcpy(&bits, &number, sizeof(bits));
+      return mixBits(bits);
     }
+    case VAL_OBJ:
+      if (IS_STRING(key)) return AS_STRING(key)->hash;
+      return mixBits((uint64_t)(uintptr_t)AS_OBJ(key));
+    case VAL_INT:
+      return mixBits((uint64_t)AS_INT(key));
+  }
+
+  return 0;  // unreachable.
+}
 
-    index = (index + 1) % capacity;
+// string interning makes strings with the same contents the same object,
+// and other objects are keys by identity.
+static inline bool keysEqual(Value a, Value b) {
+  if (a.type != b.type) {
+    return IS_NUMERIC(a) && IS_NUMERIC(b) && valuesEqual(a, b);
   }
+  switch (a.type) {
+    case VAL_BOOL:
+      return AS_BOOL(a) == AS_BOOL(b);
+    case VAL_NIL:
+      return true;
+    case VAL_NUMBER:
+      return AS_NUMBER(a) == AS_NUMBER(b);
+    case VAL_OBJ:
+      return AS_OBJ(a) == AS_OBJ(b);
+    case VAL_INT:
+      return AS_INT(a) == AS_INT(b);
+  }
+
+  return false;  // unreachable.
 }
 
-static void adjustCapacity(Table *table, int new_capacity) {
-  Entry *entries = ALLOCATE(Entry, new_capacity);
+bool isTableKey(Value key) {
+  return !IS_NIL(key) && !(IS_NUMBER(key) && isnan(AS_NUMBER(key)));
+}
 
-  table->count = 0;
-  for (int i = 0; i < table->capacity; ++i) {
-    Entry *entry = &table->entries[i];
+// the slot that holds key, or the one it would be inserted in. live and
+// deleted entries fill at most half of the index, so probing always ends.
+static int *findSlot(Table *table, Value key, uint32_t hash) {
+  uint32_t mask = (uint32_t)table->capacity * 2 - 1;
+  uint32_t i = hash & mask;
+  int *tombstone = NULL;
 
-    if (!entry->key) {
-      entries[i].key = NULL;
-      entries[i].value = NIL_VAL;
-    } else {
-      Entry *new_entry = findEntry(entries, new_capacity, entry->key);
-      new_entry->key = entry->key;
-      new_entry->value = entry->value;
-      ++table->count;
+  for (;;) {
+    int *slot = &table->index[i];
+    if (*slot == SLOT_EMPTY) return tombstone ? tombstone : slot;
+    if (*slot == SLOT_DELETED) {
+      if (!tombstone) tombstone = slot;
+    } else if (keysEqual(table->entries[*slot].key, key)) {
+      return slot;
     }
+
+    i = (i + 1) & mask;
   }
+}
+
+// makes room for one more entry, dropping the deleted ones and growing
+// when more than half of the entries are live. entries keep their order.
+static void adjustCapacity(Table *table) {
+  int capacity = table->capacity;
+  if (table->count + 1 > capacity / 2) capacity = GROW_CAPACITY(capacity);
 
-  // initialize the rest of the entries.
-  for (int i = table->capacity; i < new_capacity; ++i) {
-    entries[i].key = NULL;
-    entries[i].value = NIL_VAL;
+  Entry *entries = ALLOCATE(Entry, capacity);
+  int *index = ALLOCATE(int, capacity * 2);
+  for (int i = 0; i < capacity * 2; ++i) index[i] = SLOT_EMPTY;
+
+  uint32_t mask = (uint32_t)capacity * 2 - 1;
+  int size = 0;
+  for (int i = 0; i < table->size; ++i) {
+    Entry *entry = &table->entries[i];
+    if (IS_NIL(entry->key)) continue;
+
+    uint32_t slot = hashValue(entry->key) & mask;
+    while (index[slot] != SLOT_EMPTY) slot = (slot + 1) & mask;
+    index[slot] = size;
+    entries[size++] = *entry;
   }
 
   FREE_ARRAY(table->entries, Entry, table->capacity);
+  FREE_ARRAY(table->index, int, table->capacity * 2);
   table->entries = entries;
-  table->capacity = new_capacity;
+  table->index = index;
+  table->size = size;
+  table->capacity = capacity;
 }
 
-bool tableSet(Table *table, ObjString *key, Value value) {
-  if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-    int capacity = GROW_CAPACITY(table->capacity);
-    adjustCapacity(table, capacity);
+static bool setEntry(Table *table, Value key, uint32_t hash, Value value) {
+  if (table->size == table->capacity) adjustCapacity(table);
+
+  int *slot = findSlot(table, key, hash);
+  if (*slot >= 0) {
+    table->entries[*slot].value = value;
+    return false;
   }
 
-  Entry *entry = findEntry(table->entries, table->capacity, key);
-  bool is_new_entry = entry->key == NULL;
-  entry->key = key;
-  entry->value = value;
+  *slot = table->size;
+  table->entries[table->size].key = key;
+  table->entries[table->size].value = value;
+  ++table->size;
+  ++table->count;
+  return true;
+}
 
-  if (is_new_entry) ++table->count;
+static Entry *getEntry(Table *table, Value key, uint32_t hash) {
+  if (table->count == 0) return NULL;
 
-  return is_new_entry;
+  int slot = *findSlot(table, key, hash);
+  return slot >= 0 ? &table->entries[slot] : NULL;
+}
+
+static bool deleteEntry(Table *table, Value key, uint32_t hash) {
+  if (table->count == 0) return false;
+
+  int *slot = findSlot(table, key, hash);
+  if (*slot < 0) return false;
+
+  table->entries[*slot].key = NIL_VAL;
+  table->entries[*slot].value = NIL_VAL;
+  *slot = SLOT_DELETED;
+  --table->count;
+  return true;
+}
+
+// string keys are interned on the way in. a string that is not interned is
+// then only ever found through the interned string equal to it, and one
+// without any is not a key of any table.
+bool tableSetValue(Table *table, Value key, Value value) {
+  if (IS_STRING(key)) key = OBJ_VAL(internString(AS_STRING(key)));
+  return setEntry(table, key, hashValue(key), value);
+}
+
+static bool findKey(Value *key) {
+  if (!IS_STRING(*key)) return true;
+
+  ObjString *interned = findInterned(AS_STRING(*key));
+  if (!interned) return false;
+  *key = OBJ_VAL(interned);
+  return true;
+}
+
+bool tableGetValue(Table *table, Value key, Value *value) {
+  if (table->count == 0 || !findKey(&key)) return false;
+
+  Entry *entry = getEntry(table, key, hashValue(key));
+  if (!entry) return false;
+
+  *value = entry->value;
+  return true;
+}
+
+bool tableDeleteValue(Table *table, Value key) {
+  if (table->count == 0 || !findKey(&key)) return false;
+  return deleteEntry(table, key, hashValue(key));
+}
+
+bool tableSet(Table *table, ObjString *key, Value value) {
+  return setEntry(table, OBJ_VAL(key), key->hash, value);
 }
 
 void tableUpdate(Table *dest, Table *src) {
-  for (int i = 0; i < src->capacity; i++) {
+  for (int i = 0; i < src->size; i++) {
     Entry *entry = &src->entries[i];
-    if (entry->key) {
-      tableSet(dest, entry->key, entry->value);
+    if (!IS_NIL(entry->key)) {
+      tableSetValue(dest, entry->key, entry->value);
     }
   }
 }
 
 bool tableGet(Table *table, ObjString *key, Value *value) {
-  if (!table->entries) return false;
-
-  Entry *entry = findEntry(table->entries, table->capacity, key);
-  if (!entry->key) return false;
+  Entry *entry = getEntry(table, OBJ_VAL(key), key->hash);
+  if (!entry) return false;
 
   *value = entry->value;
   return true;
 }
 
 bool tableDelete(Table *table, ObjString *key) {
-  if (table->count == 0) return false;
-
-  Entry *entry = findEntry(table->entries, table->capacity, key);
-  if (!entry->key) return false;
-
-  entry->key = NULL;
-  entry->value = TOMBSTONE_VAL;
-  return true;
+  return deleteEntry(table, OBJ_VAL(key), key->hash);
 }
 
 ObjString *tableFindString(Table *table, const char *chars, int length,
                            uint32_t hash) {
   // for string interning used by the vm.
-  if (!table->entries) return NULL;
+  if (table->count == 0) return NULL;
 
-  uint32_t index = hash % table->capacity;
+  uint32_t mask = (uint32_t)table->capacity * 2 - 1;
+  uint32_t i = hash & mask;
 
   for (;;) {
-    Entry *entry = &table->entries[index];
-
-    if (!entry->key) return NULL;
-    if (entry->key->length == length && entry->key->hash == hash &&
-        !memcmp(entry->key->chars, chars, length)) {
-      return entry->key;
+    int slot = table->index[i];
+    if (slot == SLOT_EMPTY) return NULL;
+    if (slot >= 0 && IS_STRING(table->entries[slot].key)) {
+      ObjString *key = AS_STRING(table->entries[slot].key);
+      if (key->length == length && key->hash == hash &&
+          !memcmp(key->chars, chars, length)) {
+        return key;
+      }
     }
 
-    index = (index + 1) % table->capacity;
+    i = (i + 1) & mask;
   }
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include <limits.h>
+#include <string.h>
+
+#include "object.h"
+#include "text.h"
+#include "value.h"
+#include "vm.h"
+
+// the natives build their result in place instead of through the string of
+// every step a chain of + would make, and leave it un-interned.
+
+static bool nativeStringBuilder(int arg_count, Value *args, Value *result) {
+  *result = OBJ_VAL(newStringBuilder());
+  return true;
+}
+
+static bool nativeSbAppend(int arg_count, Value *args, Value *result) {
+  if (!IS_STRING_BUILDER(args[0]) || !IS_STRING(args[1])) {
+    return nativeError("sbAppend() expects a string builder and a string");
+  }
+
+  ObjString *string = AS_STRING(args[1]);
+  appendChars(AS_STRING_BUILDER(args[0]), string->chars, string->length);
+  *result = NIL_VAL;
+  return true;
+}
+
+static bool nativeSbAppendNumber(int arg_count, Value *args, Value *result) {
+  if (!IS_STRING_BUILDER(args[0]) || !IS_NUMERIC(args[1])) {
+    return nativeError(
+        "sbAppendNumber() expects a string builder and a number");
+  }
+
+  char text[NUMBER_TEXT_MAX];
+  int length = formatNumber(args[1], text);
+  appendChars(AS_STRING_BUILDER(args[0]), text, length);
+  *result = NIL_VAL;
+  return true;
+}
+
+// the builder is left as it is and can be appended to further.
+static bool nativeSbToString(int arg_count, Value *args, Value *result) {
+  if (!IS_STRING_BUILDER(args[0])) {
+    return nativeError("sbToString() expects a string builder");
+  }
+
+  ObjStringBuilder *builder = AS_STRING_BUILDER(args[0]);
+  *result = OBJ_VAL(makeString(builder->chars ? builder->chars : "",
+                               builder->length));
+  return true;
+}
+
+// the strings of a list with a separator between them.
+static bool nativeStrJoin(int arg_count, Value *args, Value *result) {
+  if (!IS_LIST(args[0]) || !IS_STRING(args[1])) {
+    return nativeError("strJoin() expects a list and a separator");
+  }
+
+  ValueArray *items = &AS_LIST(args[0])->items;
+  ObjString *separator = AS_STRING(args[1]);
+  int64_t length = 0;
+  for (int i = 0; i < items->size; ++i) {
+    if (!IS_STRING(items->values[i])) {
+      return nativeError("strJoin() item %d is not a string", i);
+    }
+    length += AS_STRING(items->values[i])->length;
+    if (i > 0) length += separator->length;
+  }
+  if (length > INT_MAX) return nativeError("strJoin() result is too long");
+
+  ObjString *string = newString((int)length);
+  char *to = string->chars;
+  for (int i = 0; i < items->size; ++i) {
+    if (i > 0) {
+      memcpy(to, separator->chars, separator->length);
+      to += separator->length;
+    }
+    ObjString *item = AS_STRING(items->values[i]);
+    memcpy(to, item->chars, item->length);
+    to += item->length;
+  }
+
+  *result = OBJ_VAL(string);
+  return true;
+}
+
+static bool nativeStrRepeat(int arg_count, Value *args, Value *result) {
+  int count = elementIndex(args[1], INT_MAX);
+  if (!IS_STRING(args[0]) || count < 0) {
+    return nativeError("strRepeat() expects a string and a count");
+  }
+
+  ObjString *part = AS_STRING(args[0]);
+  if (part->length > 0 && count > INT_MAX / part->length) {
+    return nativeError("strRepeat() result is too long");
+  }
+
+  ObjString *string = newString(part->length * count);
+  for (int i = 0; i < count; ++i) {
+    memcpy(string->chars + i * part->length, part->chars, part->length);
+  }
+
+  *result = OBJ_VAL(string);
+  return true;
+}
+
+// the characters from start up to end.
+static bool nativeStrSub(int arg_count, Value *args, Value *result) {
+  if (!IS_STRING(args[0]) || !IS_NUMERIC(args[1]) || !IS_NUMERIC(args[2])) {
+    return nativeError("strSub() expects a string, a start and an end");
+  }
+
+  ObjString *string = AS_STRING(args[0]);
+  int start = elementIndex(args[1], string->length + 1);
+  int end = elementIndex(args[2], string->length + 1);
+  if (start < 0 || end < start) {
+    return nativeError("strSub() range out of bounds");
+  }
+
+  *result = OBJ_VAL(makeString(string->chars + start, end - start));
+  return true;
+}
+
+// the first occurrence of the non-empty needle in chars, or NULL.
+static const char *findChars(const char *chars, int length,
+                             const char *needle, int needle_length) {
+  if (length < needle_length) return NULL;
+
+  const char *end = chars + length - needle_length;
+  for (const char *at = chars; at <= end; ++at) {
+    at = memchr(at, needle[0], end - at + 1);
+    if (!at) break;
+    if (!memcmp(at, needle, needle_length)) return at;
+  }
+  return NULL;
+}
+
+// where the first occurrence of needle starts, or -1.
+static bool nativeStrIndexOf(int arg_count, Value *args, Value *result) {
+  if (!IS_STRING(args[0]) || !IS_STRING(args[1])) {
+    return nativeError("strIndexOf() expects two strings");
+  }
+
+  ObjString *string = AS_STRING(args[0]);
+  ObjString *needle = AS_STRING(args[1]);
+  if (needle->length == 0) {
+    *result = INT_VAL(0);
+    return true;
+  }
+
+  const char *at = findChars(string->chars, string->length, needle->chars,
+                             needle->length);
+  *result = INT_VAL(at ? at - string->chars : -1);
+  return true;
+}
+
+// how many times the non-empty needle occurs without overlapping.
+static bool nativeStrCount(int arg_count, Value *args, Value *result) {
+  if (!IS_STRING(args[0]) || !IS_STRING(args[1]) ||
+      AS_STRING(args[1])->length == 0) {
+    return nativeError("strCount() expects a string and a needle");
+  }
+
+  ObjString *string = AS_STRING(args[0]);
+  ObjString *needle = AS_STRING(args[1]);
+  const char *from = string->chars;
+  const char *end = string->chars + string->length;
+  int64_t count = 0;
+  for (;;) {
+    from = findChars(from, (int)(end - from), needle->chars, needle->length);
+    if (!from) break;
+    ++count;
+    from += needle->length;
+  }
+
+  *result = INT_VAL(count);
+  return true;
+}
+
+// the parts of a string between occurrences of a separator, which are cut
+// straight from its characters.
+static bool nativeStrSplit(int arg_count, Value *args, Value *result) {
+  if (!IS_STRING(args[0]) || !IS_STRING(args[1]) ||
+      AS_STRING(args[1])->length == 0) {
+    return nativeError("strSplit() expects a string and a separator");
+  }
+
+  ObjString *string = AS_STRING(args[0]);
+  ObjString *separator = AS_STRING(args[1]);
+  ObjList *parts = newList();
+  const char *from = string->chars;
+  const char *end = string->chars + string->length;
+  for (;;) {
+    const char *at = findChars(from, (int)(end - from), separator->chars,
+                               separator->length);
+    if (!at) break;
+    writeValueArray(&parts->items, OBJ_VAL(makeString(from, (int)(at - from))));
+    from = at + separator->length;
+  }
+  writeValueArray(&parts->items, OBJ_VAL(makeString(from, (int)(end - from))));
+
+  *result = OBJ_VAL(parts);
+  return true;
+}
+
+void defineTextNatives() {
+  defineNativeFn("stringBuilder", 0, 0, nativeStringBuilder);
+  defineNativeFn("sbAppend", 2, 0, nativeSbAppend);
+  defineNativeFn("sbAppendNumber", 2, 0, nativeSbAppendNumber);
+  defineNativeFn("sbToString", 1, 0, nativeSbToString);
+  defineNativeFn("strJoin", 2, 0, nativeStrJoin);
+  defineNativeFn("strRepeat", 2, 0, nativeStrRepeat);
+  defineNativeFn("strSub", 3, 0, nativeStrSub);
+  defineNativeFn("strIndexOf", 2, 0, nativeStrIndexOf);
+  defineNativeFn("strCount", 2, 0, nativeStrCount);
+  defineNativeFn("strSplit", 2, 0, nativeStrSplit);
+}
@@ -1,7 +1,9 @@
-#include <stdio.h>
+#include <math.h>
 
 #include "memory.h"
+#include "number.h"
 #include "object.h"
+#include "output.h"
 #include "value.h"
 
 void initValueArray(ValueArray *array) {
@@ -21,30 +23,43 @@ void writeValueArray(ValueArray *array, Value value) {
   array->values[array->size++] = value;
 }
 
-void freeArray(ValueArray *array) {
+void freeValueArray(ValueArray *array) {
   FREE_ARRAY(array->values, Value, array->capacity);
   initValueArray(array);
 }
 
+int formatNumber(Value number, char *text) {
+  if (IS_INT(number)) return formatInt(AS_INT(number), text);
+  return formatDouble(AS_NUMBER(number), text);
+}
+
+// written out right away, to keep its place among the printf output of the
+// debugging code that uses it.
 void printValue(Value value) {
-  switch (value.type) {
-    case VAL_BOOL:
-      printf(AS_BOOL(value) ? "true" : "false");
-      break;
-    case VAL_NIL:
-      printf("nil");
-      break;
-    case VAL_NUMBER:
-      printf("%g", AS_NUMBER(value));
-      break;
-    case VAL_OBJ:
-      printObject(value);
-      break;
+  writeValue(value);
+  flushOutput();
+}
+
+// exact, so that ints beyond 2^53 only equal the doubles they convert to
+// without rounding.
+static bool intEqualsDouble(int64_t integer, double number) {
+  return number >= -0x1p63 && number < 0x1p63 &&
+         (int64_t)number == integer && number == (double)integer;
+}
+
+// values of different types are only equal when they are the same number.
+static bool mixedEqual(Value a, Value b) {
+  if (IS_INT(a) && IS_NUMBER(b)) {
+    return intEqualsDouble(AS_INT(a), AS_NUMBER(b));
+  }
+  if (IS_NUMBER(a) && IS_INT(b)) {
+    return intEqualsDouble(AS_INT(b), AS_NUMBER(a));
   }
+  return false;
 }
 
 bool valuesEqual(Value a, Value b) {
-  if (a.type != b.type) return false;
+  if (a.type != b.type) return mixedEqual(a, b);
   switch (a.type) {
     case VAL_BOOL:
       return AS_BOOL(a) == AS_BOOL(b);
@@ -54,7 +69,73 @@ bool valuesEqual(Value a, Value b) {
       return AS_NUMBER(a) == AS_NUMBER(b);
     case VAL_OBJ:
       return objectsEqual(a, b);
+    case VAL_INT:
+      return AS_INT(a) == AS_INT(b);
   }
 
   return false;  // unreachable.
+}
+
+Value addNumbers(Value a, Value b) {
+  int64_t result;
+  if (IS_INT(a) && IS_INT(b) &&
+      !__builtin_add_overflow(AS_INT(a), AS_INT(b), &result)) {
+    return INT_VAL(result);
+  }
+  return NUMBER_VAL(AS_DOUBLE(a) + AS_DOUBLE(b));
+}
+
+Value subtractNumbers(Value a, Value b) {
+  int64_t result;
+  if (IS_INT(a) && IS_INT(b) &&
+      !__builtin_sub_overflow(AS_INT(a), AS_INT(b), &result)) {
+    return INT_VAL(result);
+  }
+  return NUMBER_VAL(AS_DOUBLE(a) - AS_DOUBLE(b));
+}
+
+Value multiplyNumbers(Value a, Value b) {
+  int64_t result;
+  if (IS_INT(a) && IS_INT(b) &&
+      !__builtin_mul_overflow(AS_INT(a), AS_INT(b), &result)) {
+    return INT_VAL(result);
+  }
+  return NUMBER_VAL(AS_DOUBLE(a) * AS_DOUBLE(b));
+}
+
+Value divideNumbers(Value a, Value b) {
+  return NUMBER_VAL(AS_DOUBLE(a) / AS_DOUBLE(b));
+}
+
+Value negateNumber(Value a) {
+  if (IS_INT(a) && AS_INT(a) != INT64_MIN) return INT_VAL(-AS_INT(a));
+  return NUMBER_VAL(-AS_DOUBLE(a));
+}
+
+bool lessNumbers(Value a, Value b) {
+  if (IS_INT(a) && IS_INT(b)) return AS_INT(a) < AS_INT(b);
+  return AS_DOUBLE(a) < AS_DOUBLE(b);
+}
+
+bool quotientNumbers(Value a, Value b, Value *result) {
+  if (IS_INT(a) && IS_INT(b)) {
+    if (AS_INT(b) == 0) return false;
+    // the one quotient that overflows.
+    if (AS_INT(b) != -1 || AS_INT(a) != INT64_MIN) {
+      *result = INT_VAL(AS_INT(a) / AS_INT(b));
+      return true;
+    }
+  }
+  *result = NUMBER_VAL(trunc(AS_DOUBLE(a) / AS_DOUBLE(b)));
+  return true;
+}
+
+bool remainderNumbers(Value a, Value b, Value *result) {
+  if (IS_INT(a) && IS_INT(b)) {
+    if (AS_INT(b) == 0) return false;
+    *result = INT_VAL(AS_INT(b) == -1 ? 0 : AS_INT(a) % AS_INT(b));
+    return true;
+  }
+  *result = NUMBER_VAL(fmod(AS_DOUBLE(a), AS_DOUBLE(b)));
+  return true;
 }
\ No newline at end of file
@@ -3,99 +3,307 @@
 #include <string.h>
 #include <time.h>
 
+#include "array.h"
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
+#include "io.h"
+#include "jit.h"
 #include "memory.h"
 #include "object.h"
+#include "output.h"
+#include "program.h"
+#include "register.h"
+#include "text.h"
 #include "value.h"
 #include "vm.h"
 
-VM vm;
+CLOX_THREAD_LOCAL VM *vm = NULL;
 
 static void clearStack() {
-  vm.sp = vm.stack;
-  vm.open_upvalues = NULL;
-  vm.frame_count = 0;
+  vm->sp = vm->stack;
+  vm->open_upvalues = NULL;
+  vm->frame_count = 0;
 }
 
 static void initNativeFunctions();
 
-void initVM() {
+VM *newVM() {
+  VM *instance = ALLOCATE(VM, 1);
+  switchVM(instance);
+
   clearStack();
-  vm.objects = NULL;
-  initTable(&vm.globals);
-  initTable(&vm.strings);
+  vm->objects = NULL;
+  vm->programs = NULL;
+  vm->program_count = 0;
+  vm->program_capacity = 0;
+  initTable(&vm->globals);
+  initTable(&vm->strings);
+  initOutput(&vm->output);
+  vm->init_string = copyString("init", 4);
   initNativeFunctions();
+
+  return instance;
 }
 
-void freeVM() {
+void freeVM(VM *instance) {
+  VM *previous = vm;
+  switchVM(instance);
+
+  flushOutput();
   freeObjects();
-  freeTable(&vm.globals);
-  freeTable(&vm.strings);
+  freeTable(&vm->globals);
+  freeTable(&vm->strings);
+  FREE_ARRAY(vm->programs, LoadedProgram, vm->program_capacity);
+  FREE(instance, VM);
+
+  switchVM(previous != instance ? previous : NULL);
 }
 
-static Value peek(int distance) { return vm.sp[-1 - distance]; }
+void switchVM(VM *instance) { vm = instance; }
 
-static void runtimeError(const char *format, ...) {
-  for (int i = 0; i < vm.frame_count; ++i) {
-    CallFrame *frame = &vm.frames[i];
+static Value peek(int distance) { return vm->sp[-1 - distance]; }
+
+static void reportError(const char *format, va_list args) {
+  // what the script printed before the error comes first.
+  flushOutput();
+  for (int i = 0; i < vm->frame_count; ++i) {
+    CallFrame *frame = &vm->frames[i];
     ObjFunction *function = frame->closure->function;
+    uint8_t *code = function->chunk.code;
+    int *lines = function->chunk.lines;
+    if (function->tier == TIER_REGISTERS) {
+      code = function->registers->code;
+      lines = function->registers->lines;
+    }
 
-    uint8_t offset = frame->ip - function->chunk.code - 1;
-    fprintf(stderr, "line %d in ", function->chunk.lines[offset]);
+    int offset = (int)(frame->ip - code - 1);
+    fprintf(stderr, "line %d in ", lines[offset]);
     fprintf(stderr, "%s\n",
             function->name != NULL ? function->name->chars : "script");
   }
 
-  va_list args;
-  va_start(args, format);
   fputs("error: ", stderr);
   vfprintf(stderr, format, args);
-  va_end(args);
   fputs("\n", stderr);
 
   clearStack();
 }
 
+static void runtimeError(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  reportError(format, args);
+  va_end(args);
+}
+
+bool nativeError(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  reportError(format, args);
+  va_end(args);
+  return false;
+}
+
 static bool isFalsy(Value value) {
   return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
 
+static inline Value lessThan(Value a, Value b) {
+  return BOOL_VAL(lessNumbers(a, b));
+}
+
+static inline Value greaterThan(Value a, Value b) {
+  return BOOL_VAL(lessNumbers(b, a));
+}
+
+static bool checkKey(Value key) {
+  if (isTableKey(key)) return true;
+
+  runtimeError("map key cannot be nil or NaN");
+  return false;
+}
+
+// the element of a list or an array that index refers to, or -1 after
+// reporting why there is none.
+static int indexElement(Value index, int length, const char *what) {
+  if (!IS_NUMERIC(index)) {
+    runtimeError("%s index must be a number", what);
+    return -1;
+  }
+
+  int element = elementIndex(index, length);
+  if (element < 0) runtimeError("%s index out of range", what);
+  return element;
+}
+
+// missing keys of maps read as nil.
+static bool getIndex(Value target, Value index, Value *value) {
+  if (IS_LIST(target)) {
+    ValueArray *items = &AS_LIST(target)->items;
+    int item = indexElement(index, items->size, "list");
+    if (item < 0) return false;
+    *value = items->values[item];
+    return true;
+  }
+  if (IS_MAP(target)) {
+    if (!checkKey(index)) return false;
+    if (!tableGetValue(&AS_MAP(target)->table, index, value)) *value = NIL_VAL;
+    return true;
+  }
+  if (IS_ARRAY(target)) {
+    ObjArray *array = AS_ARRAY(target);
+    int element = indexElement(index, array->length, "array");
+    if (element < 0) return false;
+    *value = arrayLoad(array, element);
+    return true;
+  }
+
+  runtimeError("can only index lists, maps and arrays");
+  return false;
+}
+
+static bool setIndex(Value target, Value index, Value value) {
+  if (IS_LIST(target)) {
+    ValueArray *items = &AS_LIST(target)->items;
+    int item = indexElement(index, items->size, "list");
+    if (item < 0) return false;
+    items->values[item] = value;
+    return true;
+  }
+  if (IS_MAP(target)) {
+    if (!checkKey(index)) return false;
+    tableSetValue(&AS_MAP(target)->table, index, value);
+    return true;
+  }
+  if (IS_ARRAY(target)) {
+    ObjArray *array = AS_ARRAY(target);
+    int element = indexElement(index, array->length, "array");
+    if (element < 0) return false;
+    if (!arrayStore(array, element, value)) {
+      runtimeError("value does not fit in %s elements",
+                   arrayKindName(array->kind));
+      return false;
+    }
+    return true;
+  }
+
+  runtimeError("can only index lists, maps and arrays");
+  return false;
+}
+
+// replaces the instance on top of the stack with its method name of klass,
+// bound to it.
+static bool bindMethod(ObjClass *klass, ObjString *name) {
+  Value method;
+  if (!tableGet(&klass->methods, name, &method)) {
+    runtimeError("undefined property '%s'", name->chars);
+    return false;
+  }
+
+  vm->sp[-1] = OBJ_VAL(newBoundMethod(vm->sp[-1], AS_CLOSURE(method)));
+  return true;
+}
+
+// refills the cache on a miss for the shape of instance. fields shadow
+// methods, and methods never change once the class is declared.
+static bool lookUpProperty(ObjInstance *instance, ObjString *name,
+                           PropertyCache *cache) {
+  if (instance->shape == cache->shape) return true;
+
+  cache->shape = instance->shape;
+  cache->slot = shapeSlot(instance->shape, name);
+  cache->transition = NULL;
+  cache->method = NULL;
+  if (cache->slot >= 0) return true;
+
+  Value method;
+  if (!tableGet(&instance->shape->klass->methods, name, &method)) {
+    cache->shape = NULL;
+    runtimeError("undefined property '%s'", name->chars);
+    return false;
+  }
+  cache->method = AS_CLOSURE(method);
+  return true;
+}
+
+static uint8_t *entryPoint(ObjFunction *function) {
+  return function->tier == TIER_REGISTERS ? function->registers->code
+                                          : function->chunk.code;
+}
+
 static bool call(ObjClosure *closure, uint8_t arg_count) {
   ObjFunction *function = closure->function;
   if (function->arity != arg_count) {
     runtimeError("expected %i arguments, got %i", function->arity, arg_count);
     return false;
-  } else if (vm.frame_count == CLOX_FRAMES_MAX) {
+  } else if (vm->frame_count == CLOX_FRAMES_MAX) {
     runtimeError("stack overflow");
     return false;
   }
 
-  CallFrame *frame = &vm.frames[vm.frame_count++];
+  CallFrame *frame = &vm->frames[vm->frame_count++];
   frame->closure = closure;
-  frame->ip = function->chunk.code;
-  frame->slots = vm.sp - arg_count - 1;
+  frame->ip = entryPoint(function);
+  frame->slots = vm->sp - arg_count - 1;
   return true;
 }
 
+static bool checkNativeArity(ObjNativeFn *nativeFn, uint8_t arg_count) {
+  if (!(nativeFn->flags & NATIVE_VARIADIC) && nativeFn->arity != arg_count) {
+    runtimeError("expected %i arguments, got %i", nativeFn->arity, arg_count);
+    return false;
+  }
+  return true;
+}
+
+static inline bool invokeNative(ObjNativeFn *nativeFn, int arg_count,
+                                Value *args, Value *result) {
+  if (nativeFn->host != NULL) {
+    return callHostNative(nativeFn, arg_count, args, result);
+  }
+  return nativeFn->function(arg_count, args, result);
+}
+
 static bool callNative(ObjNativeFn *nativeFn, uint8_t arg_count) {
-  Value *args = vm.sp - arg_count;
-  Value result = nativeFn->function(arg_count, args);
-  vm.sp = args - 1;
-  push(result);
+  if (!checkNativeArity(nativeFn, arg_count)) return false;
+
+  // the result goes straight into the callee slot.
+  Value *args = vm->sp - arg_count;
+  args[-1] = NIL_VAL;
+  if (!invokeNative(nativeFn, arg_count, args, &args[-1])) return false;
+  vm->sp = args;
   return true;
 }
 
 static bool callValue(Value callee, uint8_t arg_count) {
+  // closures are by far the most common callees, skip the type switch.
+  if (IS_CLOSURE(callee)) return call(AS_CLOSURE(callee), arg_count);
+
   if (IS_OBJ(callee)) {
     switch (AS_OBJ(callee)->type) {
-      case OBJ_CLOSURE: {
-        return call(AS_CLOSURE(callee), arg_count);
-      }
       case OBJ_NATIVE_FN: {
         return callNative(AS_NATIVE_FN(callee), arg_count);
       }
+      case OBJ_BOUND_METHOD: {
+        ObjBoundMethod *bound = AS_BOUND_METHOD(callee);
+        vm->sp[-arg_count - 1] = bound->receiver;
+        return call(bound->method, arg_count);
+      }
+      case OBJ_CLASS: {
+        // the instance takes the place of the class as the initializer's
+        // this.
+        ObjClass *klass = AS_CLASS(callee);
+        vm->sp[-arg_count - 1] = OBJ_VAL(newInstance(klass));
+        Value initializer;
+        if (tableGet(&klass->methods, vm->init_string, &initializer)) {
+          return call(AS_CLOSURE(initializer), arg_count);
+        } else if (arg_count != 0) {
+          runtimeError("expected 0 arguments, got %i", arg_count);
+          return false;
+        }
+        return true;
+      }
       default:
         break;
     }
@@ -105,9 +313,39 @@ static bool callValue(Value callee, uint8_t arg_count) {
   return false;
 }
 
+// calls the method name of the receiver below the arguments on top of the
+// stack, which stays in the callee slot as this. a field holding a callable
+// is called in its place.
+static bool invoke(ObjString *name, uint8_t arg_count, PropertyCache *cache) {
+  Value receiver = peek(arg_count);
+  if (!IS_INSTANCE(receiver)) {
+    runtimeError("only instances have methods");
+    return false;
+  }
+
+  ObjInstance *instance = AS_INSTANCE(receiver);
+  if (!lookUpProperty(instance, name, cache)) return false;
+  if (cache->method) return call(cache->method, arg_count);
+
+  Value field = instance->fields[cache->slot];
+  vm->sp[-arg_count - 1] = field;
+  return callValue(field, arg_count);
+}
+
+// calls the method name of superclass on the this below the arguments.
+static bool invokeSuper(ObjClass *superclass, ObjString *name,
+                        uint8_t arg_count) {
+  Value method;
+  if (!tableGet(&superclass->methods, name, &method)) {
+    runtimeError("undefined property '%s'", name->chars);
+    return false;
+  }
+  return call(AS_CLOSURE(method), arg_count);
+}
+
 static ObjUpvalue *captureUpvalue(Value *local) {
   ObjUpvalue *prev = NULL;
-  ObjUpvalue *upvalue = vm.open_upvalues;
+  ObjUpvalue *upvalue = vm->open_upvalues;
 
   while (upvalue != NULL && upvalue->location > local) {
     prev = upvalue;
@@ -122,47 +360,258 @@ static ObjUpvalue *captureUpvalue(Value *local) {
   if (prev != NULL) {
     prev->next = captured;
   } else {
-    vm.open_upvalues = captured;
+    vm->open_upvalues = captured;
   }
 
   return captured;
 }
 
+// fills the upvalues of a new closure from the capture pairs at ip, and
+// returns the end of the pairs.
+static uint8_t *captureUpvalues(ObjClosure *closure, CallFrame *frame,
+                                uint8_t *ip) {
+  for (int i = 0; i < closure->upvalue_count; ++i) {
+    CaptureKind kind = *ip++;
+    uint8_t index = *ip++;
+    switch (kind) {
+      case CAPTURE_UPVALUE:
+        closure->upvalues[i] = frame->closure->upvalues[index];
+        break;
+      case CAPTURE_LOCAL:
+        closure->upvalues[i] = captureUpvalue(&frame->slots[index]);
+        break;
+      case CAPTURE_COPY: {
+        if (!closure->copies) {
+          closure->copies = ALLOCATE(ObjUpvalue, closure->upvalue_count);
+        }
+        ObjUpvalue *copy = &closure->copies[i];
+        copy->obj.type = OBJ_UPVALUE;
+        copy->obj.next = NULL;
+        copy->closed = frame->slots[index];
+        copy->location = &copy->closed;
+        copy->next = NULL;
+        closure->upvalues[i] = copy;
+        break;
+      }
+    }
+  }
+  return ip;
+}
+
 static void closeUpvalue(Value *last) {
-  while (vm.open_upvalues != NULL && vm.open_upvalues->location >= last) {
-    ObjUpvalue *upvalue = vm.open_upvalues;
+  while (vm->open_upvalues != NULL && vm->open_upvalues->location >= last) {
+    ObjUpvalue *upvalue = vm->open_upvalues;
     upvalue->closed = *upvalue->location;
     upvalue->location = &upvalue->closed;
-    vm.open_upvalues = upvalue->next;
+    vm->open_upvalues = upvalue->next;
+  }
+}
+
+// replaces the frame with a call of the closure below the arguments on top
+// of the stack.
+static bool reuseFrame(CallFrame *frame, ObjClosure *closure,
+                       uint8_t arg_count) {
+  if (closure->function->arity != arg_count) {
+    runtimeError("expected %i arguments, got %i", closure->function->arity,
+                 arg_count);
+    return false;
+  }
+
+  closeUpvalue(frame->slots);
+  memmove(frame->slots, vm->sp - arg_count - 1,
+          sizeof(Value) * (arg_count + 1));
+  vm->sp = frame->slots + arg_count + 1;
+  frame->closure = closure;
+  frame->ip = entryPoint(closure->function);
+  return true;
+}
+
+// calls a global with the arguments on top of the stack and no callee slot
+// below them. natives leave their result in place of the arguments. a call
+// in tail position passes its frame, which a closure then reuses.
+static bool callGlobal(ObjString *name, uint8_t arg_count, CallFrame *tail) {
+  Value callee;
+  if (!tableGet(&vm->globals, name, &callee)) {
+    runtimeError("undefined variable '%s'", name->chars);
+    return false;
+  }
+
+  Value *args = vm->sp - arg_count;
+  if (IS_NATIVE_FN(callee)) {
+    ObjNativeFn *nativeFn = AS_NATIVE_FN(callee);
+    if (!checkNativeArity(nativeFn, arg_count)) return false;
+
+    Value result = NIL_VAL;
+    if (!invokeNative(nativeFn, arg_count, args, &result)) return false;
+    args[0] = result;
+    vm->sp = args + 1;
+    return true;
+  }
+
+  // the global no longer holds a native, slide the callee under the
+  // arguments and take the generic path.
+  memmove(args + 1, args, sizeof(Value) * arg_count);
+  *args = callee;
+  ++vm->sp;
+  if (tail && IS_CLOSURE(callee)) {
+    return reuseFrame(tail, AS_CLOSURE(callee), arg_count);
   }
+  return callValue(callee, arg_count);
+}
+
+static InterpretResult runRegisters();
+static InterpretResult runFrame();
+
+// counts a call or a loop iteration of a warming function and compiles it
+// once it is hot. functions the jit cannot compile stay on the stack.
+static void warmUp(ObjFunction *function) {
+  if (++function->hotness < CLOX_JIT_THRESHOLD) return;
+
+  function->jit = compileNative(function);
+  function->tier = function->jit ? TIER_NATIVE : TIER_STACK;
 }
 
 static InterpretResult run() {
-  CallFrame *frame = &vm.frames[vm.frame_count - 1];
+  // run is reentered when natives call back into lox, so only run until the
+  // frame it was entered with returns.
+  int exit_frame_count = vm->frame_count - 1;
+  CallFrame *frame = &vm->frames[vm->frame_count - 1];
 
 #define READ_BYTE() (*frame->ip++)
 #define READ_SHORT() \
   ((uint16_t)(frame->ip += 2, (frame->ip[-2] << 8) | frame->ip[-1]))
 #define READ_CONSTANT() \
   (frame->closure->function->chunk.constants.values[READ_BYTE()])
+#define READ_LONG()                                               \
+  (frame->ip += 4, (uint32_t)frame->ip[-4] << 24 |                \
+                       frame->ip[-3] << 16 | frame->ip[-2] << 8 | \
+                       frame->ip[-1])
 #define READ_STRING() AS_STRING(READ_CONSTANT())
-#define BINARY_OP(value_type, op)                     \
+#define READ_CACHE() (&frame->closure->function->caches[READ_SHORT()])
+// runs generic arithmetic or a comparison, and quickens it into the int
+// form when ints gave an exact result, or the double form when either
+// operand is a double.
+#define BINARY_OP(operation, int_op, double_op) \
+  do {                                          \
+    Value a = vm->sp[-2];                       \
+    Value b = vm->sp[-1];                       \
+    if (!IS_NUMERIC(a) || !IS_NUMERIC(b)) {     \
+      runtimeError("operands must be numbers"); \
+      return INTERPRET_RUNTIME_ERROR;           \
+    }                                           \
+                                                \
+    Value result = operation(a, b);             \
+    if (!IS_INT(a) || !IS_INT(b)) {             \
+      QUICKEN(double_op);                       \
+    } else if (!IS_NUMBER(result)) {            \
+      QUICKEN(int_op);                          \
+    }                                           \
+    vm->sp[-2] = result;                        \
+    --vm->sp;                                   \
+  } while (0)
+// the int forms of these report division by zero.
+#define DIVISION_OP(operation)                  \
+  do {                                          \
+    Value a = vm->sp[-2];                       \
+    Value b = vm->sp[-1];                       \
+    if (!IS_NUMERIC(a) || !IS_NUMERIC(b)) {     \
+      runtimeError("operands must be numbers"); \
+      return INTERPRET_RUNTIME_ERROR;           \
+    }                                           \
+    if (!operation(a, b, &vm->sp[-2])) {        \
+      runtimeError("integer division by zero"); \
+      return INTERPRET_RUNTIME_ERROR;           \
+    }                                           \
+    --vm->sp;                                   \
+  } while (0)
+// rewrites the instruction just read into the form specialized for the
+// operands it saw. code borrowed from a program is shared and left alone.
+#define QUICKEN(op)                                                    \
+  do {                                                                 \
+    if (frame->closure->function->program == NULL) frame->ip[-1] = op; \
+  } while (0)
+// turns a quickened instruction back into its generic form and runs that.
+#define DEQUICKEN(op)   \
+  do {                  \
+    frame->ip[-1] = op; \
+    --frame->ip;        \
+  } while (0)
+// the double forms take an int operand too, as long as the other one is a
+// double.
+#define NUMBER_OP(value_type, op, generic)            \
   do {                                                \
-    if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
-      runtimeError("operands must be numbers");       \
-      return INTERPRET_RUNTIME_ERROR;                 \
+    Value *a = &vm->sp[-2];                           \
+    Value b = vm->sp[-1];                             \
+    if (IS_NUMBER(*a) && IS_NUMBER(b)) {              \
+      *a = value_type(AS_NUMBER(*a) op AS_NUMBER(b)); \
+      --vm->sp;                                       \
+    } else if (IS_NUMERIC(*a) && IS_NUMERIC(b) &&     \
+               (IS_NUMBER(*a) || IS_NUMBER(b))) {     \
+      *a = value_type(AS_DOUBLE(*a) op AS_DOUBLE(b)); \
+      --vm->sp;                                       \
+    } else {                                          \
+      DEQUICKEN(generic);                             \
     }                                                 \
-                                                      \
-    double b = AS_NUMBER(pop());                      \
-    double a = AS_NUMBER(pop());                      \
-    push(value_type(a op b));                         \
+  } while (0)
+// the int forms also turn back when the result would overflow.
+#define INT_OP(overflows, generic)                   \
+  do {                                               \
+    Value *a = &vm->sp[-2];                          \
+    Value b = vm->sp[-1];                            \
+    int64_t result;                                  \
+    if (!IS_INT(*a) || !IS_INT(b) ||                 \
+        overflows(AS_INT(*a), AS_INT(b), &result)) { \
+      DEQUICKEN(generic);                            \
+    } else {                                         \
+      *a = INT_VAL(result);                          \
+      --vm->sp;                                      \
+    }                                                \
+  } while (0)
+#define INT_COMPARE(op, generic)              \
+  do {                                        \
+    Value *a = &vm->sp[-2];                   \
+    Value b = vm->sp[-1];                     \
+    if (!IS_INT(*a) || !IS_INT(b)) {          \
+      DEQUICKEN(generic);                     \
+    } else {                                  \
+      *a = BOOL_VAL(AS_INT(*a) op AS_INT(b)); \
+      --vm->sp;                               \
+    }                                         \
+  } while (0)
+// a frame just pushed or reused may run in another tier, which runs it until
+// the frame returns.
+#define ENTER_FRAME()                                                 \
+  do {                                                                \
+    frame = &vm->frames[vm->frame_count - 1];                         \
+    if (frame->closure->function->tier != TIER_STACK) {               \
+      if (runFrame() != INTERPRET_OK) return INTERPRET_RUNTIME_ERROR; \
+      if (vm->frame_count == exit_frame_count) return INTERPRET_OK;   \
+      frame = &vm->frames[vm->frame_count - 1];                       \
+    }                                                                 \
+  } while (0)
+// loops count towards the hotness of a warming function, and a jitted one
+// goes on in machine code from the top of the loop.
+#define HOT_LOOP()                                                      \
+  do {                                                                  \
+    ObjFunction *function = frame->closure->function;                   \
+    if (function->tier == TIER_WARMING) warmUp(function);               \
+    if (function->tier == TIER_NATIVE) {                                \
+      int offset = (int)(frame->ip - function->chunk.code);             \
+      JitExit exit = enterNative(function->jit, frame, offset);         \
+      if (exit == JIT_ERROR) return INTERPRET_RUNTIME_ERROR;            \
+      if (exit == JIT_RETURNED) {                                       \
+        if (vm->frame_count == exit_frame_count) return INTERPRET_OK;   \
+        frame = &vm->frames[vm->frame_count - 1];                       \
+      }                                                                 \
+    }                                                                   \
   } while (0)
 
   for (;;) {
 #ifdef CLOX_DEBUG_TRACE_EXECUTION
-    if (vm.stack != vm.sp) {
+    flushOutput();
+    if (vm->stack != vm->sp) {
       printf("        ");
-      for (Value *slot = vm.stack; slot < vm.sp; ++slot) {
+      for (Value *slot = vm->stack; slot < vm->sp; ++slot) {
         printf("[ ");
         printValue(*slot);
         printf(" ]");
@@ -181,10 +630,11 @@ static InterpretResult run() {
         break;
       }
       case OP_NEGATE: {
-        if (!IS_NUMBER(peek(0))) {
+        if (!IS_NUMERIC(peek(0))) {
           runtimeError("operand must be a number");
+          return INTERPRET_RUNTIME_ERROR;
         }
-        push(NUMBER_VAL(-AS_NUMBER(pop())));
+        vm->sp[-1] = negateNumber(vm->sp[-1]);
         break;
       }
       case OP_NIL:
@@ -204,6 +654,13 @@ static InterpretResult run() {
         push(frame->slots[slot]);
         break;
       }
+      case OP_GET_LOCAL_GET_LOCAL: {
+        uint8_t first = READ_BYTE();
+        uint8_t second = READ_BYTE();
+        push(frame->slots[first]);
+        push(frame->slots[second]);
+        break;
+      }
       case OP_SET_LOCAL: {
         uint8_t slot = READ_BYTE();
         frame->slots[slot] = peek(0);
@@ -223,14 +680,14 @@ static InterpretResult run() {
       }
       case OP_DEF_GLOBAL: {
         ObjString *name = READ_STRING();
-        tableSet(&vm.globals, name, peek(0));
+        tableSet(&vm->globals, name, peek(0));
         pop();
         break;
       }
       case OP_GET_GLOBAL: {
         ObjString *name = READ_STRING();
         Value value;
-        if (!tableGet(&vm.globals, name, &value)) {
+        if (!tableGet(&vm->globals, name, &value)) {
           runtimeError("undefined variable '%s'", name->chars);
           return INTERPRET_RUNTIME_ERROR;
         }
@@ -239,7 +696,7 @@ static InterpretResult run() {
       }
       case OP_SET_GLOBAL: {
         ObjString *name = READ_STRING();
-        if (tableSet(&vm.globals, name, peek(0))) {
+        if (tableSet(&vm->globals, name, peek(0))) {
           runtimeError("undefined variable '%s'", name->chars);
           return INTERPRET_RUNTIME_ERROR;
         }
@@ -252,18 +709,19 @@ static InterpretResult run() {
         break;
       }
       case OP_GREATER:
-        BINARY_OP(BOOL_VAL, >);
+        BINARY_OP(greaterThan, OP_GREATER_INT, OP_GREATER_NUMBER);
         break;
       case OP_LESS:
-        BINARY_OP(BOOL_VAL, <);
+        BINARY_OP(lessThan, OP_LESS_INT, OP_LESS_NUMBER);
         break;
       case OP_ADD: {
         if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
           ObjString *b = AS_STRING(pop());
           ObjString *a = AS_STRING(pop());
           push(OBJ_VAL(stringConcat(a, b)));
-        } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
-          BINARY_OP(NUMBER_VAL, +);
+          QUICKEN(OP_ADD_STRING);
+        } else if (IS_NUMERIC(peek(0)) && IS_NUMERIC(peek(1))) {
+          BINARY_OP(addNumbers, OP_ADD_INT, OP_ADD_NUMBER);
         } else {
           runtimeError("operands must be two numbers or two strings");
           return INTERPRET_RUNTIME_ERROR;
@@ -271,14 +729,82 @@ static InterpretResult run() {
         break;
       }
       case OP_SUB:
-        BINARY_OP(NUMBER_VAL, -);
+        BINARY_OP(subtractNumbers, OP_SUB_INT, OP_SUB_NUMBER);
         break;
       case OP_MUL:
-        BINARY_OP(NUMBER_VAL, *);
+        BINARY_OP(multiplyNumbers, OP_MUL_INT, OP_MUL_NUMBER);
         break;
       case OP_DIV:
-        BINARY_OP(NUMBER_VAL, /);
+        // the quotient is a double even for ints, so there is no int form.
+        BINARY_OP(divideNumbers, OP_DIV, OP_DIV_NUMBER);
+        break;
+      case OP_MOD:
+        DIVISION_OP(remainderNumbers);
+        break;
+      case OP_QUOTIENT:
+        DIVISION_OP(quotientNumbers);
+        break;
+      case OP_ADD_NUMBER:
+        NUMBER_OP(NUMBER_VAL, +, OP_ADD);
+        break;
+      case OP_ADD_STRING: {
+        if (!IS_STRING(peek(0)) || !IS_STRING(peek(1))) {
+          DEQUICKEN(OP_ADD);
+          break;
+        }
+        ObjString *b = AS_STRING(pop());
+        ObjString *a = AS_STRING(pop());
+        push(OBJ_VAL(stringConcat(a, b)));
+        break;
+      }
+      case OP_SUB_NUMBER:
+        NUMBER_OP(NUMBER_VAL, -, OP_SUB);
+        break;
+      case OP_MUL_NUMBER:
+        NUMBER_OP(NUMBER_VAL, *, OP_MUL);
+        break;
+      case OP_DIV_NUMBER:
+        NUMBER_OP(NUMBER_VAL, /, OP_DIV);
+        break;
+      case OP_GREATER_NUMBER:
+        NUMBER_OP(BOOL_VAL, >, OP_GREATER);
+        break;
+      case OP_LESS_NUMBER:
+        NUMBER_OP(BOOL_VAL, <, OP_LESS);
+        break;
+      case OP_ADD_INT:
+        INT_OP(__builtin_add_overflow, OP_ADD);
+        break;
+      case OP_SUB_INT:
+        INT_OP(__builtin_sub_overflow, OP_SUB);
+        break;
+      case OP_MUL_INT:
+        INT_OP(__builtin_mul_overflow, OP_MUL);
         break;
+      case OP_GREATER_INT:
+        INT_COMPARE(>, OP_GREATER);
+        break;
+      case OP_LESS_INT:
+        INT_COMPARE(<, OP_LESS);
+        break;
+      case OP_ADD_LOCAL_CONST: {
+        Value *local = &frame->slots[READ_BYTE()];
+        Value constant = READ_CONSTANT();
+        int64_t sum;
+        if (IS_INT(*local) && IS_INT(constant) &&
+            !__builtin_add_overflow(AS_INT(*local), AS_INT(constant), &sum)) {
+          *local = INT_VAL(sum);
+        } else if (IS_NUMERIC(*local) && IS_NUMERIC(constant)) {
+          *local = addNumbers(*local, constant);
+        } else if (IS_STRING(*local) && IS_STRING(constant)) {
+          *local =
+              OBJ_VAL(stringConcat(AS_STRING(*local), AS_STRING(constant)));
+        } else {
+          runtimeError("operands must be two numbers or two strings");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
       case OP_NOT:
         push(BOOL_VAL(isFalsy(pop())));
         break;
@@ -292,130 +818,967 @@ static InterpretResult run() {
         if (isFalsy(peek(0))) frame->ip += offset;
         break;
       }
+      case OP_JUMP_IF_TRUE: {
+        uint16_t offset = READ_SHORT();
+        if (!isFalsy(peek(0))) frame->ip += offset;
+        break;
+      }
       case OP_LOOP: {
         uint16_t offset = READ_SHORT();
         frame->ip -= offset;
+        HOT_LOOP();
         break;
       }
-      case OP_CALL: {
-        uint8_t arg_count = READ_BYTE();
-        if (!callValue(peek(arg_count), arg_count))
+      case OP_LOCAL_LESS_CONST_JUMP: {
+        Value local = frame->slots[READ_BYTE()];
+        Value constant = READ_CONSTANT();
+        uint16_t offset = READ_SHORT();
+        if (IS_INT(local) && IS_INT(constant)) {
+          if (!(AS_INT(local) < AS_INT(constant))) frame->ip += offset;
+          break;
+        }
+        if (!IS_NUMERIC(local) || !IS_NUMERIC(constant)) {
+          runtimeError("operands must be numbers");
           return INTERPRET_RUNTIME_ERROR;
-
-        frame = &vm.frames[vm.frame_count - 1];
+        }
+        if (!lessNumbers(local, constant)) frame->ip += offset;
         break;
       }
-      case OP_CLOSE_UPVALUE: {
-        closeUpvalue(vm.sp - 1);
-        pop();
+      case OP_JUMP_LONG: {
+        uint32_t offset = READ_LONG();
+        frame->ip += offset;
         break;
       }
-      case OP_CLOSURE: {
-        ObjFunction *function = AS_FUNCTION(READ_CONSTANT());
-        ObjClosure *closure = newClosure(function);
-        push(OBJ_VAL(closure));
-        for (int i = 0; i < closure->upvalue_count; ++i) {
-          uint8_t is_local = READ_BYTE();
-          uint8_t index = READ_BYTE();
-          ObjUpvalue *upvalue;
-          if (is_local) {
-            upvalue = captureUpvalue(&frame->slots[index]);
-          } else {
-            upvalue = frame->closure->upvalues[index];
-          }
-          closure->upvalues[i] = upvalue;
+      case OP_JUMP_IF_FALSE_LONG: {
+        uint32_t offset = READ_LONG();
+        if (isFalsy(peek(0))) frame->ip += offset;
+        break;
+      }
+      case OP_JUMP_IF_TRUE_LONG: {
+        uint32_t offset = READ_LONG();
+        if (!isFalsy(peek(0))) frame->ip += offset;
+        break;
+      }
+      case OP_LOOP_LONG: {
+        uint32_t offset = READ_LONG();
+        frame->ip -= offset;
+        HOT_LOOP();
+        break;
+      }
+      case OP_LOCAL_LESS_CONST_JUMP_LONG: {
+        Value local = frame->slots[READ_BYTE()];
+        Value constant = READ_CONSTANT();
+        uint32_t offset = READ_LONG();
+        if (IS_INT(local) && IS_INT(constant)) {
+          if (!(AS_INT(local) < AS_INT(constant))) frame->ip += offset;
+          break;
+        }
+        if (!IS_NUMERIC(local) || !IS_NUMERIC(constant)) {
+          runtimeError("operands must be numbers");
+          return INTERPRET_RUNTIME_ERROR;
         }
+        if (!lessNumbers(local, constant)) frame->ip += offset;
         break;
       }
-      case OP_RETURN: {
-        Value ret_value = pop();
-        closeUpvalue(frame->slots);
+      case OP_CALL_0:
+      case OP_CALL_1:
+      case OP_CALL_2:
+      case OP_CALL_3: {
+        uint8_t arg_count = op - OP_CALL_0;
+        Value callee = peek(arg_count);
 
-        --vm.frame_count;
-        if (vm.frame_count == 0) {
-          pop();
-          return INTERPRET_OK;
+        // push the frame of a well-formed closure call in place, anything
+        // else goes through callValue which reports the errors.
+        if (IS_CLOSURE(callee) &&
+            AS_CLOSURE(callee)->function->arity == arg_count &&
+            AS_CLOSURE(callee)->function->tier == TIER_STACK &&
+            vm->frame_count < CLOX_FRAMES_MAX) {
+          ObjClosure *closure = AS_CLOSURE(callee);
+          frame = &vm->frames[vm->frame_count++];
+          frame->closure = closure;
+          frame->ip = closure->function->chunk.code;
+          frame->slots = vm->sp - arg_count - 1;
+          break;
         }
 
-        vm.sp = frame->slots;
-        push(ret_value);
-        frame = &vm.frames[vm.frame_count - 1];
+        if (!callValue(callee, arg_count)) return INTERPRET_RUNTIME_ERROR;
+
+        ENTER_FRAME();
         break;
       }
-    }
-  }
+      case OP_CALL: {
+        uint8_t arg_count = READ_BYTE();
+        if (!callValue(peek(arg_count), arg_count))
+          return INTERPRET_RUNTIME_ERROR;
 
-#undef READ_BYTE
-#undef READ_SHORT
-#undef READ_CONSTANT
-#undef READ_STRING
-#undef BINARY_OP
-}
+        ENTER_FRAME();
+        break;
+      }
+      case OP_TAIL_CALL_0:
+      case OP_TAIL_CALL_1:
+      case OP_TAIL_CALL_2:
+      case OP_TAIL_CALL_3:
+      case OP_TAIL_CALL: {
+        uint8_t arg_count =
+            op == OP_TAIL_CALL ? READ_BYTE() : op - OP_TAIL_CALL_0;
+        Value callee = peek(arg_count);
+        if (!IS_CLOSURE(callee)) {
+          // no frame to reuse, the OP_RETURN that follows returns the result.
+          if (!callValue(callee, arg_count)) return INTERPRET_RUNTIME_ERROR;
+          ENTER_FRAME();
+          break;
+        }
 
-static void defineNativeFn(const char *name, NativeFn fn) {
-  push(OBJ_VAL(copyString(name, strlen(name))));
-  push(OBJ_VAL(newNativeFn(fn)));
-  tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
-  pop();
-  pop();
-}
+        if (!reuseFrame(frame, AS_CLOSURE(callee), arg_count)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        // only register code needs another loop. jitted functions go on
+        // here, entering their machine code at the next loop, since nesting
+        // a native frame per tail call would grow the c stack without bound.
+        if (frame->closure->function->tier == TIER_REGISTERS) ENTER_FRAME();
+        break;
+      }
+      case OP_CALL_NATIVE: {
+        ObjString *name = READ_STRING();
+        uint8_t arg_count = READ_BYTE();
+        if (!callGlobal(name, arg_count, NULL)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
 
-static Value nativeClock(int arg_count, Value *args) {
-  return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
-}
+        ENTER_FRAME();
+        break;
+      }
+      case OP_TAIL_CALL_NATIVE: {
+        // a native leaves its result for the OP_RETURN that follows, a
+        // closure reuses the frame as after OP_TAIL_CALL.
+        ObjString *name = READ_STRING();
+        uint8_t arg_count = READ_BYTE();
+        int frame_count = vm->frame_count;
+        if (!callGlobal(name, arg_count, frame)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
 
-static Value nativePrintln(int arg_count, Value *args) {
-  for (int i = 0; i < arg_count; ++i) {
-    Value value = args[i];
-    switch (value.type) {
-      case VAL_BOOL:
-        printf("%s", AS_BOOL(value) ? "true" : "false");
+        // a reused frame goes on in this loop as after OP_TAIL_CALL.
+        if (vm->frame_count != frame_count ||
+            frame->closure->function->tier == TIER_REGISTERS) {
+          ENTER_FRAME();
+        }
         break;
-      case VAL_NIL:
-        printf("nil");
+      }
+      case OP_BUILD_LIST:
+        jitBuildList(READ_BYTE());
         break;
-      case VAL_NUMBER:
-        printf("%g", AS_NUMBER(value));
+      case OP_BUILD_MAP:
+        if (!jitBuildMap(READ_BYTE())) return INTERPRET_RUNTIME_ERROR;
         break;
-      case VAL_OBJ:
-        printObject(value);
-    }
-
-    if (i != arg_count - 1) {
-      putchar(' ');
-    }
-  }
-  putchar('\n');
+      case OP_INDEX_GET: {
+        Value value;
+        if (!getIndex(peek(1), peek(0), &value)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
 
-  return NIL_VAL;
-}
+        pop();
+        vm->sp[-1] = value;
+        break;
+      }
+      case OP_INDEX_SET: {
+        if (!setIndex(peek(2), peek(1), peek(0))) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
 
-static void initNativeFunctions() {
-  defineNativeFn("clock", nativeClock);
-  defineNativeFn("println", nativePrintln);
-}
+        // the assignment evaluates to the value assigned.
+        Value value = pop();
+        pop();
+        vm->sp[-1] = value;
+        break;
+      }
+      case OP_GET_PROPERTY: {
+        ObjString *name = READ_STRING();
+        PropertyCache *cache = READ_CACHE();
+        Value receiver = peek(0);
+        if (IS_INSTANCE(receiver) &&
+            AS_INSTANCE(receiver)->shape == cache->shape && !cache->method) {
+          vm->sp[-1] = AS_INSTANCE(receiver)->fields[cache->slot];
+          break;
+        }
 
-InterpretResult interpret(const char *source) {
-  ObjFunction *function = compile(source);
-  if (!function) {
-    return INTERPRET_COMPILE_ERROR;
-  }
+        if (!jitGetProperty(name, cache)) return INTERPRET_RUNTIME_ERROR;
+        break;
+      }
+      case OP_SET_PROPERTY: {
+        ObjString *name = READ_STRING();
+        PropertyCache *cache = READ_CACHE();
+        Value receiver = peek(1);
+        if (IS_INSTANCE(receiver) &&
+            AS_INSTANCE(receiver)->shape == cache->shape &&
+            !cache->transition) {
+          Value value = pop();
+          AS_INSTANCE(receiver)->fields[cache->slot] = value;
+          vm->sp[-1] = value;
+          break;
+        }
 
-  push(OBJ_VAL(function));
-  ObjClosure *closure = newClosure(function);
-  pop();
-  push(OBJ_VAL(closure));
-  call(closure, 0);
+        if (!jitSetProperty(name, cache)) return INTERPRET_RUNTIME_ERROR;
+        break;
+      }
+      case OP_GET_SUPER: {
+        ObjString *name = READ_STRING();
+        ObjClass *superclass = AS_CLASS(pop());
+        if (!bindMethod(superclass, name)) return INTERPRET_RUNTIME_ERROR;
+        break;
+      }
+      case OP_INVOKE: {
+        ObjString *name = READ_STRING();
+        uint8_t arg_count = READ_BYTE();
+        PropertyCache *cache = READ_CACHE();
+        if (!invoke(name, arg_count, cache)) return INTERPRET_RUNTIME_ERROR;
+
+        ENTER_FRAME();
+        break;
+      }
+      case OP_SUPER_INVOKE: {
+        ObjString *name = READ_STRING();
+        uint8_t arg_count = READ_BYTE();
+        ObjClass *superclass = AS_CLASS(pop());
+        if (!invokeSuper(superclass, name, arg_count)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        ENTER_FRAME();
+        break;
+      }
+      case OP_CLOSE_UPVALUE: {
+        closeUpvalue(vm->sp - 1);
+        pop();
+        break;
+      }
+      case OP_CLOSURE:
+        jitClosure(frame);
+        break;
+      case OP_RETURN: {
+        Value ret_value = pop();
+        closeUpvalue(frame->slots);
+
+        --vm->frame_count;
+        vm->sp = frame->slots;
+        push(ret_value);
+        if (vm->frame_count == exit_frame_count) return INTERPRET_OK;
+
+        frame = &vm->frames[vm->frame_count - 1];
+        break;
+      }
+      case OP_CLASS:
+        push(OBJ_VAL(newClass(READ_STRING())));
+        break;
+      case OP_INHERIT: {
+        Value superclass = peek(1);
+        if (!IS_CLASS(superclass)) {
+          runtimeError("superclass must be a class");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        // methods are copied down, so lookups never walk the hierarchy.
+        ObjClass *subclass = AS_CLASS(pop());
+        tableUpdate(&subclass->methods, &AS_CLASS(superclass)->methods);
+        break;
+      }
+      case OP_METHOD: {
+        ObjString *name = READ_STRING();
+        tableSet(&AS_CLASS(peek(1))->methods, name, peek(0));
+        pop();
+        break;
+      }
+    }
+  }
 
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef READ_LONG
+#undef READ_STRING
+#undef READ_CACHE
+#undef BINARY_OP
+#undef DIVISION_OP
+#undef QUICKEN
+#undef DEQUICKEN
+#undef NUMBER_OP
+#undef INT_OP
+#undef INT_COMPARE
+#undef ENTER_FRAME
+#undef HOT_LOOP
+}
+
+static bool addValues(Value a, Value b, Value *result) {
+  if (IS_NUMERIC(a) && IS_NUMERIC(b)) {
+    *result = addNumbers(a, b);
+  } else if (IS_STRING(a) && IS_STRING(b)) {
+    *result = OBJ_VAL(stringConcat(AS_STRING(a), AS_STRING(b)));
+  } else {
+    runtimeError("operands must be two numbers or two strings");
+    return false;
+  }
+  return true;
+}
+
+// the register counterpart of run. registers are the slots of the frame, so
+// calls only have to move the stack pointer above the arguments.
+static InterpretResult runRegisters() {
+  int exit_frame_count = vm->frame_count - 1;
+  CallFrame *frame = &vm->frames[vm->frame_count - 1];
+
+#define READ_BYTE() (*frame->ip++)
+#define READ_SHORT() \
+  ((uint16_t)(frame->ip += 2, (frame->ip[-2] << 8) | frame->ip[-1]))
+#define READ_CONSTANT() \
+  (frame->closure->function->chunk.constants.values[READ_BYTE()])
+#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define REGISTER() (frame->slots[READ_BYTE()])
+#define BINARY_OP(operation, read_right)        \
+  do {                                          \
+    Value *dst = &REGISTER();                   \
+    Value a = REGISTER();                       \
+    Value b = read_right();                     \
+    if (!IS_NUMERIC(a) || !IS_NUMERIC(b)) {     \
+      runtimeError("operands must be numbers"); \
+      return INTERPRET_RUNTIME_ERROR;           \
+    }                                           \
+    *dst = operation(a, b);                     \
+  } while (0)
+#define COMPARE_JUMP(compare, read_right)             \
+  do {                                                \
+    Value a = REGISTER();                             \
+    Value b = read_right();                           \
+    uint16_t offset = READ_SHORT();                   \
+    if (!IS_NUMERIC(a) || !IS_NUMERIC(b)) {           \
+      runtimeError("operands must be numbers");       \
+      return INTERPRET_RUNTIME_ERROR;                 \
+    }                                                 \
+    if (!AS_BOOL(compare(a, b))) frame->ip += offset; \
+  } while (0)
+#define ENTER_FRAME()                                                 \
+  do {                                                                \
+    frame = &vm->frames[vm->frame_count - 1];                         \
+    if (frame->closure->function->tier != TIER_REGISTERS) {           \
+      if (runFrame() != INTERPRET_OK) return INTERPRET_RUNTIME_ERROR; \
+      if (vm->frame_count == exit_frame_count) return INTERPRET_OK;   \
+      frame = &vm->frames[vm->frame_count - 1];                       \
+    }                                                                 \
+  } while (0)
+
+  for (;;) {
+#ifdef CLOX_DEBUG_TRACE_EXECUTION
+    disassembleRegisterOp(
+        frame->closure->function,
+        (int)(frame->ip - frame->closure->function->registers->code));
+#endif
+
+    RegisterOp op = READ_BYTE();
+    switch (op) {
+      case REG_MOVE: {
+        Value *dst = &REGISTER();
+        *dst = REGISTER();
+        break;
+      }
+      case REG_CONSTANT: {
+        Value *dst = &REGISTER();
+        *dst = READ_CONSTANT();
+        break;
+      }
+      case REG_NIL:
+        REGISTER() = NIL_VAL;
+        break;
+      case REG_TRUE:
+        REGISTER() = BOOL_VAL(true);
+        break;
+      case REG_FALSE:
+        REGISTER() = BOOL_VAL(false);
+        break;
+      case REG_GET_UPVALUE: {
+        Value *dst = &REGISTER();
+        *dst = *frame->closure->upvalues[READ_BYTE()]->location;
+        break;
+      }
+      case REG_SET_UPVALUE: {
+        ObjUpvalue *upvalue = frame->closure->upvalues[READ_BYTE()];
+        *upvalue->location = REGISTER();
+        break;
+      }
+      case REG_DEF_GLOBAL: {
+        ObjString *name = READ_STRING();
+        tableSet(&vm->globals, name, REGISTER());
+        break;
+      }
+      case REG_GET_GLOBAL: {
+        Value *dst = &REGISTER();
+        ObjString *name = READ_STRING();
+        if (!tableGet(&vm->globals, name, dst)) {
+          runtimeError("undefined variable '%s'", name->chars);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case REG_SET_GLOBAL: {
+        ObjString *name = READ_STRING();
+        if (tableSet(&vm->globals, name, REGISTER())) {
+          runtimeError("undefined variable '%s'", name->chars);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case REG_NOT: {
+        Value *dst = &REGISTER();
+        *dst = BOOL_VAL(isFalsy(REGISTER()));
+        break;
+      }
+      case REG_NEGATE: {
+        Value *dst = &REGISTER();
+        Value value = REGISTER();
+        if (!IS_NUMERIC(value)) {
+          runtimeError("operand must be a number");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        *dst = negateNumber(value);
+        break;
+      }
+      case REG_EQUAL: {
+        Value *dst = &REGISTER();
+        Value a = REGISTER();
+        *dst = BOOL_VAL(valuesEqual(a, REGISTER()));
+        break;
+      }
+      case REG_EQUAL_K: {
+        Value *dst = &REGISTER();
+        Value a = REGISTER();
+        *dst = BOOL_VAL(valuesEqual(a, READ_CONSTANT()));
+        break;
+      }
+      case REG_GREATER:
+        BINARY_OP(greaterThan, REGISTER);
+        break;
+      case REG_GREATER_K:
+        BINARY_OP(greaterThan, READ_CONSTANT);
+        break;
+      case REG_LESS:
+        BINARY_OP(lessThan, REGISTER);
+        break;
+      case REG_LESS_K:
+        BINARY_OP(lessThan, READ_CONSTANT);
+        break;
+      case REG_ADD: {
+        Value *dst = &REGISTER();
+        Value a = REGISTER();
+        if (!addValues(a, REGISTER(), dst)) return INTERPRET_RUNTIME_ERROR;
+        break;
+      }
+      case REG_ADD_K: {
+        Value *dst = &REGISTER();
+        Value a = REGISTER();
+        if (!addValues(a, READ_CONSTANT(), dst)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case REG_SUB:
+        BINARY_OP(subtractNumbers, REGISTER);
+        break;
+      case REG_SUB_K:
+        BINARY_OP(subtractNumbers, READ_CONSTANT);
+        break;
+      case REG_MUL:
+        BINARY_OP(multiplyNumbers, REGISTER);
+        break;
+      case REG_MUL_K:
+        BINARY_OP(multiplyNumbers, READ_CONSTANT);
+        break;
+      case REG_DIV:
+        BINARY_OP(divideNumbers, REGISTER);
+        break;
+      case REG_DIV_K:
+        BINARY_OP(divideNumbers, READ_CONSTANT);
+        break;
+      case REG_JUMP: {
+        uint16_t offset = READ_SHORT();
+        frame->ip += offset;
+        break;
+      }
+      case REG_LOOP: {
+        uint16_t offset = READ_SHORT();
+        frame->ip -= offset;
+        break;
+      }
+      case REG_JUMP_IF_FALSE: {
+        Value condition = REGISTER();
+        uint16_t offset = READ_SHORT();
+        if (isFalsy(condition)) frame->ip += offset;
+        break;
+      }
+      case REG_JUMP_IF_TRUE: {
+        Value condition = REGISTER();
+        uint16_t offset = READ_SHORT();
+        if (!isFalsy(condition)) frame->ip += offset;
+        break;
+      }
+      case REG_JUMP_IF_NOT_EQUAL: {
+        Value a = REGISTER();
+        Value b = REGISTER();
+        uint16_t offset = READ_SHORT();
+        if (!valuesEqual(a, b)) frame->ip += offset;
+        break;
+      }
+      case REG_JUMP_IF_NOT_EQUAL_K: {
+        Value a = REGISTER();
+        Value b = READ_CONSTANT();
+        uint16_t offset = READ_SHORT();
+        if (!valuesEqual(a, b)) frame->ip += offset;
+        break;
+      }
+      case REG_JUMP_IF_NOT_GREATER:
+        COMPARE_JUMP(greaterThan, REGISTER);
+        break;
+      case REG_JUMP_IF_NOT_GREATER_K:
+        COMPARE_JUMP(greaterThan, READ_CONSTANT);
+        break;
+      case REG_JUMP_IF_NOT_LESS:
+        COMPARE_JUMP(lessThan, REGISTER);
+        break;
+      case REG_JUMP_IF_NOT_LESS_K:
+        COMPARE_JUMP(lessThan, READ_CONSTANT);
+        break;
+      case REG_CALL: {
+        uint8_t base = READ_BYTE();
+        uint8_t arg_count = READ_BYTE();
+        Value callee = frame->slots[base];
+        vm->sp = &frame->slots[base + arg_count + 1];
+
+        if (IS_CLOSURE(callee) &&
+            AS_CLOSURE(callee)->function->arity == arg_count &&
+            AS_CLOSURE(callee)->function->tier == TIER_REGISTERS &&
+            vm->frame_count < CLOX_FRAMES_MAX) {
+          ObjClosure *closure = AS_CLOSURE(callee);
+          frame = &vm->frames[vm->frame_count++];
+          frame->closure = closure;
+          frame->ip = closure->function->registers->code;
+          frame->slots = vm->sp - arg_count - 1;
+          break;
+        }
+
+        if (!callValue(callee, arg_count)) return INTERPRET_RUNTIME_ERROR;
+
+        ENTER_FRAME();
+        break;
+      }
+      case REG_TAIL_CALL: {
+        uint8_t base = READ_BYTE();
+        uint8_t arg_count = READ_BYTE();
+        Value callee = frame->slots[base];
+        vm->sp = &frame->slots[base + arg_count + 1];
+        if (!IS_CLOSURE(callee)) {
+          // no frame to reuse, the REG_RETURN that follows returns the result.
+          if (!callValue(callee, arg_count)) return INTERPRET_RUNTIME_ERROR;
+          ENTER_FRAME();
+          break;
+        }
+
+        if (!reuseFrame(frame, AS_CLOSURE(callee), arg_count)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        ENTER_FRAME();
+        break;
+      }
+      case REG_CALL_NATIVE: {
+        uint8_t base = READ_BYTE();
+        ObjString *name = READ_STRING();
+        uint8_t arg_count = READ_BYTE();
+        vm->sp = &frame->slots[base + arg_count];
+        if (!callGlobal(name, arg_count, NULL)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        ENTER_FRAME();
+        break;
+      }
+      case REG_TAIL_CALL_NATIVE: {
+        uint8_t base = READ_BYTE();
+        ObjString *name = READ_STRING();
+        uint8_t arg_count = READ_BYTE();
+        vm->sp = &frame->slots[base + arg_count];
+        if (!callGlobal(name, arg_count, frame)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        ENTER_FRAME();
+        break;
+      }
+      case REG_CLOSURE: {
+        Value *dst = &REGISTER();
+        ObjFunction *function = AS_FUNCTION(READ_CONSTANT());
+        ObjClosure *closure = newClosure(function);
+        *dst = OBJ_VAL(closure);
+        frame->ip = captureUpvalues(closure, frame, frame->ip);
+        break;
+      }
+      case REG_CLOSE_UPVALUE:
+        closeUpvalue(&REGISTER());
+        break;
+      case REG_RETURN: {
+        Value ret_value = REGISTER();
+        closeUpvalue(frame->slots);
+
+        --vm->frame_count;
+        frame->slots[0] = ret_value;
+        vm->sp = frame->slots + 1;
+        if (vm->frame_count == exit_frame_count) return INTERPRET_OK;
+
+        frame = &vm->frames[vm->frame_count - 1];
+        break;
+      }
+    }
+  }
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef READ_STRING
+#undef REGISTER
+#undef BINARY_OP
+#undef COMPARE_JUMP
+#undef ENTER_FRAME
+}
+
+// runs the frame on top in the tier of its function until it returns.
+static InterpretResult runFrame() {
+  CallFrame *frame = &vm->frames[vm->frame_count - 1];
+  ObjFunction *function = frame->closure->function;
+  if (function->tier == TIER_WARMING) warmUp(function);
+
+  switch (function->tier) {
+    case TIER_REGISTERS:
+      return runRegisters();
+    case TIER_NATIVE: {
+      int offset = (int)(frame->ip - function->chunk.code);
+      switch (enterNative(function->jit, frame, offset)) {
+        case JIT_RETURNED:
+          return INTERPRET_OK;
+        case JIT_FALLBACK:
+          return run();
+        case JIT_ERROR:
+          return INTERPRET_RUNTIME_ERROR;
+      }
+      return INTERPRET_RUNTIME_ERROR;  // unreachable.
+    }
+    case TIER_STACK:
+    case TIER_WARMING:
+      break;
+  }
   return run();
 }
 
+bool jitCall(int arg_count) {
+  int frame_count = vm->frame_count;
+  if (!callValue(peek(arg_count), arg_count)) return false;
+  return vm->frame_count == frame_count || runFrame() == INTERPRET_OK;
+}
+
+bool jitCallGlobal(ObjString *name, int arg_count) {
+  int frame_count = vm->frame_count;
+  if (!callGlobal(name, arg_count, NULL)) return false;
+  return vm->frame_count == frame_count || runFrame() == INTERPRET_OK;
+}
+
+bool jitHoldsNative(ObjString *name) {
+  Value value;
+  return tableGet(&vm->globals, name, &value) && IS_NATIVE_FN(value);
+}
+
+bool jitInvoke(ObjString *name, int arg_count, PropertyCache *cache) {
+  int frame_count = vm->frame_count;
+  if (!invoke(name, arg_count, cache)) return false;
+  return vm->frame_count == frame_count || runFrame() == INTERPRET_OK;
+}
+
+bool jitInvokeSuper(ObjString *name, int arg_count) {
+  ObjClass *superclass = AS_CLASS(pop());
+  if (!invokeSuper(superclass, name, arg_count)) return false;
+  return runFrame() == INTERPRET_OK;
+}
+
+void jitClosure(CallFrame *frame) {
+  ObjFunction *function = AS_FUNCTION(
+      frame->closure->function->chunk.constants.values[*frame->ip++]);
+  ObjClosure *closure = newClosure(function);
+  push(OBJ_VAL(closure));
+  frame->ip = captureUpvalues(closure, frame, frame->ip);
+}
+
+void jitCloseUpvalue(Value *last) { closeUpvalue(last); }
+
+void jitBuildList(int item_count) {
+  ObjList *list = newList();
+  for (int i = item_count; i > 0; --i) {
+    writeValueArray(&list->items, vm->sp[-i]);
+  }
+  vm->sp -= item_count;
+  push(OBJ_VAL(list));
+}
+
+bool jitBuildMap(int entry_count) {
+  Value *entries = vm->sp - entry_count * 2;
+  for (int i = 0; i < entry_count * 2; i += 2) {
+    if (!checkKey(entries[i])) return false;
+  }
+
+  ObjMap *map = newMap();
+  for (int i = 0; i < entry_count * 2; i += 2) {
+    tableSetValue(&map->table, entries[i], entries[i + 1]);
+  }
+  vm->sp = entries;
+  push(OBJ_VAL(map));
+  return true;
+}
+
+bool jitGetProperty(ObjString *name, PropertyCache *cache) {
+  Value receiver = peek(0);
+  if (!IS_INSTANCE(receiver)) {
+    runtimeError("only instances have properties");
+    return false;
+  }
+
+  ObjInstance *instance = AS_INSTANCE(receiver);
+  if (!lookUpProperty(instance, name, cache)) return false;
+
+  vm->sp[-1] = cache->method
+                   ? OBJ_VAL(newBoundMethod(receiver, cache->method))
+                   : instance->fields[cache->slot];
+  return true;
+}
+
+bool jitSetProperty(ObjString *name, PropertyCache *cache) {
+  Value receiver = peek(1);
+  if (!IS_INSTANCE(receiver)) {
+    runtimeError("only instances have fields");
+    return false;
+  }
+
+  ObjInstance *instance = AS_INSTANCE(receiver);
+  if (instance->shape != cache->shape) {
+    cache->shape = instance->shape;
+    cache->slot = shapeSlot(instance->shape, name);
+    cache->transition = NULL;
+    cache->method = NULL;
+    if (cache->slot < 0) {
+      cache->slot = instance->shape->slot_count;
+      cache->transition = shapeTransition(instance->shape, name);
+    }
+  }
+
+  if (cache->transition) {
+    growFields(instance, cache->slot + 1);
+    instance->shape = cache->transition;
+  }
+  instance->fields[cache->slot] = peek(0);
+
+  // the assignment evaluates to the value assigned.
+  Value value = pop();
+  vm->sp[-1] = value;
+  return true;
+}
+
+void jitReturn(CallFrame *frame) {
+  Value ret_value = pop();
+  closeUpvalue(frame->slots);
+
+  --vm->frame_count;
+  vm->sp = frame->slots;
+  push(ret_value);
+}
+
+ObjNativeFn *defineNativeFn(const char *name, int arity, uint8_t flags,
+                            NativeFn fn) {
+  push(OBJ_VAL(copyString(name, strlen(name))));
+  push(OBJ_VAL(newNativeFn(fn, arity, flags)));
+  tableSet(&vm->globals, AS_STRING(peek(1)), peek(0));
+  ObjNativeFn *nativeFn = AS_NATIVE_FN(pop());
+  pop();
+  return nativeFn;
+}
+
+static bool nativeClock(int arg_count, Value *args, Value *result) {
+  *result = NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+  return true;
+}
+
+static bool nativePrintln(int arg_count, Value *args, Value *result) {
+  for (int i = 0; i < arg_count; ++i) {
+    if (i > 0) writeChars(" ", 1);
+    writeValue(args[i]);
+  }
+  writeLine();
+
+  return true;
+}
+
+static bool nativeFlush(int arg_count, Value *args, Value *result) {
+  flushOutput();
+  *result = NIL_VAL;
+  return true;
+}
+
+static bool nativeLen(int arg_count, Value *args, Value *result) {
+  if (IS_STRING(args[0])) {
+    *result = INT_VAL(AS_STRING(args[0])->length);
+  } else if (IS_BUFFER(args[0])) {
+    *result = INT_VAL(AS_BUFFER(args[0])->length);
+  } else if (IS_LIST(args[0])) {
+    *result = INT_VAL(AS_LIST(args[0])->items.size);
+  } else if (IS_MAP(args[0])) {
+    *result = INT_VAL(AS_MAP(args[0])->table.count);
+  } else if (IS_ARRAY(args[0])) {
+    *result = INT_VAL(AS_ARRAY(args[0])->length);
+  } else if (IS_STRING_BUILDER(args[0])) {
+    *result = INT_VAL(AS_STRING_BUILDER(args[0])->length);
+  } else {
+    return nativeError(
+        "len() expects a string, a buffer, a list, a map, an array or a "
+        "string builder");
+  }
+
+  return true;
+}
+
+static bool nativeListPush(int arg_count, Value *args, Value *result) {
+  if (!IS_LIST(args[0])) return nativeError("listPush() expects a list");
+
+  writeValueArray(&AS_LIST(args[0])->items, args[1]);
+  *result = NIL_VAL;
+  return true;
+}
+
+static bool nativeListPop(int arg_count, Value *args, Value *result) {
+  if (!IS_LIST(args[0])) return nativeError("listPop() expects a list");
+
+  ValueArray *items = &AS_LIST(args[0])->items;
+  if (items->size == 0) return nativeError("listPop() from an empty list");
+
+  *result = items->values[--items->size];
+  return true;
+}
+
+static bool nativeMapHas(int arg_count, Value *args, Value *result) {
+  if (!IS_MAP(args[0])) return nativeError("mapHas() expects a map");
+
+  Value value;
+  *result = BOOL_VAL(tableGetValue(&AS_MAP(args[0])->table, args[1], &value));
+  return true;
+}
+
+static bool nativeMapRemove(int arg_count, Value *args, Value *result) {
+  if (!IS_MAP(args[0])) return nativeError("mapRemove() expects a map");
+
+  *result = BOOL_VAL(tableDeleteValue(&AS_MAP(args[0])->table, args[1]));
+  return true;
+}
+
+// the keys of a map in insertion order.
+static bool nativeMapKeys(int arg_count, Value *args, Value *result) {
+  if (!IS_MAP(args[0])) return nativeError("mapKeys() expects a map");
+
+  Table *table = &AS_MAP(args[0])->table;
+  ObjList *keys = newList();
+  for (int i = 0; i < table->size; ++i) {
+    if (IS_NIL(table->entries[i].key)) continue;
+    writeValueArray(&keys->items, table->entries[i].key);
+  }
+
+  *result = OBJ_VAL(keys);
+  return true;
+}
+
+static bool nativeByteAt(int arg_count, Value *args, Value *result) {
+  if (!IS_BUFFER(args[0]) || !IS_NUMERIC(args[1])) {
+    return nativeError("byteAt() expects a buffer and an index");
+  }
+
+  ObjBuffer *buffer = AS_BUFFER(args[0]);
+  double index = AS_DOUBLE(args[1]);
+  if (!(index >= 0 && index < buffer->length) || index != (int)index) {
+    return nativeError("buffer index out of range");
+  }
+
+  *result = INT_VAL(buffer->bytes[(int)index]);
+  return true;
+}
+
+static void initNativeFunctions() {
+  defineNativeFn("clock", 0, 0, nativeClock);
+  defineNativeFn("println", 0, NATIVE_VARIADIC, nativePrintln);
+  defineNativeFn("flush", 0, 0, nativeFlush);
+  defineNativeFn("len", 1, 0, nativeLen);
+  defineNativeFn("byteAt", 2, 0, nativeByteAt);
+  defineNativeFn("listPush", 2, 0, nativeListPush);
+  defineNativeFn("listPop", 1, 0, nativeListPop);
+  defineNativeFn("mapHas", 2, 0, nativeMapHas);
+  defineNativeFn("mapRemove", 2, 0, nativeMapRemove);
+  defineNativeFn("mapKeys", 1, 0, nativeMapKeys);
+  defineArrayNatives();
+  defineTextNatives();
+  defineIoNatives();
+}
+
+static InterpretResult runScript(ObjClosure *closure) {
+  push(OBJ_VAL(closure));
+  call(closure, 0);
+
+  InterpretResult result = runFrame();
+  if (result == INTERPRET_OK) pop();
+  flushOutput();
+  return result;
+}
+
+InterpretResult callFunction(int arg_count) {
+  Value callee = peek(arg_count);
+  int frame_count = vm->frame_count;
+  if (!callValue(callee, arg_count)) return INTERPRET_RUNTIME_ERROR;
+  return vm->frame_count == frame_count ? INTERPRET_OK : runFrame();
+}
+
+InterpretResult interpret(const char *source) {
+  ObjFunction *function = compile(source);
+  if (!function) {
+    return INTERPRET_COMPILE_ERROR;
+  }
+
+  return runScript(newClosure(function));
+}
+
+// loads a program the first time this vm runs it, later runs start from the
+// same script closure.
+static ObjClosure *loadedScript(Program *program) {
+  for (int i = 0; i < vm->program_count; ++i) {
+    if (vm->programs[i].program == program) return vm->programs[i].script;
+  }
+
+  if (vm->program_capacity < vm->program_count + 1) {
+    int old_capacity = vm->program_capacity;
+    vm->program_capacity = GROW_CAPACITY(old_capacity);
+    vm->programs = GROW_ARRAY(vm->programs, LoadedProgram, old_capacity,
+                              vm->program_capacity);
+  }
+
+  ObjClosure *script = newClosure(loadProgram(program));
+  vm->programs[vm->program_count++] = (LoadedProgram){program, script};
+  return script;
+}
+
+InterpretResult interpretProgram(Program *program) {
+  return runScript(loadedScript(program));
+}
+
 void push(Value value) {
-  *vm.sp = value;
-  ++vm.sp;
+  *vm->sp = value;
+  ++vm->sp;
 }
 
 Value pop() {
-  --vm.sp;
-  return *vm.sp;
+  --vm->sp;
+  return *vm->sp;
 }
\ No newline at end of file
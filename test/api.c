@@ -0,0 +1,175 @@
+// drives the embedding interface the way a host program would. make test
+// builds it against the interpreter and runs it, it prints what failed and
+// exits with 1, the runtime errors it provokes on purpose go to stderr.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "clox.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                               \
+  do {                                                                 \
+    if (!(condition)) {                                                \
+      printf("%s:%d: failed %s\n", __FILE__, __LINE__, #condition);    \
+      ++failures;                                                      \
+    }                                                                  \
+  } while (false)
+
+// the vm the natives below call back into.
+static CloxVM *current;
+
+static bool add(int arg_count, CloxValue *args, CloxValue *result) {
+  if (!cloxIsNumber(args[0]) || !cloxIsNumber(args[1])) {
+    return cloxError("add() expects two numbers");
+  }
+  *result = cloxNumber(cloxAsNumber(args[0]) + cloxAsNumber(args[1]));
+  return true;
+}
+
+static bool count(int arg_count, CloxValue *args, CloxValue *result) {
+  *result = cloxInt(arg_count);
+  return true;
+}
+
+// calls its first argument with the rest.
+static bool apply(int arg_count, CloxValue *args, CloxValue *result) {
+  if (arg_count == 0) return cloxError("apply() expects a callee");
+  if (cloxCall(current, args[0], arg_count - 1, args + 1, result) != CLOX_OK) {
+    return cloxError("apply() failed");
+  }
+  return true;
+}
+
+static bool getGlobal(CloxVM *instance, const char *name, CloxValue *value) {
+  *value = cloxNil();
+  return cloxGetGlobal(instance, name, value);
+}
+
+static void testArity() {
+  CloxVM *instance = cloxNewVM();
+  CHECK(!cloxDefineNative(instance, "add", 256, add));
+  CHECK(!cloxDefineNative(instance, "add", -2, add));
+  CHECK(cloxDefineNative(instance, "add", 2, add));
+  CHECK(cloxDefineNative(instance, "count", CLOX_VARIADIC, count));
+
+  CloxValue value;
+  CHECK(cloxInterpret(instance, "let a = add(1, 2.5);") == CLOX_OK);
+  CHECK(getGlobal(instance, "a", &value) && cloxAsNumber(value) == 3.5);
+  CHECK(cloxInterpret(instance, "let b = count(1, 2, 3);") == CLOX_OK);
+  CHECK(getGlobal(instance, "b", &value) && cloxAsInt(value) == 3);
+  CHECK(cloxInterpret(instance, "add(1);") == CLOX_RUNTIME_ERROR);
+  CHECK(cloxInterpret(instance, "add(1, 2, 3);") == CLOX_RUNTIME_ERROR);
+  CHECK(cloxInterpret(instance, "add(1, nil);") == CLOX_RUNTIME_ERROR);
+  cloxFreeVM(instance);
+}
+
+static void testReentry() {
+  CloxVM *instance = cloxNewVM();
+  current = instance;
+  CHECK(cloxDefineNative(instance, "add", 2, add));
+  CHECK(cloxDefineNative(instance, "apply", CLOX_VARIADIC, apply));
+
+  // lox calls the host, which calls lox, which calls the host again.
+  CHECK(cloxInterpret(instance,
+                      "fun twice(x) { return apply(add, x, x); }\n"
+                      "let r = apply(twice, 21);") == CLOX_OK);
+  CloxValue value;
+  CHECK(getGlobal(instance, "r", &value) && cloxAsNumber(value) == 42);
+
+  CloxValue twice, args[1] = {cloxInt(5)}, result;
+  CHECK(getGlobal(instance, "twice", &twice));
+  CHECK(cloxCall(instance, twice, 1, args, &result) == CLOX_OK);
+  CHECK(cloxAsNumber(result) == 10);
+  CHECK(cloxCall(instance, twice, 256, args, &result) == CLOX_RUNTIME_ERROR);
+  CHECK(cloxInterpret(instance, "apply(apply);") == CLOX_RUNTIME_ERROR);
+  cloxFreeVM(instance);
+}
+
+static void testBuffers() {
+  CloxVM *instance = cloxNewVM();
+  uint8_t bytes[] = {1, 2, 3};
+  cloxSetGlobal(instance, "wrapped", cloxWrapBuffer(instance, bytes, 3));
+
+  CloxValue owned = cloxNewBuffer(instance, 2);
+  int length;
+  uint8_t *owned_bytes = cloxBufferBytes(owned, &length);
+  CHECK(length == 2);
+  owned_bytes[0] = 7;
+  owned_bytes[1] = 9;
+  cloxSetGlobal(instance, "owned", owned);
+
+  CHECK(cloxInterpret(instance,
+                      "let sum = byteAt(wrapped, 0) + byteAt(wrapped, 2) +\n"
+                      "    byteAt(owned, 1) + len(wrapped) + len(owned);") ==
+        CLOX_OK);
+  CloxValue value;
+  CHECK(getGlobal(instance, "sum", &value) && cloxAsInt(value) == 18);
+  CHECK(getGlobal(instance, "wrapped", &value) && cloxIsBuffer(value));
+  CHECK(cloxBufferBytes(value, NULL) == bytes);
+  cloxFreeVM(instance);
+}
+
+static void testSharedProgram() {
+  CloxProgram *program = cloxCompile(
+      "fun bump() { runs = runs + 1; return runs; }\n"
+      "bump();");
+  CHECK(program != NULL);
+  CHECK(cloxCompile("let = ;") == NULL);
+
+  CloxVM *first = cloxNewVM();
+  CloxVM *second = cloxNewVM();
+  cloxSetGlobal(first, "runs", cloxInt(0));
+  cloxSetGlobal(second, "runs", cloxInt(100));
+
+  CHECK(cloxRunProgram(first, program) == CLOX_OK);
+  CHECK(cloxRunProgram(first, program) == CLOX_OK);
+  CHECK(cloxRunProgram(second, program) == CLOX_OK);
+
+  CloxValue value;
+  CHECK(getGlobal(first, "runs", &value) && cloxAsInt(value) == 2);
+  CHECK(getGlobal(second, "runs", &value) && cloxAsInt(value) == 101);
+
+  // each vm keeps the program loaded after the host lets go of it.
+  cloxReleaseProgram(program);
+  CHECK(cloxInterpret(second, "bump();") == CLOX_OK);
+  CHECK(getGlobal(second, "runs", &value) && cloxAsInt(value) == 102);
+  cloxFreeVM(first);
+  cloxFreeVM(second);
+}
+
+static void testStack() {
+  CloxVM *instance = cloxNewVM();
+  CHECK(cloxIsNil(cloxPop(instance)));
+  CHECK(cloxIsNil(cloxPeek(instance, 0)));
+
+  CHECK(cloxPush(instance, cloxInt(1)));
+  CHECK(cloxPush(instance, cloxBool(true)));
+  CHECK(cloxAsInt(cloxPeek(instance, 1)) == 1);
+  CHECK(cloxIsNil(cloxPeek(instance, 2)));
+  CHECK(cloxIsNil(cloxPeek(instance, -1)));
+  CHECK(cloxAsBool(cloxPop(instance)));
+  CHECK(cloxAsInt(cloxPop(instance)) == 1);
+
+  int pushed = 0;
+  while (cloxPush(instance, cloxNil())) ++pushed;
+  CHECK(pushed > 0);
+  while (pushed-- > 0) cloxPop(instance);
+  CHECK(cloxIsNil(cloxPeek(instance, 0)));
+  cloxFreeVM(instance);
+}
+
+int main() {
+  testArity();
+  testReentry();
+  testBuffers();
+  testSharedProgram();
+  testStack();
+
+  if (failures > 0) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
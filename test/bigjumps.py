@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Writes a script whose jumps and loops span more than 64KB of bytecode.
+
+The then branches of near() end 65534 and 65535 bytes past their jump, in
+reach of 16 bits until the jump over the long else branch is widened.
+'x = -y;' takes 6 bytes and 'x = -(-y);' 7.
+"""
+
+
+def near(name, sixes, sevens):
+    print("fun %s(c) {" % name)
+    print("  let x = 0;")
+    print("  let y = 1;")
+    print("  if c {")
+    print("    x = -y;\n" * sixes + "    x = -(-y);\n" * sevens, end="")
+    print("  } else {")
+    print("    x = -y;\n" * 11000, end="")
+    print("  }")
+    print("  return x;")
+    print("}")
+    print("println(%s(true), %s(false));" % (name, name))
+
+
+def main():
+    print("fun big(n) {")
+    print("  let x = 0;")
+    print("  let y = 1;")
+    print("  let i = 0;")
+    print("  loop i < n {")
+    print("    x = x + y;\n" * 15000, end="")
+    print("    i = i + 1;")
+    print("  }")
+    print("  if n > 100 {")
+    print("    x = x + y;\n" * 15000, end="")
+    print("  } else {")
+    print("    x = x - 1;")
+    print("  }")
+    print("  if n > 1 and x > 0 {")
+    print("    x = x + y;\n" * 100, end="")
+    print("  }")
+    print("  return x;")
+    print("}")
+    print("println(big(2));")
+    print("println(big(200));")
+    print("let total = 0;")
+    print("loop let i = 0; i < 150; i = i + 1 {")
+    print("  total = total + big(1);")
+    print("}")
+    print("println(total);")
+
+    # 4 bytes of the jump and the pop at the start of the branch.
+    near("near65534", 10917, 4)
+    near("near65535", 10916, 5)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,18 @@
+#!/usr/bin/env python3
+"""Writes a script whose fused 'i < constant' loop test jumps over more than
+64KB of bytecode."""
+
+
+def main():
+    print("fun f() {")
+    print("  let t = 0;")
+    print("  loop let i = 0; i < 3; i = i + 1 {")
+    print("    t = t + i;\n" * 12000, end="")
+    print("  }")
+    print("  return t;")
+    print("}")
+    print("println(f());")
+
+
+if __name__ == "__main__":
+    main()
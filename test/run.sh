@@ -0,0 +1,35 @@
+#!/bin/sh
+# runs every script in this directory with the interpreter and flags given,
+# and compares what it prints to stdout and stderr, followed by its exit
+# status, with the .out file next to it. scripts too large to keep are
+# written by the .py file of the same name first. CLOX_RECORD=1 rewrites the
+# .out files instead.
+#
+# usage: test/run.sh path/to/clox [flags...]
+
+clox=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+shift
+cd "$(dirname "$0")" || exit 1
+
+generated=$(mktemp -d) || exit 1
+trap 'rm -rf "$generated"' EXIT
+for generator in *.py; do
+  [ -e "$generator" ] || continue
+  python3 "$generator" > "$generated/${generator%.py}.lox" || exit 1
+done
+
+failed=0
+for script in *.lox "$generated"/*.lox; do
+  [ -e "$script" ] || continue
+  name=$(basename "$script")
+  expected=${name%.lox}.out
+  actual=$("$clox" "$@" "$script" 2>&1; echo "exit=$?")
+  if [ -n "$CLOX_RECORD" ]; then
+    printf '%s\n' "$actual" > "$expected"
+  elif ! printf '%s\n' "$actual" | diff -u "$expected" - > /dev/null; then
+    echo "FAIL $name $*"
+    printf '%s\n' "$actual" | diff -u "$expected" - | head -20
+    failed=1
+  fi
+done
+exit $failed
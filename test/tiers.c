@@ -0,0 +1,113 @@
+// checks which tier each function of a script runs on with each option, so
+// a function that stops translating to register code, or an instruction the
+// register tier does not translate yet, shows up here.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
+
+// one function per kind of instruction, each called often enough to get
+// jitted.
+static const char *source =
+    "fun arith(a, b) { return a * b - a / b; }\n"
+    "fun calls(n) { return arith(n, 2) + len(\"ab\"); }\n"
+    "fun lists(n) { return [n, n][1]; }\n"
+    "fun maps(n) { return {\"n\": n}[\"n\"]; }\n"
+    "class Point {\n"
+    "  init(x) { this.x = x; }\n"
+    "  get() { return this.x; }\n"
+    "}\n"
+    "fun properties(n) { let p = Point(n); p.x = n; return p.x; }\n"
+    "fun invokes(n) { return Point(n).get(); }\n"
+    "fun ints(n) { return n % 3 + n ~/ 2; }\n"
+    "loop let i = 0; i < 200; i = i + 1 {\n"
+    "  arith(i, 2); calls(i); lists(i); maps(i);\n"
+    "  properties(i); invokes(i); ints(i);\n"
+    "}\n";
+
+typedef struct {
+  const char *name;
+  FunctionTier registers;  // the tier with --registers.
+} Expected;
+
+// the register tier does not translate collections, properties, methods,
+// or % and ~/, so those functions stay on the stack.
+static const Expected expected[] = {
+    {"arith", TIER_REGISTERS},
+    {"calls", TIER_REGISTERS},
+    {"lists", TIER_STACK},
+    {"maps", TIER_STACK},
+    {"properties", TIER_STACK},
+    {"invokes", TIER_STACK},
+    {"ints", TIER_STACK},
+};
+
+// the platforms the jit emits code for, as in jit.c.
+#if defined(__x86_64__) && defined(__linux__)
+#define JITTED TIER_NATIVE
+#else
+#define JITTED TIER_STACK
+#endif
+
+static const char *tierName(FunctionTier tier) {
+  switch (tier) {
+    case TIER_STACK:
+      return "stack";
+    case TIER_REGISTERS:
+      return "registers";
+    case TIER_WARMING:
+      return "warming";
+    case TIER_NATIVE:
+      return "native";
+  }
+  return "unknown";
+}
+
+// runs the script with the options given and checks the tier every function
+// ended up on.
+static int check(const char *mode, bool registers, bool jit) {
+  compiler_options.registers = registers;
+  compiler_options.jit = jit;
+  VM *instance = newVM();
+  if (interpret(source) != INTERPRET_OK) {
+    printf("%s: the script failed\n", mode);
+    freeVM(instance);
+    return 1;
+  }
+
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(expected) / sizeof(*expected); ++i) {
+    FunctionTier tier = TIER_STACK;
+    if (registers) {
+      tier = expected[i].registers;
+    } else if (jit) {
+      tier = JITTED;
+    }
+
+    const char *name = expected[i].name;
+    Value value;
+    ObjString *key = copyString(name, strlen(name));
+    if (!tableGet(&vm->globals, key, &value) || !IS_CLOSURE(value)) {
+      printf("%s: %s is not defined\n", mode, name);
+      ++failures;
+    } else if (AS_CLOSURE(value)->function->tier != tier) {
+      printf("%s: %s runs on the %s tier instead of the %s tier\n", mode,
+             name, tierName(AS_CLOSURE(value)->function->tier),
+             tierName(tier));
+      ++failures;
+    }
+  }
+
+  freeVM(instance);
+  return failures;
+}
+
+int main() {
+  int failures = check("stack", false, false) +
+                 check("registers", true, false) + check("jit", false, true);
+  return failures > 0 ? 1 : 0;
+}
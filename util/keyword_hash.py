@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Generates the keyword tables of identifierType() in src/scanner.c.
+
+Searches for values of the first and last characters of the keywords such
+that length + first[c0] + last[cN] - offset maps every keyword to its own
+slot in 0..len(KEYWORDS)-1. Rerun it after adding a keyword and replace the
+tables in src/scanner.c, from "#define X" to the keywords array, with its
+output. identifierType() also rejects identifiers longer than the longest
+keyword, which has to be kept in step by hand:
+
+    python3 util/keyword_hash.py
+"""
+
+import random
+import sys
+
+# every keyword of TokenType, with its token.
+KEYWORDS = [
+    ("and", "TOKEN_AND"),
+    ("class", "TOKEN_CLASS"),
+    ("else", "TOKEN_ELSE"),
+    ("false", "TOKEN_FALSE"),
+    ("fun", "TOKEN_FUN"),
+    ("if", "TOKEN_IF"),
+    ("let", "TOKEN_LET"),
+    ("loop", "TOKEN_LOOP"),
+    ("nil", "TOKEN_NIL"),
+    ("or", "TOKEN_OR"),
+    ("return", "TOKEN_RETURN"),
+    ("super", "TOKEN_SUPER"),
+    ("this", "TOKEN_THIS"),
+    ("true", "TOKEN_TRUE"),
+]
+
+# the value of characters that never start or end a keyword, large enough
+# to map any identifier using them out of range.
+UNUSED = 64
+SEED = 1
+MAX_VALUE = len(KEYWORDS)
+
+
+def search():
+    rng = random.Random(SEED)
+    firsts = sorted({word[0] for word, _ in KEYWORDS})
+    lasts = sorted({word[-1] for word, _ in KEYWORDS})
+    for _ in range(10_000_000):
+        first = {c: rng.randrange(MAX_VALUE) for c in firsts}
+        last = {c: rng.randrange(MAX_VALUE) for c in lasts}
+        sums = [len(w) + first[w[0]] + last[w[-1]] for w, _ in KEYWORDS]
+        offset = min(sums)
+        if sorted(sums) == list(range(offset, offset + len(KEYWORDS))):
+            return first, last, offset
+    sys.exit("no perfect hash found, raise MAX_VALUE")
+
+
+def table(name, values):
+    cells = [str(values.get(chr(ord("a") + i), "X")) for i in range(26)]
+    rows = [cells[:13], cells[13:]]
+    lines = ["    " + ", ".join(row) + "," for row in rows]
+    return "static const uint8_t %s[26] = {\n%s\n};\n" % (name, "\n".join(lines))
+
+
+def main():
+    first, last, offset = search()
+    slots = sorted(KEYWORDS, key=lambda k: len(k[0]) + first[k[0][0]] +
+                   last[k[0][-1]])
+
+    print("#define X %d" % UNUSED)
+    print("#define KEYWORD_HASH_OFFSET %d" % offset)
+    print()
+    print(table("keyword_first_values", first))
+    print(table("keyword_last_values", last))
+    print("#undef X")
+    print()
+    print("typedef struct {")
+    print("  const char *chars;")
+    print("  int length;")
+    print("  TokenType type;")
+    print("} Keyword;")
+    print()
+    print("static const Keyword keywords[] = {")
+    cells = ['{"%s", %d, %s},' % (w, len(w), t) for w, t in slots]
+    width = max(len(cell) for cell in cells[::2])
+    for i in range(0, len(cells), 2):
+        print(("    " + cells[i].ljust(width) + " " +
+               " ".join(cells[i + 1:i + 2])).rstrip())
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+"""Writes identifier heavy source to time the scanner's keyword lookup.
+
+Mixes keywords, identifiers that share their first and last characters or
+length, and unrelated identifiers. The output only has to scan, run it with
+
+    python3 util/lex_bench.py > idents.lox
+    clox --lex-only idents.lox
+"""
+
+import random
+import sys
+
+KEYWORDS = ["and", "class", "else", "false", "fun", "if", "let", "loop",
+            "nil", "or", "return", "super", "this", "true"]
+NEAR = ["thistle", "trueness", "superb", "returned", "elsewhere", "classy",
+        "loopy", "letter", "iffy", "lot", "thing", "result", "format",
+        "final", "nothing", "order"]
+OTHER = ["alpha", "beta", "delta", "value", "index", "string", "counter",
+         "total"]
+SEED = 1
+
+
+def main():
+    size = int(sys.argv[1]) if len(sys.argv) > 1 else 32 << 20
+    rng = random.Random(SEED)
+    words = KEYWORDS * 3 + NEAR * 2 + OTHER
+    out = sys.stdout
+    written = 0
+    line = []
+    while written < size:
+        word = rng.choice(words)
+        if rng.random() < 0.2:
+            word += str(rng.randrange(100))
+        line.append(word)
+        if len(line) == 12:
+            text = " ".join(line) + "\n"
+            out.write(text)
+            written += len(text)
+            line = []
+
+
+if __name__ == "__main__":
+    main()